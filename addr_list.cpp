@@ -14,7 +14,7 @@ using namespace std;
 address_list::address_list(): info {nullptr} {}
 
 // Operations borrowed from Beej's Guide
-void address_list::populate(int socktype, int port) {
+void address_list::populate(int socktype, int port, const string& host) {
     int status;
     addrinfo hints;
 
@@ -24,7 +24,7 @@ void address_list::populate(int socktype, int port) {
 
     string ps = to_string(port);
 
-    status = getaddrinfo("localhost", ps.c_str(), &hints, &info);
+    status = getaddrinfo(host.c_str(), ps.c_str(), &hints, &info);
 
     if(status != 0) {
         throw address_list_err { string{"address_list error: "} + string{gai_strerror(status)} };
@@ -1,4 +1,7 @@
+#pragma once
+
 #include <stdexcept>
+#include <string>
 #include <netdb.h>
 
 /*
@@ -11,8 +14,8 @@ public:
 
     address_list();
 
-    // populate address with loopback address, the provided port and the provided socket type
-    void populate(int socktype, int port = 0);
+    // populate address with the provided host, port and socket type, the loopback address by default
+    void populate(int socktype, int port = 0, const std::string& host = "localhost");
 
     // free occupied memory
     void free();
@@ -1,15 +1,39 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <errno.h>
+#include <filesystem>
 #include <fstream>
-#include <iostream>
-#include <sstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <poll.h>
+#include <random>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <tuple>
 #include <unistd.h>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "socket.h"
 #include "backend.h"
 #include "constants.h"
+#include "event_loop.h"
+#include "logger.h"
+#include "reservation_log.h"
+#include "room_table.h"
+#include "spsc_queue.h"
+#include "stats.h"
 
 using namespace std;
 using namespace socket_constants;
@@ -21,18 +45,156 @@ public:
 };
 
 
+// tentative decrements of a prepared group reservation, held until the main server commits or aborts it
+struct group_hold {
+    vector<string> rooms;
+    chrono::steady_clock::time_point expires;
+
+    // hash of the room lines of the prepare, which a repeated prepare matches
+    size_t digest;
+};
+
+
+// the room status of a backend server along with its group reservation state
+struct backend_state {
+    // the room status information is stored as a flat hash table, mapping the rooms to their counts
+    room_table room_status;
+
+    // rooms moved to other backend servers along with their counts when they left,
+    // so a repeated move from the main server is answered consistently
+    unordered_map<string, int> moved_out {};
+
+    // durable record of the reservations made, replayed on top of the room status file at startup
+    reservation_log log;
+
+    // prepared group reservations, keyed by the main server port and transaction id
+    unordered_map<string, group_hold> holds {};
+
+    // outcomes of recently finished group reservations, true if committed, along with the time each is forgotten,
+    // so a repeated commit or abort from the main server is answered consistently
+    unordered_map<string, pair<bool, chrono::steady_clock::time_point>> decided {};
+    deque<pair<chrono::steady_clock::time_point, string>> decided_order {};
+};
+
+
+// a prepared group reservation not committed or aborted in this time is aborted,
+// so rooms are never held indefinitely by a main server that went away
+constexpr chrono::seconds HOLD_TIMEOUT {30};
+
+// time the outcome of a group reservation is remembered
+constexpr chrono::seconds DECIDED_TIMEOUT {60};
+
+// owner of a table slot whose room was moved to another backend server, the slot is kept since tables never shrink
+constexpr int32_t ROOM_MOVED = -1;
+
+// most requests handled before their reservations are flushed to disk and their responses sent
+constexpr size_t MAX_GROUP_COMMIT = 256;
+
+// most datagrams received by a single system call
+constexpr size_t MAX_BATCH_DATAGRAMS = 64;
+
+// milliseconds waited for the main server to acknowledge room status chunks before sending them again,
+// doubled on every silence up to the maximum
+constexpr int TRANSFER_RETRANSMIT_MS = 50;
+constexpr int MAX_TRANSFER_RETRANSMIT_MS = 1000;
+
+// silences after which a room status transfer the main server has acknowledged before is given up,
+// since the main server may have received every chunk and only its last acknowledgement was lost
+constexpr int MAX_TRANSFER_SILENCES = 10;
+
+// time waited for the first acknowledgement of a room status transfer before serving requests,
+// the transfer then goes on alongside the requests
+constexpr chrono::seconds TRANSFER_FIRST_ACK_WAIT {5};
+
+// most shards the rooms of a backend server may be split into
+constexpr unsigned int MAX_SHARDS = 64;
+
+// tasks and results each shard queue holds before the dispatcher waits on the shard
+constexpr size_t SHARD_QUEUE_SIZE = 4096;
+
+// bytes of requests the socket buffers, so bursts from the many sockets of the main server are not dropped
+constexpr int REQUEST_RECEIVE_BUFFER = 4 << 20;
+
+// time and number of requests that change rooms kept once handled, so a copy the main server sends again
+// is answered with the same response rather than handled twice, well beyond the time the main server resends a request
+constexpr chrono::seconds HANDLED_RETENTION {10};
+constexpr size_t MAX_HANDLED_REQUESTS = 1 << 17;
+
+// positions of the counters of a backend server within its stats registry, in the order make_stats names them
+// response codes are counted from RESPONSE_COUNTERS on, by the value of the code
+constexpr size_t AVAILABILITY_COUNTER = 0;
+constexpr size_t RESERVATION_COUNTER = 1;
+constexpr size_t BATCH_AVAILABILITY_COUNTER = 2;
+constexpr size_t BATCH_RESERVATION_COUNTER = 3;
+constexpr size_t PREPARE_COUNTER = 4;
+constexpr size_t COMMIT_COUNTER = 5;
+constexpr size_t ABORT_COUNTER = 6;
+constexpr size_t MOVE_COUNTER = 7;
+constexpr size_t ADOPT_COUNTER = 8;
+constexpr size_t STATS_COUNTER = 9;
+constexpr size_t INVALID_COUNTER = 10;
+constexpr size_t RESPONSE_COUNTERS = 11;
+
+// positions of the stages of a backend server within its stats registry
+// requests are handled, then their reservations flushed to disk together, then their responses sent together
+constexpr size_t HANDLE_STAGE = 0;
+constexpr size_t SYNC_STAGE = 1;
+constexpr size_t SEND_STAGE = 2;
+
+
+// returns the number of shards given as the argument at the provided index, or 1 if the argument is absent
+// returns 0 if the argument is not a number of shards
+unsigned int parse_shards(int argc, char* argv[], int index) {
+    if(argc <= index) return 1;
+    if(argc > index + 1) return 0;
+
+    const string arg {argv[index]};
+    if(arg.empty() || arg.size() > 2 || !all_of(arg.begin(), arg.end(), [](unsigned char c) { return isdigit(c); })) return 0;
+
+    unsigned int shards = stoi(arg);
+    return shards <= MAX_SHARDS ? shards : 0;
+}
+
+
+// the shard owning a room
+unsigned int shard_of(string_view room, unsigned int shards) {
+    return hash<string_view> {}(room) % shards;
+}
+
+
+// allocate the counters and stage histograms of a backend server, named in the order of their positions
+stats_registry make_stats(const char server_name) {
+    vector<string> counters {};
+    for(const char* type : {"availability", "reservation", "batch_availability", "batch_reservation", "prepare", "commit", "abort", "move", "adopt", "stats", "invalid"}) {
+        counters.push_back(string {"requests_total{type=\""} + type + "\"}");
+    }
+    for(const char* code : RESPONSE_CODE_NAMES) counters.push_back(string {"responses_total{code=\""} + code + "\"}");
+
+    return stats_registry {string {"server"} + server_name, counters, {"handle", "sync", "send"}};
+}
+
+
+// count a response code of an availability or reservation request, or of a request that could not be handled
+void count_response(stats_registry& stats, const string& code) {
+    stats.count(RESPONSE_COUNTERS + (code[0] - '0'));
+}
+
+
 // read the provided file and save the room counts
-unordered_map<string, int> read_status(const string& filename) {
-    unordered_map<string, int> room_status {};
+room_table read_status(const string& filename) {
     ifstream f {filename};
 
     if(!f.good()) throw backend_exception {"backend exception: read_status: file " + filename + " does not exist"};
 
+    // rooms go straight into the table, which grows as they are read
+    // the owner of a room is only meaningful to the main server
+    room_table room_status {};
+
     string room;
     int number;
     string next_line;
     while(f.good() && getline(f, room, ',') && f >> number) {
-        room_status[room] = number;
+        room_status.insert(room, 0, number);
         getline(f, next_line);
     }
 
@@ -40,133 +202,1519 @@ unordered_map<string, int> read_status(const string& filename) {
 }
 
 
-// send the room statuses to the main server
-void send_list(Socket& sock, const unordered_map<string, int>& room_status) {
-    string msg {};
+// map the snapshot of the provided file if one was made since the file last changed, or read the file otherwise
+room_table load_status(const char server_name, const string& filename) {
+    const string snapshot = filename.substr(0, filename.rfind('.')) + ".snap";
+
+    struct stat file_info, snapshot_info;
+    if(stat(snapshot.c_str(), &snapshot_info) == 0) {
+        if(stat(filename.c_str(), &file_info) == 0 && file_info.st_mtim.tv_sec > snapshot_info.st_mtim.tv_sec) {
+            logging::warning()<<"The Server "<<server_name<<" found the snapshot "<<snapshot<<" older than "<<filename<<", reading the file instead.";
+        } else {
+            // a snapshot written by another version of the table is skipped until it is made again
+            try {
+                return room_table::load(snapshot);
+            } catch(room_table_exception& re) {
+                logging::warning()<<re.what()<<", reading "<<filename<<" instead.";
+            }
+        }
+    }
+
+    return read_status(filename);
+}
+
+
+// returns the count of the provided room, or nullptr if the backend server does not have the room
+atomic<int32_t>* room_count(backend_state& state, const string& room) {
+    room_slot* slot = state.room_status.find(room);
+    return slot == nullptr || slot->owner.load(memory_order_relaxed) == ROOM_MOVED ? nullptr : &slot->count;
+}
+
+
+// the response for a room the backend server does not have, telling a room it moved out apart from one it never had
+const char* missing_room(const backend_state& state, const string& room) {
+    return state.moved_out.count(room) > 0 ? ROOM_MOVED_OUT : ROOM_NOT_FOUND;
+}
+
+
+// take over a room from another backend server, or set the count of a room already held
+void adopt_room(backend_state& state, const string& room, int count) {
+    state.moved_out.erase(room);
+    state.room_status.insert(room, 0, count);
+}
+
+
+// give up a room to another backend server, remembering the count it left with
+void move_room(backend_state& state, const string& room, int count) {
+    room_slot* slot = state.room_status.find(room);
+    if(slot != nullptr) slot->owner.store(ROOM_MOVED, memory_order_relaxed);
+
+    state.moved_out[room] = count;
+}
+
+
+// a room status transfer to the main server, sent as large sequenced chunks
+// a window of chunks is sent ahead of the acknowledgements, and chunks not acknowledged in time are sent again
+struct list_transfer {
+    // chunks of the transfer, each starting with its header line
+    vector<string> chunks {};
 
-    // send the information in pieces so as to not exceed the receive buffer size
-    for(const pair<string, int>& r : room_status) {
-        string m = r.first + ',' + to_string(r.second) + '\n';
+    // start of the acknowledgements of this transfer, followed by the next chunk the main server expects
+    string ack_prefix {};
 
-        if(msg.size() + m.size() > Socket::MAXDATASIZE - 3) {
-            sock.send_info_to(serverM_backend, msg);
-            msg = m;
-        } else msg += m;
+    // chunks the main server acknowledged, and chunks sent
+    size_t acknowledged {0};
+    size_t sent {0};
+
+    // time by which the chunks sent are to be acknowledged before they are sent again, and the milliseconds waited for them
+    chrono::steady_clock::time_point due {};
+    int timeout {TRANSFER_RETRANSMIT_MS};
+
+    // the main server may not be up yet, so the transfer is only given up once it went silent midway
+    bool heard {false};
+    int silences {0};
+
+    // whether every chunk was acknowledged, or the transfer was given up
+    bool done {false};
+};
+
+
+// split the room statuses of every shard into the chunks of a transfer to the main server
+list_transfer make_transfer(const vector<backend_state>& states) {
+    list_transfer t {};
+    string chunk {};
+
+    auto add = [&](const string& room, int count) {
+        string m = room + ',' + to_string(count) + '\n';
+
+        if(chunk.size() + m.size() > TRANSFER_CHUNK_SIZE) {
+            t.chunks.push_back(std::move(chunk));
+            chunk.clear();
+        }
+        chunk += m;
+    };
+
+    for(const backend_state& state : states) {
+        state.room_status.for_each([&](string_view code, const room_slot& slot) {
+            if(slot.owner.load(memory_order_relaxed) != ROOM_MOVED) add(string {code}, slot.count.load(memory_order_relaxed));
+        });
+    }
+
+    // a transfer always has a chunk, so the main server learns of a backend server without rooms as well
+    t.chunks.push_back(std::move(chunk));
+
+    // the transfer id tells this transfer apart from one of an earlier run of the backend server
+    const string transfer = to_string(random_device {}());
+    for(size_t i = 0; i < t.chunks.size(); i++) {
+        t.chunks[i] = TRANSFER_CHUNK + transfer + ',' + to_string(i) + ',' + to_string(t.chunks.size()) + '\n' + t.chunks[i];
+    }
+
+    t.ack_prefix = TRANSFER_CHUNK + transfer + ',';
+    return t;
+}
+
+
+// send the chunks that entered the window, or the whole window again once its chunks went unacknowledged in time
+// returns the milliseconds until the chunks sent are due, or -1 once the transfer is done
+int resend_transfer(const char server_name, Socket& sock, list_transfer& t) {
+    if(t.done) return -1;
+
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    if(t.sent > t.acknowledged && now >= t.due) {
+        if(t.heard && ++t.silences == MAX_TRANSFER_SILENCES) {
+            logging::warning()<<"The Server "<<server_name<<" received no acknowledgement for the rest of its room status from the main server.";
+            t.done = true;
+            return -1;
+        }
+
+        // send the window again, the main server keeps the chunks it already has
+        t.sent = t.acknowledged;
+        t.timeout = min(t.timeout * 2, MAX_TRANSFER_RETRANSMIT_MS);
+    }
+
+    size_t window_end = min(t.chunks.size(), t.acknowledged + TRANSFER_WINDOW);
+    if(t.sent < window_end) {
+        sock.send_many_to(serverM_backend, t.chunks.data() + t.sent, window_end - t.sent);
+        t.sent = window_end;
+        t.due = now + chrono::milliseconds {t.timeout};
+    }
+
+    return max<long>(0, chrono::ceil<chrono::milliseconds>(t.due - now).count());
+}
+
+
+// take in an acknowledgement of the room status transfer from the main server
+// returns whether the datagram is an acknowledgement, of this transfer or of an earlier one, rather than a request
+bool acknowledge_transfer(const char server_name, list_transfer& t, const msg_port& ack) {
+    if(ack.msg.compare(0, 1, TRANSFER_CHUNK) != 0) return false;
+    if(t.done || ack.port != serverM_backend || ack.msg.compare(0, t.ack_prefix.size(), t.ack_prefix) != 0) return true;
+
+    // an acknowledgement carries the next chunk the main server expects
+    size_t next = strtoul(ack.msg.c_str() + t.ack_prefix.size(), nullptr, 10);
+    if(next > t.acknowledged && next <= t.chunks.size()) t.acknowledged = next;
+
+    t.heard = true;
+    t.silences = 0;
+    t.timeout = TRANSFER_RETRANSMIT_MS;
+    t.due = chrono::steady_clock::now() + chrono::milliseconds {t.timeout};
+
+    if(t.acknowledged == t.chunks.size()) {
+        t.done = true;
+        logging::info()<<"The Server "<<server_name<<" has sent the room status to the main server.";
     }
 
-    // send the code to signify that all the status information has been sent
-    sock.send_info_to(serverM_backend, msg + ',' + FINISH_STATUS);
+    return true;
 }
 
 
-// search for the provided room and relay the information to the main server
-void availability_request(Socket& sock, const char server_name, const unordered_map<string, int>& room_status, const string& room) {
+// send the room status transfer to the main server, waiting for its acknowledgements
+// a main server that acknowledges nothing in time, such as one not up yet, has the transfer go on in the background
+// while requests are served, so a backend server restarted behind a busy or absent main server still serves
+void send_list(const char server_name, Socket& sock, list_transfer& t) {
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + TRANSFER_FIRST_ACK_WAIT;
+
+    while(true) {
+        int timeout = resend_transfer(server_name, sock, t);
+        if(t.done) return;
+
+        if(!t.heard && chrono::steady_clock::now() >= deadline) {
+            logging::info()<<"The Server "<<server_name<<" keeps sending its room status to the main server while serving requests.";
+            return;
+        }
+
+        if(!sock.wait_readable(timeout)) continue;
+
+        // requests arriving before the main server took the room status are dropped, and sent again by the main server
+        while(optional<msg_port> ack = sock.try_recv_info_from()) acknowledge_transfer(server_name, t, *ack);
+    }
+}
+
+
+// returns the sooner of two timeouts in milliseconds, where -1 waits indefinitely
+int sooner(int a, int b) {
+    if(a < 0) return b;
+    if(b < 0) return a;
+    return min(a, b);
+}
+
+
+// search for the provided room and return the response for the main server
+string availability_request(const char server_name, backend_state& state, const string& room) {
+    string response;
+
     // lookup the room status for the room
-    unordered_map<string, int>::const_iterator available = room_status.find(room);
-
-    if(available == room_status.end()) {
-        cout<<"Not able to find the room layout.\n";
-        sock.send_info_to(serverM_backend, ROOM_NOT_FOUND);
-    } else if(available->second > 0) {
-        cout<<"Room "<<room<<" is available.\n";
-        sock.send_info_to(serverM_backend, ROOM_AVAILABLE);
+    const atomic<int32_t>* available = room_count(state, room);
+
+    if(available == nullptr) {
+        logging::info()<<"Not able to find the room layout.";
+        response = missing_room(state, room);
+    } else if(available->load(memory_order_relaxed) > 0) {
+        logging::info()<<"Room "<<room<<" is available.";
+        response = ROOM_AVAILABLE;
     } else {
-        cout<<"Room "<<room<<" is not available.\n";
-        sock.send_info_to(serverM_backend, ROOM_NOT_AVAILABLE);
+        logging::info()<<"Room "<<room<<" is not available.";
+        response = ROOM_NOT_AVAILABLE;
     }
 
-    cout<<"The Server "<<server_name<<" finished sending the response to the main server.\n";
+    logging::info()<<"The Server "<<server_name<<" finished sending the response to the main server.";
+    return response;
 }
 
 
-// search for the provided room, decrement the count if available, and relay the information to the main server
-void reservation_request(Socket& sock, const char server_name, unordered_map<string, int>& room_status, const string& room) {
+// search for the provided room, decrement the count if available, and return the response for the main server
+string reservation_request(const char server_name, backend_state& state, const string& room) {
+    string response;
+
     // lookup the room status for the room
-    unordered_map<string, int>::iterator available = room_status.find(room);
+    atomic<int32_t>* available = room_count(state, room);
 
-    if(available == room_status.end()) {
-        cout<<"Cannot make a reservation. Not able to find the room layout.\n";
-        sock.send_info_to(serverM_backend, ROOM_NOT_FOUND);
-    } else if(available->second > 0) {
+    if(available == nullptr) {
+        logging::info()<<"Cannot make a reservation. Not able to find the room layout.";
+        response = missing_room(state, room);
+    } else if(available->load(memory_order_relaxed) > 0) {
         // decrement the room count
-        available->second = available->second - 1;
-        cout<<"Successful reservation. The count of Room "<<room<<" is now "<<available->second<<".\n";
+        int32_t count = available->load(memory_order_relaxed) - 1;
+        available->store(count, memory_order_relaxed);
+        state.log.append({{room, -1}});
+        logging::info()<<"Successful reservation. The count of Room "<<room<<" is now "<<count<<".";
 
         // send the new room count to the main server
-        sock.send_info_to(serverM_backend, string {ROOM_AVAILABLE} + '\n' + to_string(available->second));
+        logging::info()<<"The Server "<<server_name<<" finished sending the response and the updated room status to the main server.";
+        return string {ROOM_AVAILABLE} + '\n' + to_string(count);
+    } else {
+        logging::info()<<"Cannot make a reservation. Room "<<room<<" is not available.";
+        response = ROOM_NOT_AVAILABLE;
+    }
+
+    logging::info()<<"The Server "<<server_name<<" finished sending the response to the main server.";
+    return response;
+}
+
+
+// take the next line off the front of a request, returns false once no line is left
+// requests are split in place, without copying them into a string stream
+bool next_line(string_view& request, string_view& line) {
+    if(request.empty()) return false;
+
+    size_t end = request.find('\n');
+    line = request.substr(0, end);
+    request.remove_prefix(end == string_view::npos ? request.size() : end + 1);
+    return true;
+}
+
+
+// answer each room of a batch request on its own line, in the order of the request
+string batch_request(const char server_name, backend_state& state, string_view request_type, string_view rooms) {
+    string response;
+    string_view line;
+
+    while(next_line(rooms, line)) {
+        const string room {line};
+
+        string r;
+        if(room == "") r = ROOM_EMPTY;
+        else if(request_type == BATCH_AVAILABILITY_REQUEST) r = availability_request(server_name, state, room);
+        else r = reservation_request(server_name, state, room);
+
+        // a successful reservation carries the updated count on the same line
+        replace(r.begin(), r.end(), '\n', ',');
+
+        response += r + '\n';
+    }
+
+    return response;
+}
 
-        cout<<"The Server "<<server_name<<" finished sending the response and the updated room status to the main server.\n";
-        return;
+
+// remember the outcome of a finished group reservation
+void decide(backend_state& state, const string& key, bool committed) {
+    chrono::steady_clock::time_point forgotten = chrono::steady_clock::now() + DECIDED_TIMEOUT;
+    state.decided[key] = {committed, forgotten};
+    state.decided_order.emplace_back(forgotten, key);
+}
+
+
+// release the rooms held by a group reservation
+void release_hold(backend_state& state, const group_hold& hold) {
+    for(const string& room : hold.rooms) {
+        atomic<int32_t>* available = room_count(state, room);
+        if(available != nullptr) available->store(available->load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+}
+
+
+// tentatively reserve every room of a group reservation, answering each room on its own line
+// the rooms are held only if all of them can be reserved
+string prepare_request(const char server_name, backend_state& state, const string& key, string_view rooms) {
+    string response;
+    group_hold hold {{}, chrono::steady_clock::now() + HOLD_TIMEOUT, hash<string_view> {}(rooms)};
+    bool success = true;
+    string_view line;
+
+    // a repeated prepare finds its rooms already held
+    // a hold of other rooms under the same key was left by an earlier socket of the main server on the same port,
+    // whose transaction ids started over, so the prepare holds nothing and every room is answered as invalid
+    unordered_map<string, group_hold>::const_iterator held = state.holds.find(key);
+    if(held != state.holds.end()) {
+        const bool repeated = held->second.digest == hold.digest;
+        if(!repeated) logging::warning()<<"The Server "<<server_name<<" is already holding other rooms for the transaction of a group reservation.";
+
+        while(next_line(rooms, line)) response += string {repeated ? ROOM_AVAILABLE : INVALID_REQUEST} + '\n';
+        return response;
+    }
+
+    while(next_line(rooms, line)) {
+        const string room {line};
+        atomic<int32_t>* available = room_count(state, room);
+
+        if(available == nullptr) {
+            response += string {missing_room(state, room)} + '\n';
+            success = false;
+        } else if(available->load(memory_order_relaxed) > 0) {
+            available->store(available->load(memory_order_relaxed) - 1, memory_order_relaxed);
+            hold.rooms.push_back(room);
+            response += string {ROOM_AVAILABLE} + '\n';
+        } else {
+            response += string {ROOM_NOT_AVAILABLE} + '\n';
+            success = false;
+        }
+    }
+
+    if(success && !hold.rooms.empty()) {
+        logging::info()<<"The Server "<<server_name<<" is holding "<<hold.rooms.size()<<" rooms for a group reservation.";
+        state.holds.emplace(key, std::move(hold));
     } else {
-        cout<<"Cannot make a reservation. Room "<<room<<" is not available.\n";
-        sock.send_info_to(serverM_backend, ROOM_NOT_AVAILABLE);
+        // a partially prepared group holds nothing
+        release_hold(state, hold);
+        logging::info()<<"The Server "<<server_name<<" cannot hold the rooms for a group reservation.";
+        if(success) response = string {INVALID_REQUEST} + '\n';
     }
 
-    cout<<"The Server "<<server_name<<" finished sending the response to the main server.\n";
+    return response;
 }
 
 
-// a backend server is responsible for reading and storing room status information from a file,
-// and communicating with the main server to satisfy user requests
-int run_backend(const char server_name, const int sock_port, const string& filename) {
-    constexpr bool debug = false;
+// make the held rooms of a group reservation final, answering with the updated count of each room
+string commit_request(const char server_name, backend_state& state, const string& key) {
+    unordered_map<string, group_hold>::iterator held = state.holds.find(key);
 
-    try {
-        // create UDP socket and bind it
-        Socket sock {-1, SOCK_DGRAM, sock_port, debug};
-        sock.bind_socket(sock_port);
+    if(held == state.holds.end()) {
+        // a repeated commit succeeds again, a commit after an abort cannot
+        unordered_map<string, pair<bool, chrono::steady_clock::time_point>>::iterator outcome = state.decided.find(key);
+        if(outcome != state.decided.end() && outcome->second.first) return string {ROOM_AVAILABLE} + '\n';
 
-        cout<<"The Server "<<server_name<<" is up and running using UDP on port "<<sock_port<<".\n";
+        logging::info()<<"The Server "<<server_name<<" has no held rooms to commit for a group reservation.";
+        return string {ROOM_NOT_AVAILABLE} + '\n';
+    }
 
-        // the room status information is stored as a hash table, mapping the rooms to their counts
-        unordered_map<string, int> room_status = read_status(filename);
-        send_list(sock, room_status);
+    string response = string {ROOM_AVAILABLE} + '\n';
+    vector<pair<string, int>> changes;
+    for(const string& room : held->second.rooms) {
+        // moves leave held rooms in place, a room gone regardless has taken its count along and is not booked here
+        const atomic<int32_t>* count = room_count(state, room);
+        if(count == nullptr) {
+            logging::warning()<<"The Server "<<server_name<<" no longer has Room "<<room<<" of a group reservation to commit.";
+            continue;
+        }
 
-        cout<<"The Server "<<server_name<<" has sent the room status to the main server.\n";
+        response += room + ',' + to_string(count->load(memory_order_relaxed)) + '\n';
+        changes.emplace_back(room, -1);
+    }
 
-        while(true) {
-            msg_port request = sock.recv_info_from();
+    // the rooms of a group are logged as a single record, so they survive a crash all together or not at all
+    state.log.append(changes);
 
-            // invalidate information not received from the main server
-            if(request.port != serverM_backend) {
-                cout<<"The Server "<<server_name<<" has received a request from an unknown server on UDP with port "<<request.port<<".\n";
-                continue;
-            }
+    logging::info()<<"The Server "<<server_name<<" committed the group reservation of "<<held->second.rooms.size()<<" rooms.";
 
-            string request_type, room;
-            istringstream sstream {request.msg};
+    state.holds.erase(held);
+    decide(state, key, true);
+    return response;
+}
 
-            if(!getline(sstream, request_type)) {
-                cout<<"The Server "<<server_name<<" has received a request with a missing request type using UDP over port "<<sock_port<<".\n";
-                sock.send_info_to(serverM_backend, REQUEST_EMPTY);
-                continue;
-            }
 
-            if(!getline(sstream, room)) {
-                cout<<"The Server "<<server_name<<" has received a request with a missing room using UDP over port "<<sock_port<<".\n";
-                sock.send_info_to(serverM_backend, ROOM_EMPTY);
-                continue;
+// release the held rooms of a group reservation
+string abort_request(const char server_name, backend_state& state, const string& key) {
+    unordered_map<string, group_hold>::iterator held = state.holds.find(key);
+
+    // aborting an unknown group is harmless, its prepare may never have arrived
+    if(held != state.holds.end()) {
+        release_hold(state, held->second);
+        logging::info()<<"The Server "<<server_name<<" aborted the group reservation of "<<held->second.rooms.size()<<" rooms.";
+
+        state.holds.erase(held);
+        decide(state, key, false);
+    }
+
+    return string {ROOM_AVAILABLE} + '\n';
+}
+
+
+// abort the group reservations held for too long and forget old outcomes
+// returns the milliseconds until the next hold expires, or -1 if nothing is held
+int expire_holds(const char server_name, backend_state& state) {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    chrono::steady_clock::time_point next = chrono::steady_clock::time_point::max();
+
+    for(unordered_map<string, group_hold>::iterator held = state.holds.begin(); held != state.holds.end();) {
+        if(held->second.expires <= now) {
+            release_hold(state, held->second);
+            logging::info()<<"The Server "<<server_name<<" released the rooms of an expired group reservation.";
+
+            decide(state, held->first, false);
+            held = state.holds.erase(held);
+        } else {
+            next = min(next, held->second.expires);
+            held++;
+        }
+    }
+
+    while(!state.decided_order.empty() && state.decided_order.front().first <= now) {
+        // a group decided again is only forgotten once its latest outcome expires
+        unordered_map<string, pair<bool, chrono::steady_clock::time_point>>::iterator outcome = state.decided.find(state.decided_order.front().second);
+        if(outcome != state.decided.end() && outcome->second.second <= now) state.decided.erase(outcome);
+
+        state.decided_order.pop_front();
+    }
+
+    if(next == chrono::steady_clock::time_point::max()) return -1;
+    return chrono::ceil<chrono::milliseconds>(next - now).count();
+}
+
+
+// release the holds and forget the outcomes of the group reservations sent from the provided ports,
+// whose sockets the main server closed or bound again, so a new socket starting its transaction ids over
+// never finds the groups of the one before it
+void forget_groups(const char server_name, backend_state& state, const vector<int>& ports) {
+    if(ports.empty()) return;
+
+    vector<string> prefixes {};
+    for(int port : ports) prefixes.push_back(to_string(port) + ':');
+
+    auto sent_from = [&](const string& key) {
+        return any_of(prefixes.begin(), prefixes.end(), [&](const string& p) { return key.compare(0, p.size(), p) == 0; });
+    };
+
+    size_t released = 0;
+    for(unordered_map<string, group_hold>::iterator held = state.holds.begin(); held != state.holds.end();) {
+        if(!sent_from(held->first)) {
+            held++;
+            continue;
+        }
+
+        release_hold(state, held->second);
+        held = state.holds.erase(held);
+        released++;
+    }
+
+    for(unordered_map<string, pair<bool, chrono::steady_clock::time_point>>::iterator outcome = state.decided.begin(); outcome != state.decided.end();) {
+        if(sent_from(outcome->first)) outcome = state.decided.erase(outcome);
+        else outcome++;
+    }
+
+    if(released > 0) logging::info()<<"The Server "<<server_name<<" released the rooms of "<<released<<" group reservations of a closed socket of the main server.";
+}
+
+
+// give up the rooms of a move request to another backend server, answering the count of each room on its own line
+// rooms the backend server never had are left out of the response
+// rooms held by a group reservation stay until it is committed or aborted, and are answered with HELD_COUNT
+string move_request(const char server_name, backend_state& state, string_view rooms) {
+    string response;
+    string_view line;
+    size_t moved = 0;
+
+    unordered_set<string> held {};
+    for(const pair<const string, group_hold>& h : state.holds) held.insert(h.second.rooms.begin(), h.second.rooms.end());
+
+    while(next_line(rooms, line)) {
+        const string room {line};
+        const atomic<int32_t>* count = room_count(state, room);
+
+        if(count != nullptr && held.count(room) > 0) {
+            response += room + ',' + to_string(HELD_COUNT) + '\n';
+            continue;
+        }
+
+        if(count != nullptr) {
+            int left = count->load(memory_order_relaxed);
+            move_room(state, room, left);
+            state.log.append_moved(room, left);
+
+            response += room + ',' + to_string(left) + '\n';
+            moved++;
+            continue;
+        }
+
+        // a repeated move is answered with the count the room left with
+        unordered_map<string, int>::const_iterator gone = state.moved_out.find(room);
+        if(gone != state.moved_out.end()) response += room + ',' + to_string(gone->second) + '\n';
+    }
+
+    logging::info()<<"The Server "<<server_name<<" moved "<<moved<<" rooms to another Server.";
+    return response;
+}
+
+
+// take over the rooms of an adopt request, each line holding a room and its count separated by a comma
+string adopt_request(const char server_name, backend_state& state, string_view rooms) {
+    string_view line;
+    size_t adopted = 0;
+
+    while(next_line(rooms, line)) {
+        size_t comma = line.rfind(',');
+        if(comma == string_view::npos || comma == 0) continue;
+
+        const string room {line.substr(0, comma)};
+        int count = atoi(string {line.substr(comma + 1)}.c_str());
+
+        adopt_room(state, room, count);
+        state.log.append_adopted(room, count);
+        adopted++;
+    }
+
+    logging::info()<<"The Server "<<server_name<<" adopted "<<adopted<<" rooms from another Server.";
+    return ROOM_AVAILABLE;
+}
+
+
+// a request that changes rooms, handled recently
+struct handled_request {
+    // hash of the whole request, which a copy sent again matches
+    size_t digest;
+
+    // response sent to the request, empty while it is being handled
+    string response {};
+};
+
+
+// the ports requests are served from, the backend port of the main server and the ports it registered
+// registrations are kept in memory, so a restarted backend server only serves the backend port of the main server
+struct sender_registry {
+    unordered_set<int> ports {serverM_backend};
+
+    // requests that change rooms handled recently, keyed by the port they came from and then by their request id line
+    unordered_map<int, unordered_map<string, handled_request>> handled {};
+
+    // ports registered again or unregistered since the caller last looked, whose group reservations are to be forgotten
+    vector<int> reset {};
+
+    // ports and request id lines of the handled requests in the order they arrived, along with the time each is forgotten
+    deque<tuple<chrono::steady_clock::time_point, int, string>> handled_order {};
+};
+
+
+// returns whether a request changes rooms, so handling a copy of it again would change them twice
+bool changes_rooms(string_view request_type) {
+    return request_type == RESERVATION_REQUEST || request_type == BATCH_RESERVATION_REQUEST
+        || request_type == MOVE_REQUEST || request_type == ADOPT_REQUEST;
+}
+
+
+// forget the handled requests kept too long, or beyond the number kept
+void forget_handled(sender_registry& senders) {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    while(!senders.handled_order.empty()) {
+        auto& [expiry, port, id_line] = senders.handled_order.front();
+        if(expiry > now && senders.handled_order.size() <= MAX_HANDLED_REQUESTS) break;
+
+        unordered_map<int, unordered_map<string, handled_request>>::iterator found = senders.handled.find(port);
+        if(found != senders.handled.end()) found->second.erase(id_line);
+
+        senders.handled_order.pop_front();
+    }
+}
+
+
+// keep the responses about to be sent to the handled requests, to answer copies of them sent again
+void remember_responses(sender_registry& senders, const vector<msg_port>& responses) {
+    for(const msg_port& r : responses) {
+        unordered_map<int, unordered_map<string, handled_request>>::iterator port = senders.handled.find(r.port);
+        if(port == senders.handled.end() || port->second.empty()) continue;
+
+        size_t id_end = r.msg.find('\n');
+        if(r.msg.compare(0, 1, REQUEST_ID) != 0 || id_end == string::npos) continue;
+
+        unordered_map<string, handled_request>::iterator found = port->second.find(r.msg.substr(0, id_end));
+        if(found != port->second.end() && found->second.response.empty()) found->second.response = r.msg;
+    }
+}
+
+
+// returns whether a request was sent by the main server and is to be handled
+// requests from any other port are dropped, so no other process can reserve, move or adopt rooms, besides stats requests
+// register and unregister requests are handled here, the answer to a registration is added to the responses,
+// as is the response kept for a copy of a request already handled
+// the ports they carry are added to the reset ports, for the caller to forget their group reservations
+bool accept_sender(const char server_name, sender_registry& senders, const msg_port& request, vector<msg_port>& responses) {
+    string_view rest {request.msg};
+    string_view id_line, request_type, line;
+
+    if(!rest.empty() && rest[0] == REQUEST_ID[0]) next_line(rest, id_line);
+    next_line(rest, request_type);
+
+    if(request_type == REGISTER_REQUEST && request.port == serverM_backend) {
+        // a port registered again belongs to a new socket of the main server, whose request ids start over
+        while(next_line(rest, line)) {
+            int port = atoi(string {line}.c_str());
+            if(port > 0) {
+                senders.ports.insert(port);
+                senders.handled.erase(port);
+                senders.reset.push_back(port);
             }
+        }
 
-            if(request_type == AVAILABILITY_REQUEST) {
-                cout<<"The Server "<<server_name<<" received an availability request from the main server.\n";
-                availability_request(sock, server_name, room_status, room);
-            } else if(request_type == RESERVATION_REQUEST) {
-                cout<<"The Server "<<server_name<<" received a reservation request from the main server.\n";
-                reservation_request(sock, server_name, room_status, room);
-            } else {
-                cout<<"The Server "<<server_name<<" has received an invalid request type using UDP over port "<<sock_port<<".\n";
-                sock.send_info_to(serverM_backend, INVALID_REQUEST);
+        logging::info()<<"The Server "<<server_name<<" accepts requests from "<<senders.ports.size()<<" ports of the main server.";
+        responses.push_back({string {id_line} + (id_line.empty() ? "" : "\n") + ROOM_AVAILABLE, request.port, request.from});
+        return false;
+    }
+
+    // stats change nothing, so any process may scrape them
+    if(request_type == STATS_REQUEST) return true;
+
+    if(senders.ports.count(request.port) == 0) {
+        logging::warning()<<"The Server "<<server_name<<" has received a request from an unknown server on UDP with port "<<request.port<<".";
+        return false;
+    }
+
+    // the main server unregisters the ports of sockets it closed, or that closed with a process that crashed
+    if(request_type == UNREGISTER_REQUEST) {
+        if(request.port != serverM_backend) return false;
+
+        while(next_line(rest, line)) {
+            int port = atoi(string {line}.c_str());
+            if(port > 0 && port != serverM_backend) {
+                senders.ports.erase(port);
+                senders.handled.erase(port);
+                senders.reset.push_back(port);
             }
         }
 
-        return 0;
+        logging::info()<<"The Server "<<server_name<<" accepts requests from "<<senders.ports.size()<<" ports of the main server.";
+        return false;
+    }
 
-    } catch(socket_exception& se) {
-        cout<<se.what()<<endl;
-        return 1;
-    } catch(backend_exception& be) {
-        cout<<be.what()<<endl;
+    if(id_line.empty() || !changes_rooms(request_type)) return true;
+
+    // the main server sends a request again with the same id when its response is late or lost,
+    // a copy is answered with the response of the request, or dropped while the request is still being handled
+    forget_handled(senders);
+
+    size_t digest = hash<string_view> {}(request.msg);
+    auto [found, added] = senders.handled[request.port].try_emplace(string {id_line}, handled_request {digest});
+
+    if(!added && found->second.digest == digest) {
+        logging::info()<<"The Server "<<server_name<<" has received a request it already handled from the main server.";
+        if(!found->second.response.empty()) responses.push_back({found->second.response, request.port, request.from});
+        return false;
+    }
+
+    found->second = handled_request {digest};
+    senders.handled_order.emplace_back(chrono::steady_clock::now() + HANDLED_RETENTION, request.port, string {id_line});
+    return true;
+}
+
+
+// parse a request from the main server and return the response
+// a request may start with a request id line, which is echoed at the start of the response
+// so the main server can match the response to the request it answers
+string handle_request(const char server_name, const int sock_port, backend_state& state, stats_registry& stats, const msg_port& request_info) {
+    string_view request {request_info.msg};
+
+    string request_id;
+    string_view request_type, room;
+
+    if(!request.empty() && request[0] == REQUEST_ID[0]) {
+        next_line(request, room);
+        request_id = string {room} + '\n';
+    }
+
+    if(!next_line(request, request_type)) {
+        logging::warning()<<"The Server "<<server_name<<" has received a request with a missing request type using UDP over port "<<sock_port<<".";
+        stats.count(INVALID_COUNTER);
+        count_response(stats, REQUEST_EMPTY);
+        return request_id + REQUEST_EMPTY;
+    }
+
+    if(request_type == BATCH_AVAILABILITY_REQUEST || request_type == BATCH_RESERVATION_REQUEST) {
+        logging::info()<<"The Server "<<server_name<<" received a batch "<<(request_type == BATCH_AVAILABILITY_REQUEST ? "availability" : "reservation")<<" request from the main server.";
+        stats.count(request_type == BATCH_AVAILABILITY_REQUEST ? BATCH_AVAILABILITY_COUNTER : BATCH_RESERVATION_COUNTER);
+        return request_id + batch_request(server_name, state, request_type, request);
+    }
+
+    if(request_type == MOVE_REQUEST) {
+        logging::info()<<"The Server "<<server_name<<" received a move request from the main server.";
+        stats.count(MOVE_COUNTER);
+        return request_id + move_request(server_name, state, request);
+    }
+
+    if(request_type == ADOPT_REQUEST) {
+        logging::info()<<"The Server "<<server_name<<" received an adopt request from the main server.";
+        stats.count(ADOPT_COUNTER);
+        return request_id + adopt_request(server_name, state, request);
+    }
+
+    // unregister requests are handled by accept_sender, only the dispatcher hands one to a shard,
+    // carrying the ports whose group reservations the shard forgets
+    if(request_type == UNREGISTER_REQUEST) {
+        vector<int> ports {};
+        while(next_line(request, room)) ports.push_back(atoi(string {room}.c_str()));
+
+        forget_groups(server_name, state, ports);
+        return request_id + ROOM_AVAILABLE;
+    }
+
+    if(request_type == STATS_REQUEST) {
+        logging::info()<<"The Server "<<server_name<<" received a stats request.";
+        stats.count(STATS_COUNTER);
+        return request_id + stats.report();
+    }
+
+    if(request_type == PREPARE_REQUEST || request_type == COMMIT_REQUEST || request_type == ABORT_REQUEST) {
+        stats.count(request_type == PREPARE_REQUEST ? PREPARE_COUNTER : request_type == COMMIT_REQUEST ? COMMIT_COUNTER : ABORT_COUNTER);
+
+        string_view transaction;
+        if(!next_line(request, transaction)) {
+            logging::warning()<<"The Server "<<server_name<<" has received a group reservation request with a missing transaction using UDP over port "<<sock_port<<".";
+            count_response(stats, INVALID_REQUEST);
+            return request_id + INVALID_REQUEST;
+        }
+
+        // transaction ids are only unique per main server socket
+        const string key = to_string(request_info.port) + ':' + string {transaction};
+
+        if(request_type == PREPARE_REQUEST) {
+            logging::info()<<"The Server "<<server_name<<" received a group reservation request from the main server.";
+            return request_id + prepare_request(server_name, state, key, request);
+        } else if(request_type == COMMIT_REQUEST) {
+            return request_id + commit_request(server_name, state, key);
+        } else {
+            return request_id + abort_request(server_name, state, key);
+        }
+    }
+
+    if(!next_line(request, room)) {
+        logging::warning()<<"The Server "<<server_name<<" has received a request with a missing room using UDP over port "<<sock_port<<".";
+        stats.count(INVALID_COUNTER);
+        count_response(stats, ROOM_EMPTY);
+        return request_id + ROOM_EMPTY;
+    }
+
+    string response;
+    if(request_type == AVAILABILITY_REQUEST) {
+        logging::info()<<"The Server "<<server_name<<" received an availability request from the main server.";
+        stats.count(AVAILABILITY_COUNTER);
+        response = availability_request(server_name, state, string {room});
+    } else if(request_type == RESERVATION_REQUEST) {
+        logging::info()<<"The Server "<<server_name<<" received a reservation request from the main server.";
+        stats.count(RESERVATION_COUNTER);
+        response = reservation_request(server_name, state, string {room});
+    } else {
+        logging::warning()<<"The Server "<<server_name<<" has received an invalid request type using UDP over port "<<sock_port<<".";
+        stats.count(INVALID_COUNTER);
+        response = INVALID_REQUEST;
+    }
+
+    count_response(stats, response);
+    return request_id + response;
+}
+
+
+// path of the log of a shard, a backend server with a single shard keeps its log beside the room status file
+string shard_log_path(const string& base, unsigned int index, unsigned int shards) {
+    if(shards == 1) return base + ".log";
+    return base + '.' + to_string(index) + "of" + to_string(shards) + ".log";
+}
+
+
+// paths of the logs left beside the room status file by earlier runs, whatever their number of shards
+vector<string> find_logs(const string& base) {
+    const filesystem::path prefix {base};
+    const filesystem::path directory = prefix.parent_path().empty() ? filesystem::path {"."} : prefix.parent_path();
+    const string stem = prefix.filename().string() + '.';
+
+    auto is_number = [](const string& s) { return !s.empty() && all_of(s.begin(), s.end(), [](unsigned char c) { return isdigit(c); }); };
+
+    vector<string> found {};
+    error_code error;
+    for(filesystem::directory_iterator entry {directory, error}; !error && entry != filesystem::directory_iterator {}; entry.increment(error)) {
+        const string name = entry->path().filename().string();
+        if(name.compare(0, stem.size(), stem) != 0) continue;
+
+        // the log of a single shard, or of one of several shards named <index>of<shards>
+        const string suffix = name.substr(stem.size());
+        size_t of = suffix.find("of");
+        bool shard_log = suffix.size() > 4 && suffix.compare(suffix.size() - 4, 4, ".log") == 0 && of != string::npos
+                         && is_number(suffix.substr(0, of)) && is_number(suffix.substr(of + 2, suffix.size() - 4 - of - 2));
+
+        if(suffix == "log" || shard_log) found.push_back(base + '.' + suffix);
+    }
+
+    return found;
+}
+
+
+// replay the logs of earlier runs and lay the rooms they hold out over one log per shard,
+// so the number of shards may change from one run to the next
+// a room is only ever logged by the shard owning it, so a room found in several logs was copied by a layout
+// interrupted before the old logs were removed, and its copies agree
+vector<reservation_log> open_logs(const char server_name, const string& base, unsigned int shards, map<string, logged_room>& logged) {
+    vector<string> found = find_logs(base);
+    for(const string& path : found) {
+        reservation_log old {path};
+        for(const pair<const string, logged_room>& r : old.replay()) logged.insert(r);
+    }
+
+    vector<string> paths {};
+    for(unsigned int i = 0; i < shards; i++) paths.push_back(shard_log_path(base, i, shards));
+
+    vector<reservation_log> logs {};
+    logs.reserve(shards);
+    for(const string& path : paths) logs.emplace_back(path);
+
+    // logs of the same number of shards already hold the rooms they own
+    sort(found.begin(), found.end());
+    vector<string> sorted_paths = paths;
+    sort(sorted_paths.begin(), sorted_paths.end());
+    if(found == sorted_paths) return logs;
+
+    vector<map<string, logged_room>> laid_out(shards);
+    for(const pair<const string, logged_room>& r : logged) laid_out[shard_of(r.first, shards)].insert(r);
+    for(unsigned int i = 0; i < shards; i++) logs[i].rewrite(laid_out[i]);
+
+    // the old logs are only removed once every room is in its new log
+    for(const string& path : found) {
+        if(find(paths.begin(), paths.end(), path) == paths.end()) reservation_log::remove(path);
+    }
+
+    if(!found.empty()) logging::info()<<"The Server "<<server_name<<" laid out its reservation log over "<<shards<<(shards == 1 ? " shard" : " shards")<<".";
+    return logs;
+}
+
+
+// split the rooms read at startup among the shards, each shard taking its own log
+vector<backend_state> partition_status(room_table&& room_status, vector<reservation_log>&& logs) {
+    vector<backend_state> states {};
+    states.reserve(logs.size());
+
+    // a single shard keeps the table as read, which may be a mapped snapshot
+    if(logs.size() == 1) {
+        states.push_back(backend_state {std::move(room_status), {}, std::move(logs.front())});
+        return states;
+    }
+
+    const unsigned int shards = logs.size();
+
+    vector<size_t> sizes(shards);
+    room_status.for_each([&](string_view code, const room_slot&) { sizes[shard_of(code, shards)]++; });
+
+    for(unsigned int i = 0; i < shards; i++) {
+        states.push_back(backend_state {room_table {sizes[i]}, {}, std::move(logs[i])});
+    }
+
+    room_status.for_each([&](string_view code, const room_slot& slot) {
+        states[shard_of(code, shards)].room_status.insert(code, 0, slot.count.load(memory_order_relaxed));
+    });
+
+    return states;
+}
+
+
+// a request handed to a shard, either whole or as the part of a request split across shards
+// seq is 0 for a whole request, otherwise it names the split request the part belongs to
+struct shard_task {
+    uint64_t seq;
+    size_t part;
+    msg_port request;
+};
+
+// the response of a shard to one of its tasks
+struct shard_result {
+    uint64_t seq;
+    size_t part;
+    msg_port response;
+};
+
+
+/*
+ * struct shard is a worker thread owning a part of the rooms of a backend server,
+ * exchanging tasks and results with the dispatcher thread through queues only the two of them use
+ */
+struct shard {
+    backend_state& state;
+
+    spsc_queue<shard_task> tasks {SHARD_QUEUE_SIZE};
+    spsc_queue<shard_result> results {SHARD_QUEUE_SIZE};
+
+    // signalled by the dispatcher once tasks are queued
+    int wakeup;
+
+    // whether tasks were queued since the shard was last signalled
+    bool queued {false};
+
+    explicit shard(backend_state& state): state {state}, wakeup {eventfd(0, EFD_CLOEXEC)} {
+        if(wakeup == -1) throw backend_exception {string {"backend exception: shard: eventfd: "} + strerror(errno)};
+    }
+
+    ~shard() {
+        close(wakeup);
+    }
+};
+
+
+// the shards holding the rooms of a prepared group reservation
+struct group_route {
+    // time the group is forgotten, well after its holds expire
+    chrono::steady_clock::time_point expires;
+
+    vector<unsigned int> shards;
+
+    // hash of the room lines of the prepare, which a repeated prepare matches
+    size_t digest;
+};
+
+
+// a request whose rooms belong to several shards, answered once every shard involved has answered its part
+struct split_request {
+    uint64_t seq;
+    int port;
+    endpoint from;
+    string request_id;
+    string request_type;
+
+    // transaction key, for group reservations
+    string key;
+
+    // number of rooms of the request, and the positions of the rooms of each part within the request
+    size_t rooms;
+    vector<vector<size_t>> positions;
+
+    // shard and response of each part
+    vector<unsigned int> shards;
+    vector<string> responses;
+    size_t remaining;
+
+    // whether a commit or abort reached every shard, since the shards that prepared its group are not known
+    bool broadcast {false};
+
+    // hash of the room lines, for group reservations
+    size_t digest {0};
+};
+
+
+// the state of the dispatcher thread, the only thread using the socket
+struct dispatcher {
+    const char server_name;
+
+    // counters and stage latencies, shared with the shards
+    stats_registry& stats;
+
+    vector<unique_ptr<shard>> shards {};
+
+    // signalled by the shards once results are queued
+    int results_ready {-1};
+
+    // signalled once to stop every shard, and never read, so it stays signalled
+    int stop {-1};
+
+    // threads of the shards
+    vector<thread> threads {};
+
+    unordered_map<uint64_t, split_request> splits {};
+    uint64_t next_seq {1};
+
+    // shards holding the rooms of recently prepared group reservations, keyed like the holds of the shards,
+    // so a commit or abort only reaches the shards involved
+    unordered_map<string, group_route> group_shards {};
+    deque<pair<chrono::steady_clock::time_point, string>> group_order {};
+
+    // aborts of group reservations some shards could not prepare, queued once the results at hand are handled
+    vector<pair<unsigned int, shard_task>> aborts {};
+
+    // ports requests are served from, and the requests that change rooms handled recently
+    sender_registry senders {};
+
+    // responses ready to be sent to the main server
+    vector<msg_port> responses {};
+
+    // the shards use the dispatcher and the states of the backend server, so however the dispatcher stops,
+    // they are stopped and joined before either is gone
+    ~dispatcher() {
+        if(stop != -1) eventfd_write(stop, 1);
+        for(thread& t : threads) t.join();
+
+        if(stop != -1) close(stop);
+        if(results_ready != -1) close(results_ready);
+    }
+};
+
+
+// returns whether an eventfd is signalled, without waiting
+bool signalled(int fd) {
+    pollfd event {fd, POLLIN, 0};
+    return poll(&event, 1, 0) > 0;
+}
+
+
+// a shard answers the tasks queued for it, flushing their reservations to disk together before handing back the results,
+// until stop is signalled
+void run_shard(const char server_name, const int sock_port, shard& s, stats_registry& stats, int results_ready, int stop) {
+    int hold_timeout = -1;
+    shard_task task;
+    vector<shard_result> done;
+
+    try {
+        while(true) {
+            pollfd events[2] {{s.wakeup, POLLIN, 0}, {stop, POLLIN, 0}};
+            int ready = poll(events, 2, hold_timeout);
+            if(events[1].revents & POLLIN) return;
+
+            if(ready <= 0 || !(events[0].revents & POLLIN)) {
+                hold_timeout = expire_holds(server_name, s.state);
+                continue;
+            }
+
+            eventfd_t signals;
+            eventfd_read(s.wakeup, &signals);
+
+            // signals only count queued tasks once, so the queue is emptied before waiting again
+            while(true) {
+                done.clear();
+                while(done.size() < MAX_GROUP_COMMIT && s.tasks.try_pop(task)) {
+                    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                    done.push_back({task.seq, task.part, {handle_request(server_name, sock_port, s.state, stats, task.request), task.request.port, task.request.from}});
+                    stats.record_since(HANDLE_STAGE, start);
+                }
+                if(done.empty()) break;
+
+                // no result is handed back before the reservations it reports are on disk
+                chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                s.state.log.sync();
+                stats.record_since(SYNC_STAGE, start);
+
+                for(shard_result& r : done) {
+                    while(!s.results.try_push(std::move(r))) {
+                        // a stopped dispatcher takes no more results
+                        if(signalled(stop)) return;
+
+                        eventfd_write(results_ready, 1);
+                        this_thread::yield();
+                    }
+                }
+                eventfd_write(results_ready, 1);
+            }
+
+            hold_timeout = expire_holds(server_name, s.state);
+        }
+    } catch(reservation_log_exception& le) {
+        // a shard unable to log can answer nothing more, so the backend server stops with it
+        logging::error()<<le.what();
+        logging::flush();
+        _Exit(1);
+    }
+}
+
+
+// assemble the response to a split request from the responses of its parts
+string combine(dispatcher& d, const split_request& s) {
+    if(s.request_type == MOVE_REQUEST) {
+        string response = s.request_id;
+        for(const string& r : s.responses) response += r;
+        return response;
+    }
+
+    if(s.request_type == ADOPT_REQUEST) return s.request_id + ROOM_AVAILABLE;
+    if(s.request_type == ABORT_REQUEST) return s.request_id + ROOM_AVAILABLE + '\n';
+
+    if(s.request_type == COMMIT_REQUEST) {
+        // the group is committed once every shard that prepared it committed, and the counts of every committed room follow
+        const string committed = string {ROOM_AVAILABLE} + '\n';
+        string rooms;
+        string failure;
+        size_t count = 0;
+
+        for(const string& r : s.responses) {
+            if(r.compare(0, committed.size(), committed) == 0) {
+                rooms += r.substr(committed.size());
+                count++;
+            } else if(failure.empty()) {
+                failure = r.substr(0, r.find('\n'));
+            }
+        }
+
+        if(count == s.responses.size()) return s.request_id + committed + rooms;
+        if(count == 0) return s.request_id + s.responses.front();
+
+        // a shard whose hold expired or was lost cannot commit, so only part of the group was booked
+        // a broadcast commit cannot tell such a shard from one the group never involved, so the commit is uncertain
+        // either way, the main server is not told the group was committed, and learns the counts of the committed rooms
+        return s.request_id + (s.broadcast ? string {BACKEND_TIMEOUT} : failure) + '\n' + rooms;
+    }
+
+    // batch requests and prepares answer each room on its own line, put back in the order of the request
+    vector<string_view> lines(s.rooms);
+    vector<bool> held(s.responses.size(), true);
+
+    for(size_t i = 0; i < s.responses.size(); i++) {
+        string_view response {s.responses[i]};
+        string_view line;
+
+        for(size_t position : s.positions[i]) {
+            if(!next_line(response, line)) line = INVALID_REQUEST;
+            lines[position] = line;
+            if(line != ROOM_AVAILABLE) held[i] = false;
+        }
+    }
+
+    if(s.request_type == PREPARE_REQUEST) {
+        if(all_of(held.begin(), held.end(), [](bool h) { return h; })) {
+            chrono::steady_clock::time_point expires = chrono::steady_clock::now() + HOLD_TIMEOUT + DECIDED_TIMEOUT;
+            d.group_shards[s.key] = {expires, s.shards, s.digest};
+            d.group_order.emplace_back(expires, s.key);
+        } else {
+            // shards that held their rooms let go of them, since the group cannot be held as a whole
+            const string transaction = s.key.substr(s.key.find(':') + 1);
+            for(size_t i = 0; i < s.shards.size(); i++) {
+                if(held[i]) d.aborts.push_back({s.shards[i], {s.seq, i, {string {ABORT_REQUEST} + '\n' + transaction, s.port}}});
+            }
+        }
+    }
+
+    string response = s.request_id;
+    for(string_view line : lines) response += string {line} + '\n';
+    return response;
+}
+
+
+// take the results handed back by the shards and send the responses they complete
+// whole requests are answered at once, split requests once all their parts are in
+void collect_results(Socket& sock, dispatcher& d) {
+    shard_result r;
+
+    for(unique_ptr<shard>& s : d.shards) {
+        while(s->results.try_pop(r)) {
+            if(r.seq == 0) {
+                d.responses.push_back(std::move(r.response));
+                continue;
+            }
+
+            // the aborts sent for a group that could not be held, and the tasks forgetting the groups of closed sockets, answer no request
+            unordered_map<uint64_t, split_request>::iterator split = d.splits.find(r.seq);
+            if(split == d.splits.end()) continue;
+
+            split->second.responses[r.part] = std::move(r.response.msg);
+            if(--split->second.remaining > 0) continue;
+
+            d.responses.push_back({combine(d, split->second), split->second.port, split->second.from});
+            d.splits.erase(split);
+        }
+    }
+
+    if(!d.responses.empty()) {
+        remember_responses(d.senders, d.responses);
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        sock.send_many_to(d.responses);
+        d.stats.record_since(SEND_STAGE, start);
+        d.responses.clear();
+    }
+}
+
+
+// queue a task for a shard
+// while the shard is too far behind to take it, results are collected so neither thread waits on the other forever
+void queue_task(Socket& sock, dispatcher& d, unsigned int index, shard_task&& task) {
+    shard& s = *d.shards[index];
+
+    while(!s.tasks.try_push(std::move(task))) {
+        eventfd_write(s.wakeup, 1);
+        collect_results(sock, d);
+        this_thread::yield();
+    }
+
+    s.queued = true;
+}
+
+
+// route a request to the shard owning its rooms, or split it among the shards when its rooms belong to several
+// requests missing a part are handed to any shard, which answers what is missing
+void dispatch(Socket& sock, dispatcher& d, msg_port&& request) {
+    const unsigned int shards = d.shards.size();
+
+    string_view rest {request.msg};
+    string_view id_line, request_type, line;
+
+    if(!rest.empty() && rest[0] == REQUEST_ID[0]) next_line(rest, id_line);
+
+    if(!next_line(rest, request_type)) return queue_task(sock, d, 0, {0, 0, std::move(request)});
+
+    if(request_type == AVAILABILITY_REQUEST || request_type == RESERVATION_REQUEST) {
+        unsigned int index = next_line(rest, line) ? shard_of(line, shards) : 0;
+        return queue_task(sock, d, index, {0, 0, std::move(request)});
+    }
+
+    bool group = request_type == PREPARE_REQUEST || request_type == COMMIT_REQUEST || request_type == ABORT_REQUEST;
+    bool rooms = request_type == BATCH_AVAILABILITY_REQUEST || request_type == BATCH_RESERVATION_REQUEST
+                 || request_type == MOVE_REQUEST || request_type == ADOPT_REQUEST || request_type == PREPARE_REQUEST;
+
+    string_view transaction;
+    if((!group && !rooms) || (group && !next_line(rest, transaction))) return queue_task(sock, d, 0, {0, 0, std::move(request)});
+
+    split_request split {d.next_seq, request.port, request.from, string {id_line} + (id_line.empty() ? "" : "\n"), string {request_type},
+                         to_string(request.port) + ':' + string {transaction}, 0, {}, {}, {}, 0};
+    vector<string> bodies(shards);
+    vector<vector<size_t>> positions(shards);
+
+    if(request_type == PREPARE_REQUEST) {
+        split.digest = hash<string_view> {}(rest);
+
+        // the shards only hold the rooms they own, so a prepare of other rooms under the key of a known group
+        // may reach none of the shards holding the group, and is answered here, holding nothing
+        unordered_map<string, group_route>::const_iterator known = d.group_shards.find(split.key);
+        if(known != d.group_shards.end() && known->second.digest != split.digest) {
+            logging::warning()<<"The Server "<<d.server_name<<" is already holding other rooms for the transaction of a group reservation.";
+
+            string response = split.request_id;
+            while(next_line(rest, line)) response += string {INVALID_REQUEST} + '\n';
+            d.responses.push_back({response, request.port, request.from});
+            return;
+        }
+    }
+
+    if(rooms) {
+        while(next_line(rest, line)) {
+            // the rooms of an adopt request come along with their counts
+            string_view room = request_type == ADOPT_REQUEST ? line.substr(0, line.rfind(',')) : line;
+            unsigned int index = shard_of(room, shards);
+
+            bodies[index] += string {line} + '\n';
+            positions[index].push_back(split.rooms++);
+        }
+
+        for(unsigned int i = 0; i < shards; i++) {
+            if(!positions[i].empty()) split.shards.push_back(i);
+        }
+    } else {
+        // a commit or abort reaches the shards that prepared the group, or every shard if the group is unknown
+        unordered_map<string, group_route>::const_iterator known = d.group_shards.find(split.key);
+        if(known != d.group_shards.end()) {
+            split.shards = known->second.shards;
+        } else {
+            for(unsigned int i = 0; i < shards; i++) split.shards.push_back(i);
+            split.broadcast = true;
+        }
+    }
+
+    if(split.shards.size() <= 1) {
+        unsigned int index = split.shards.empty() ? 0 : split.shards.front();
+
+        // a group prepared by a single shard is known as well, so its commit only counts on that shard
+        if(request_type == PREPARE_REQUEST) {
+            chrono::steady_clock::time_point expires = chrono::steady_clock::now() + HOLD_TIMEOUT + DECIDED_TIMEOUT;
+            d.group_shards[split.key] = {expires, {index}, split.digest};
+            d.group_order.emplace_back(expires, split.key);
+        }
+
+        return queue_task(sock, d, index, {0, 0, std::move(request)});
+    }
+
+    const string header = string {request_type} + '\n' + (group ? string {transaction} + '\n' : "");
+    const uint64_t seq = d.next_seq++;
+
+    for(unsigned int index : split.shards) {
+        split.positions.push_back(std::move(positions[index]));
+        split.responses.emplace_back();
+    }
+    split.remaining = split.shards.size();
+
+    vector<unsigned int> involved = split.shards;
+    d.splits.emplace(seq, std::move(split));
+
+    for(size_t part = 0; part < involved.size(); part++) {
+        queue_task(sock, d, involved[part], {seq, part, {header + bodies[involved[part]], request.port, request.from}});
+    }
+}
+
+
+// have every shard forget the group reservations of the ports registered again or unregistered,
+// through tasks whose results answer no request
+void forget_senders(Socket& sock, dispatcher& d) {
+    if(d.senders.reset.empty()) return;
+
+    string request = string {UNREGISTER_REQUEST} + '\n';
+    for(int port : d.senders.reset) {
+        request += to_string(port) + '\n';
+
+        const string prefix = to_string(port) + ':';
+        for(unordered_map<string, group_route>::iterator known = d.group_shards.begin(); known != d.group_shards.end();) {
+            if(known->first.compare(0, prefix.size(), prefix) == 0) known = d.group_shards.erase(known);
+            else known++;
+        }
+    }
+    d.senders.reset.clear();
+
+    for(unsigned int i = 0; i < d.shards.size(); i++) queue_task(sock, d, i, {d.next_seq++, 0, {request, serverM_backend}});
+}
+
+
+// forget the shards of group reservations decided long ago
+// returns the milliseconds until the next group is forgotten, or -1 if none is known
+int expire_groups(dispatcher& d) {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    while(!d.group_order.empty() && d.group_order.front().first <= now) {
+        // a group prepared again is only forgotten once its latest prepare expires
+        unordered_map<string, group_route>::iterator known = d.group_shards.find(d.group_order.front().second);
+        if(known != d.group_shards.end() && known->second.expires <= now) d.group_shards.erase(known);
+
+        d.group_order.pop_front();
+    }
+
+    if(d.group_order.empty()) return -1;
+    return chrono::ceil<chrono::milliseconds>(d.group_order.front().first - now).count();
+}
+
+
+// serve requests with the rooms split among several shards, each a thread of its own
+// the dispatcher thread receives every request and sends every response, and the shards never share a room,
+// so no lock is taken on the way of a request
+// a room status transfer the main server has not taken yet goes on from the dispatcher thread
+void run_sharded(const char server_name, const int sock_port, Socket& sock, vector<backend_state>& states, stats_registry& stats, list_transfer& transfer) {
+    dispatcher d {server_name, stats};
+    d.results_ready = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(d.results_ready == -1) throw backend_exception {string {"backend exception: run_sharded: eventfd: "} + strerror(errno)};
+    d.stop = eventfd(0, EFD_CLOEXEC);
+    if(d.stop == -1) throw backend_exception {string {"backend exception: run_sharded: eventfd: "} + strerror(errno)};
+
+    for(backend_state& state : states) d.shards.push_back(make_unique<shard>(state));
+
+    // shards serve until the dispatcher stops
+    for(unique_ptr<shard>& s : d.shards) d.threads.emplace_back(run_shard, server_name, sock_port, ref(*s), ref(stats), d.results_ready, d.stop);
+
+    event_loop loop {};
+    loop.add(sock.descriptor(), EPOLLIN);
+    loop.add(d.results_ready, EPOLLIN);
+
+    epoll_event events[event_loop::MAXEVENTS];
+    datagram_batch batch {MAX_BATCH_DATAGRAMS};
+    vector<msg_port> requests;
+    int group_timeout = -1;
+    int transfer_timeout = resend_transfer(server_name, sock, transfer);
+
+    while(true) {
+        loop.wait(events, sooner(group_timeout, transfer_timeout));
+
+        // hand the queued requests to the shards, a batch of datagrams per system call
+        size_t received = 0;
+        while(received < MAX_GROUP_COMMIT && sock.try_recv_many_from(batch, requests) > 0) {
+            for(msg_port& request : requests) {
+                if(acknowledge_transfer(server_name, transfer, request)) continue;
+                if(accept_sender(server_name, d.senders, request, d.responses)) dispatch(sock, d, std::move(request));
+                else forget_senders(sock, d);
+            }
+            received += requests.size();
+        }
+
+        eventfd_t signals;
+        eventfd_read(d.results_ready, &signals);
+
+        do {
+            collect_results(sock, d);
+
+            vector<pair<unsigned int, shard_task>> aborts {};
+            aborts.swap(d.aborts);
+            for(pair<unsigned int, shard_task>& a : aborts) queue_task(sock, d, a.first, std::move(a.second));
+
+            // each shard is signalled once for all the tasks queued for it
+            for(unique_ptr<shard>& s : d.shards) {
+                if(!s->queued) continue;
+                eventfd_write(s->wakeup, 1);
+                s->queued = false;
+            }
+        } while(!d.aborts.empty());
+
+        group_timeout = expire_groups(d);
+        transfer_timeout = resend_transfer(server_name, sock, transfer);
+    }
+}
+
+
+// a backend server is responsible for reading and storing room status information from a file,
+// and communicating with the main server to satisfy user requests
+int run_backend(const char server_name, const int sock_port, const string& filename, unsigned int shards) {
+    constexpr bool debug = false;
+
+    try {
+        // create UDP socket and bind it
+        Socket sock {-1, SOCK_DGRAM, sock_port, debug};
+        sock.bind_socket(sock_port);
+        sock.set_receive_buffer(REQUEST_RECEIVE_BUFFER);
+
+        logging::info()<<"The Server "<<server_name<<" is up and running using UDP on port "<<sock_port<<".";
+
+        // reservations made before a restart are logged beside the room status file, in one log per shard
+        map<string, logged_room> logged {};
+        vector<reservation_log> logs = open_logs(server_name, filename.substr(0, filename.rfind('.')), shards, logged);
+
+        room_table room_status = load_status(server_name, filename);
+
+        vector<backend_state> states = partition_status(std::move(room_status), std::move(logs));
+
+        for(const pair<const string, logged_room>& l : logged) {
+            const string& room = l.first;
+            backend_state& state = states[shard_of(room, shards)];
+
+            if(l.second.adopted) {
+                adopt_room(state, room, l.second.count);
+            } else if(l.second.moved) {
+                move_room(state, room, l.second.count);
+            } else {
+                // rooms no longer in the room status file are kept in the log, but not applied
+                atomic<int32_t>* count = room_count(state, room);
+                if(count != nullptr) count->store(count->load(memory_order_relaxed) + l.second.count, memory_order_relaxed);
+            }
+        }
+
+        list_transfer transfer = make_transfer(states);
+        send_list(server_name, sock, transfer);
+
+        // counters and stage latencies, answered to stats requests
+        stats_registry stats = make_stats(server_name);
+
+        if(shards > 1) {
+            logging::info()<<"The Server "<<server_name<<" is serving its rooms from "<<shards<<" shards.";
+            run_sharded(server_name, sock_port, sock, states, stats, transfer);
+            return 0;
+        }
+
+        backend_state& state = states.front();
+
+        sender_registry senders {};
+        int hold_timeout = -1;
+        int transfer_timeout = resend_transfer(server_name, sock, transfer);
+        datagram_batch batch {MAX_BATCH_DATAGRAMS};
+        vector<msg_port> requests;
+        vector<msg_port> responses;
+        while(true) {
+            // wake up for expiring group reservations, and for room status chunks to send again, even when no requests arrive
+            if(!sock.wait_readable(sooner(hold_timeout, transfer_timeout))) {
+                hold_timeout = expire_holds(server_name, state);
+                transfer_timeout = resend_transfer(server_name, sock, transfer);
+                continue;
+            }
+
+            // drain the queued requests a batch of datagrams per system call, and handle all of them before
+            // flushing the log, so their reservations share a single flush and their responses a single send
+            responses.clear();
+            while(responses.size() < MAX_GROUP_COMMIT && sock.try_recv_many_from(batch, requests) > 0) {
+                // the main server may query from several sockets, such as one per worker thread,
+                // so responses are sent back to the port the request came from
+                for(const msg_port& request : requests) {
+                    if(acknowledge_transfer(server_name, transfer, request)) continue;
+                    if(!accept_sender(server_name, senders, request, responses)) {
+                        forget_groups(server_name, state, senders.reset);
+                        senders.reset.clear();
+                        continue;
+                    }
+
+                    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                    responses.push_back({handle_request(server_name, sock_port, state, stats, request), request.port, request.from});
+                    stats.record_since(HANDLE_STAGE, start);
+                }
+            }
+
+            // no response is sent before the reservations it reports are on disk
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            state.log.sync();
+            stats.record_since(SYNC_STAGE, start);
+
+            remember_responses(senders, responses);
+
+            start = chrono::steady_clock::now();
+            sock.send_many_to(responses);
+            stats.record_since(SEND_STAGE, start);
+
+            hold_timeout = expire_holds(server_name, state);
+            transfer_timeout = resend_transfer(server_name, sock, transfer);
+        }
+
+        return 0;
+
+    } catch(socket_exception& se) {
+        logging::error()<<se.what();
+        return 1;
+    } catch(backend_exception& be) {
+        logging::error()<<be.what();
+        return 1;
+    } catch(reservation_log_exception& le) {
+        logging::error()<<le.what();
+        return 1;
+    } catch(room_table_exception& re) {
+        logging::error()<<re.what();
+        return 1;
+    } catch(stats_exception& se) {
+        logging::error()<<se.what();
         return 1;
     }
 }
@@ -1,5 +1,21 @@
+#pragma once
+
 #include <string>
+#include <string_view>
+
+#include "room_table.h"
 using namespace std;
 
 // interface function for different backend servers
-int run_backend(const char server_name, const int sock_port, const string& filename);
+// with several shards, the rooms are split among as many worker threads, each owning its part of the rooms
+int run_backend(const char server_name, const int sock_port, const string& filename, unsigned int shards = 1);
+
+// returns the number of shards given as the argument at the provided index, or 1 if the argument is absent
+// returns 0 if the argument is not a number of shards
+unsigned int parse_shards(int argc, char* argv[], int index);
+
+// read a room status file into a room table
+room_table read_status(const string& filename);
+
+// take the next line off the front of a request, returns false once no line is left
+bool next_line(string_view& request, string_view& line);
@@ -0,0 +1,54 @@
+#include <cstring>
+#include <errno.h>
+#include <string>
+#include <sys/mman.h>
+
+#include "backend_directory.h"
+
+using namespace std;
+
+
+backend_directory::backend_directory(const map<int, char>& backend): entries {nullptr} {
+    // anonymous shared memory starts zeroed, which marks every entry as free
+    void* region = mmap(nullptr, MAX_BACKENDS * sizeof(backend_entry), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(region == MAP_FAILED) throw backend_directory_exception {string {"backend_directory exception: backend_directory: "} + strerror(errno)};
+
+    entries = static_cast<backend_entry*>(region);
+
+    for(const pair<const int, char>& b : backend) add(b.first, b.second);
+}
+
+
+void backend_directory::add(int port, char name) {
+    for(size_t i = 0; i < MAX_BACKENDS; i++) {
+        int32_t held = entries[i].port.load(memory_order_relaxed);
+        if(held == port) return;
+        if(held != 0) continue;
+
+        entries[i].name = name;
+        entries[i].port.store(port, memory_order_release);
+        return;
+    }
+
+    throw backend_directory_exception {"backend_directory exception: add: no room for Server " + string {name}};
+}
+
+
+char backend_directory::name(int port) const {
+    // entries are filled in order, so the first free one ends the search
+    for(size_t i = 0; i < MAX_BACKENDS; i++) {
+        int32_t held = entries[i].port.load(memory_order_acquire);
+        if(held == 0) break;
+        if(held == port) return entries[i].name;
+    }
+
+    return '?';
+}
+
+
+backend_directory::~backend_directory() {
+    if(entries != nullptr) munmap(entries, MAX_BACKENDS * sizeof(backend_entry));
+}
+
+
+backend_directory_exception::backend_directory_exception(const string& err) : std::runtime_error{err} {}
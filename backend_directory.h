@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+/*
+ * struct backend_entry is a single entry of a backend directory
+ * an entry with port 0 is free
+ */
+struct backend_entry {
+    std::atomic<int32_t> port;
+    char name;
+};
+
+/*
+ * class backend_directory names the backend servers known to the main server by their ports,
+ * allocated in memory that stays shared with forked child processes,
+ * so a backend server added while clients are served is known to every process and thread
+ *
+ * entries are only added, by the process keeping the backend port of the main server,
+ * and an entry is published by storing its port once its name is written
+ */
+class backend_directory {
+private:
+    backend_entry* entries;
+
+public:
+    // backend servers are named by a single character, so the directory holds as many as there are names
+    constexpr static size_t MAX_BACKENDS = 256;
+
+    // allocate a directory holding the provided backend servers, mapping their port to their names
+    explicit backend_directory(const std::map<int, char>& backend);
+
+    // disallow copy operations to maintain unique ownership of the shared memory
+    backend_directory(const backend_directory&) = delete;
+    backend_directory& operator=(const backend_directory&) = delete;
+
+    // add a backend server, a port already held keeps its name
+    void add(int port, char name);
+
+    // returns the name of the backend server of the port, or '?' if the directory does not hold it
+    char name(int port) const;
+
+    // release the shared memory
+    ~backend_directory();
+};
+
+class backend_directory_exception : public std::runtime_error {
+public:
+    backend_directory_exception(const std::string& err);
+};
@@ -0,0 +1,467 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <linux/perf_event.h>
+#include <new>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+#include "backend.h"
+#include "constants.h"
+#include "credential_index.h"
+#include "encrypt.h"
+#include "framing.h"
+#include "md5.h"
+#include "room_table.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace std;
+using namespace socket_constants;
+
+// rooms and members in the generated room status and member files
+constexpr size_t FILE_ROOMS = 10000;
+constexpr size_t FILE_MEMBERS = 10000;
+
+// rooms in the table the lookups are timed against
+constexpr size_t TABLE_ROOMS = 100000;
+
+// strings encrypted together by the batch benchmarks, timed per string
+constexpr size_t BATCH_STRINGS = 256;
+
+const string usage {"usage: bench [filter=SUBSTRING] [repetitions=N] [seconds=PER_REPETITION] [warmup=SECONDS] [out=FILE] [label=TEXT] [baseline=FILE]"};
+
+
+// allocations made through the global operator new, counted so a benchmark reports what it allocates per operation
+static atomic<uint64_t> allocations {0};
+static atomic<uint64_t> allocated_bytes {0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    allocated_bytes.fetch_add(size, memory_order_relaxed);
+
+    void* p = malloc(size == 0 ? 1 : size);
+    if(p == nullptr) throw bad_alloc {};
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+
+// keep the compiler from discarding a result that is otherwise unused
+template <typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+
+/*
+ * class cycle_counter counts the processor cycles spent by the process,
+ * through the hardware counter of the kernel where it is allowed,
+ * or through the time stamp counter otherwise, which ticks at a constant rate rather than with the core clock
+ */
+class cycle_counter {
+private:
+    int fd {-1};
+
+public:
+    cycle_counter() {
+        perf_event_attr attr {};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    cycle_counter(const cycle_counter&) = delete;
+    cycle_counter& operator=(const cycle_counter&) = delete;
+
+    // name of the source of the cycles, for the output to record
+    const char* source() const {
+#if defined(__x86_64__) || defined(__i386__)
+        return fd != -1 ? "perf" : "tsc";
+#else
+        return fd != -1 ? "perf" : "none";
+#endif
+    }
+
+    uint64_t now() const {
+        if(fd != -1) {
+            uint64_t count = 0;
+            if(read(fd, &count, sizeof(count)) == sizeof(count)) return count;
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+    ~cycle_counter() {
+        if(fd != -1) close(fd);
+    }
+};
+
+
+struct bench_options {
+    // only benchmarks whose name holds the filter are run
+    string filter {};
+
+    // timed repetitions of every benchmark, and the seconds each one lasts at least
+    size_t repetitions {5};
+    double seconds {0.2};
+
+    // seconds every benchmark runs untimed before its repetitions, filling caches and settling the clock
+    double warmup {0.1};
+
+    // file the results are written to as JSON, a label stored with them, and results of an earlier run to compare against
+    string out {"bench.json"};
+    string label {};
+    string baseline {};
+};
+
+
+// a benchmark runs its operation the provided number of times
+struct benchmark {
+    string name;
+    function<void(size_t)> run;
+};
+
+
+struct bench_result {
+    string name;
+    size_t operations;
+
+    // medians and minimums over the repetitions
+    double ns_per_op;
+    double min_ns_per_op;
+    double cycles_per_op;
+
+    // averages over every timed operation
+    double allocs_per_op;
+    double bytes_per_op;
+};
+
+
+// parse arguments of the form name=value, leaving the defaults of the names absent
+bench_options parse_options(int argc, char* argv[]) {
+    bench_options options {};
+
+    for(int i = 1; i < argc; i++) {
+        string arg {argv[i]};
+        size_t eq = arg.find('=');
+        if(eq == string::npos) throw runtime_error {usage};
+
+        string name = arg.substr(0, eq), value = arg.substr(eq + 1);
+        try {
+            if(name == "filter") options.filter = value;
+            else if(name == "repetitions") options.repetitions = max<size_t>(1, stoull(value));
+            else if(name == "seconds") options.seconds = stod(value);
+            else if(name == "warmup") options.warmup = stod(value);
+            else if(name == "out") options.out = value;
+            else if(name == "label") options.label = value;
+            else if(name == "baseline") options.baseline = value;
+            else throw runtime_error {usage};
+        } catch(logic_error&) {
+            throw runtime_error {usage};
+        }
+    }
+
+    return options;
+}
+
+
+double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double> {chrono::steady_clock::now() - start}.count();
+}
+
+
+// time a benchmark, sizing its repetitions to last the configured time
+bench_result measure(const benchmark& b, const bench_options& options, const cycle_counter& cycles) {
+    // double the operations until a run is long enough to time, then scale to the repetition time
+    size_t operations = 1;
+    while(true) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        b.run(operations);
+        double elapsed = seconds_since(start);
+
+        if(elapsed >= options.seconds / 10 || operations >= (size_t {1} << 40)) {
+            operations = max<size_t>(1, static_cast<size_t>(operations * options.seconds / max(elapsed, 1e-9)));
+            break;
+        }
+        operations *= 2;
+    }
+
+    chrono::steady_clock::time_point warmup = chrono::steady_clock::now();
+    while(seconds_since(warmup) < options.warmup) b.run(max<size_t>(1, operations / 10));
+
+    vector<double> ns {}, cycle_counts {};
+    uint64_t allocs_before = allocations.load(memory_order_relaxed), bytes_before = allocated_bytes.load(memory_order_relaxed);
+
+    for(size_t r = 0; r < options.repetitions; r++) {
+        uint64_t cycles_start = cycles.now();
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        b.run(operations);
+        double elapsed = seconds_since(start);
+        uint64_t cycles_end = cycles.now();
+
+        ns.push_back(elapsed * 1e9 / operations);
+        cycle_counts.push_back(static_cast<double>(cycles_end - cycles_start) / operations);
+    }
+
+    size_t timed = operations * options.repetitions;
+    double allocs = static_cast<double>(allocations.load(memory_order_relaxed) - allocs_before) / timed;
+    double bytes = static_cast<double>(allocated_bytes.load(memory_order_relaxed) - bytes_before) / timed;
+
+    double min_ns = *min_element(ns.begin(), ns.end());
+    nth_element(ns.begin(), ns.begin() + ns.size() / 2, ns.end());
+    nth_element(cycle_counts.begin(), cycle_counts.begin() + cycle_counts.size() / 2, cycle_counts.end());
+
+    return bench_result {b.name, operations, ns[ns.size() / 2], min_ns, cycle_counts[cycle_counts.size() / 2], allocs, bytes};
+}
+
+
+// a path for a generated input file, removed when the benchmarks finish
+string temporary_path(const string& suffix) {
+    return "/tmp/bench_" + to_string(getpid()) + suffix;
+}
+
+
+// write a room status file of the provided number of rooms, in the format of the backend servers
+void write_rooms(const string& path, size_t rooms) {
+    ofstream f {path};
+    for(size_t i = 0; i < rooms; i++) f<<"R"<<i<<", "<<(i % 7)<<"\r\n";
+}
+
+
+// write a member file of the provided number of members, their credentials encrypted as the main server reads them
+void write_members(const string& path, size_t members) {
+    ofstream f {path};
+    for(size_t i = 0; i < members; i++) f<<encrypt("user" + to_string(i))<<", "<<encrypt("password" + to_string(i))<<"\r\n";
+}
+
+
+// escape a string for a JSON document
+string json_string(const string& s) {
+    string out {"\""};
+    for(char c : s) {
+        if(c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + '"';
+}
+
+
+// write the results as a JSON document, a benchmark per line so runs compare with a line diff as well
+void write_json(const string& path, const bench_options& options, const char* cycle_source, const vector<bench_result>& results) {
+    ofstream f {path};
+    f<<"{\"label\": "<<json_string(options.label)<<", \"cycle_source\": \""<<cycle_source<<"\", \"md5_kernel\": \""<<md5_kernel()<<"\", \"benchmarks\": [\n";
+
+    for(size_t i = 0; i < results.size(); i++) {
+        const bench_result& r = results[i];
+        char line[512];
+        snprintf(line, sizeof(line), "  {\"name\": %s, \"operations\": %zu, \"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, "
+                 "\"cycles_per_op\": %.1f, \"allocs_per_op\": %.3f, \"bytes_per_op\": %.1f}%s\n",
+                 json_string(r.name).c_str(), r.operations, r.ns_per_op, r.min_ns_per_op, r.cycles_per_op, r.allocs_per_op, r.bytes_per_op,
+                 i + 1 < results.size() ? "," : "");
+        f<<line;
+    }
+
+    f<<"]}\n";
+}
+
+
+// read the median time per operation of every benchmark of a document written by write_json
+vector<pair<string, double>> read_baseline(const string& path) {
+    ifstream f {path};
+    if(!f) throw runtime_error {"Failed to read baseline " + path};
+
+    vector<pair<string, double>> baseline {};
+    for(string line; getline(f, line);) {
+        size_t name = line.find("{\"name\": \"");
+        size_t ns = line.find("\"ns_per_op\": ");
+        if(name == string::npos || ns == string::npos) continue;
+
+        name += 10;
+        baseline.emplace_back(line.substr(name, line.find('"', name) - name), stod(line.substr(ns + 13)));
+    }
+
+    return baseline;
+}
+
+
+// time the hot paths of the servers: credential encryption, reading room status and member files,
+// parsing requests and looking up rooms
+// usage: bench [name=value...], best built with -DCMAKE_BUILD_TYPE=Release
+int main(int argc, char* argv[]) {
+    try {
+        bench_options options = parse_options(argc, argv);
+        cycle_counter cycles {};
+
+        const string rooms_path = temporary_path("_rooms.txt");
+        const string members_path = temporary_path("_members.txt");
+        const string index_path = temporary_path("_members.idx");
+        write_rooms(rooms_path, FILE_ROOMS);
+        write_members(members_path, FILE_MEMBERS);
+        credential_index::build(members_path).save(index_path);
+
+        credential_index user_info = credential_index::load(index_path);
+        const string member_hit = encrypt("user" + to_string(FILE_MEMBERS / 2));
+        const string member_miss = encrypt("nobody");
+
+        room_table table {TABLE_ROOMS};
+        vector<string> codes {};
+        for(size_t i = 0; i < TABLE_ROOMS; i++) {
+            codes.push_back("S" + to_string(100000 + i * 7919 % TABLE_ROOMS));
+            table.insert(codes.back(), 0, 1);
+        }
+
+        // requests as the main server and the backend servers receive them
+        const string legacy_request = string {RESERVATION_REQUEST} + "\nS100042";
+        string batch_request {BATCH_AVAILABILITY_REQUEST};
+        for(size_t i = 0; i < 32; i++) batch_request += "\nS" + to_string(100000 + i);
+
+        string frames {};
+        for(uint32_t i = 0; i < 64; i++) framing::encode(frames, FRAME_AVAILABILITY, i, "S" + to_string(100000 + i));
+
+        vector<string> usernames {};
+        vector<string_view> username_views {};
+        for(size_t i = 0; i < BATCH_STRINGS; i++) usernames.push_back("user" + to_string(i));
+        for(const string& u : usernames) username_views.push_back(u);
+
+        vector<benchmark> benchmarks {
+            {"encrypt/username", [&](size_t n) {
+                for(size_t i = 0; i < n; i++) keep(encrypt("alice"));
+            }},
+            {"encrypt/64_bytes", [&](size_t n) {
+                const string input(64, 'x');
+                for(size_t i = 0; i < n; i++) keep(encrypt(input));
+            }},
+            {"encrypt_many/username", [&](size_t n) {
+                for(size_t done = 0; done < n; done += BATCH_STRINGS) keep(encrypt_many(usernames.data(), min(BATCH_STRINGS, n - done)).size());
+            }},
+            {"md5_hex_many/username", [&](size_t n) {
+                char hex[BATCH_STRINGS * MD5_HEX_SIZE];
+                for(size_t done = 0; done < n; done += BATCH_STRINGS) {
+                    md5_hex_many(username_views.data(), min(BATCH_STRINGS, n - done), hex);
+                    keep(hex[0]);
+                }
+            }},
+            {"read_status/10000_rooms", [&](size_t n) {
+                for(size_t i = 0; i < n; i++) keep(read_status(rooms_path).size());
+            }},
+            {"get_user_info/build_10000_members", [&](size_t n) {
+                for(size_t i = 0; i < n; i++) keep(credential_index::build(members_path).size());
+            }},
+            {"get_user_info/load_index", [&](size_t n) {
+                for(size_t i = 0; i < n; i++) keep(credential_index::load(index_path).size());
+            }},
+            {"credential_index/find_hit", [&](size_t n) {
+                for(size_t i = 0; i < n; i++) keep(user_info.find(member_hit));
+            }},
+            {"credential_index/find_miss", [&](size_t n) {
+                for(size_t i = 0; i < n; i++) keep(user_info.find(member_miss));
+            }},
+            {"parse/legacy_istringstream", [&](size_t n) {
+                for(size_t i = 0; i < n; i++) {
+                    string request_type, room;
+                    istringstream sstream {legacy_request};
+                    getline(sstream, request_type);
+                    getline(sstream, room);
+                    keep(room.size());
+                }
+            }},
+            {"parse/batch_32_next_line", [&](size_t n) {
+                for(size_t i = 0; i < n; i++) {
+                    string_view request {batch_request}, line;
+                    size_t lines = 0;
+                    while(next_line(request, line)) lines += line.size();
+                    keep(lines);
+                }
+            }},
+            {"parse/64_frames", [&](size_t n) {
+                for(size_t i = 0; i < n; i++) {
+                    size_t offset = 0;
+                    frame f;
+                    while(framing::decode(frames, offset, f)) keep(f.id);
+                }
+            }},
+            {"room_table/find_hit", [&](size_t n) {
+                for(size_t i = 0; i < n; i++) keep(table.find(codes[i % codes.size()]));
+            }},
+            {"room_table/find_miss", [&](size_t n) {
+                const string missing {"X999999"};
+                for(size_t i = 0; i < n; i++) keep(table.find(missing));
+            }},
+        };
+
+        vector<pair<string, double>> baseline {};
+        if(!options.baseline.empty()) baseline = read_baseline(options.baseline);
+
+        printf("%-36s %12s %12s %10s %10s %10s %10s\n", "benchmark", "ns/op", "min ns/op", "cycles/op", "allocs/op", "bytes/op", "vs base");
+
+        vector<bench_result> results {};
+        for(const benchmark& b : benchmarks) {
+            if(b.name.find(options.filter) == string::npos) continue;
+
+            bench_result r = measure(b, options, cycles);
+            results.push_back(r);
+
+            string change {"-"};
+            auto base = find_if(baseline.begin(), baseline.end(), [&](const pair<string, double>& p) { return p.first == r.name; });
+            if(base != baseline.end() && base->second > 0) {
+                char ratio[32];
+                snprintf(ratio, sizeof(ratio), "%+.1f%%", (r.ns_per_op / base->second - 1) * 100);
+                change = ratio;
+            }
+
+            printf("%-36s %12.1f %12.1f %10.1f %10.2f %10.1f %10s\n", r.name.c_str(), r.ns_per_op, r.min_ns_per_op, r.cycles_per_op,
+                   r.allocs_per_op, r.bytes_per_op, change.c_str());
+        }
+
+        write_json(options.out, options, cycles.source(), results);
+        printf("\ncycles counted with %s, md5 batches hashed with %s, results written to %s\n", cycles.source(), md5_kernel(), options.out.c_str());
+
+        unlink(rooms_path.c_str());
+        unlink(members_path.c_str());
+        unlink(index_path.c_str());
+        return 0;
+
+    } catch(runtime_error& e) {
+        printf("%s\n", e.what());
+        return 1;
+    }
+}
@@ -1,17 +1,16 @@
 #include <cctype>
 #include <iostream>
-#include <sys/socket.h>
 
-#include "socket.h"
-#include "encrypt.h"
 #include "constants.h"
+#include "reservation_client.h"
+#include "socket.h"
 
 using namespace std;
 using namespace socket_constants;
 
 
 // input, send and receive authentication information
-bool authenticate(Socket& sock, string& username, bool& open) {
+bool authenticate(reservation_client& client, string& username, bool& open) {
     bool member = false;
     string password;
 
@@ -29,16 +28,12 @@ bool authenticate(Socket& sock, string& username, bool& open) {
     if(password != "") member = true;
     else member = false;
 
-    string e_username = encrypt(username);
-    string e_password {""};
-    if(member) e_password = encrypt(password);
-
-    sock.send_info(e_username + '\n' + e_password);
+    // the connection the request goes over is only known once it is answered, so the request is reported then
+    reservation_result answer = client.login(username, password).get();
+    const string& result = answer.code;
 
     if(member) cout<<username<<" sent an authentication request to the main server.\n";
-    else cout<<username<<" sent a guest request to the main server using TCP over port "<<sock.bound_port()<<".\n";
-
-    string result = sock.recv_info();
+    else cout<<username<<" sent a guest request to the main server using TCP over port "<<answer.port<<".\n";
 
     bool success = false;
     if(result == VALID_MEMBER) {
@@ -63,12 +58,13 @@ bool authenticate(Socket& sock, string& username, bool& open) {
 
 
 // send and receive availability information
-void check_availability(Socket& sock, const string& room, const string& username, bool& open) {
-    sock.send_info(AVAILABILITY_REQUEST + ('\n' + room));
+void check_availability(reservation_client& client, const string& room, const string& username, bool& open) {
+    future<reservation_result> pending = client.check_availability(room);
     cout<<username<<" sent an availability request to the main server.\n";
 
-    string result = sock.recv_info();
-    cout<<"The client received the response from the main server using TCP over port "<<sock.bound_port()<<".\n";
+    reservation_result answer = pending.get();
+    const string& result = answer.code;
+    cout<<"The client received the response from the main server using TCP over port "<<answer.port<<".\n";
 
     if(result == ROOM_AVAILABLE) {
         cout<<"The requested room is available.\n";
@@ -82,6 +78,8 @@ void check_availability(Socket& sock, const string& room, const string& username
         cout<<"Not able to detect a requested room.\n";
     } else if(result == INVALID_REQUEST) {
         cout<<"The main server detected an invalid request.\n";
+    } else if(result == BACKEND_TIMEOUT) {
+        cout<<"The backend server did not respond in time.\n";
     } else if(result == CLOSED_CONNECTION) {
         cout<<"The main server has closed the connection.\n";
         open = false;
@@ -94,16 +92,17 @@ void check_availability(Socket& sock, const string& room, const string& username
 
 
 // send and receive reservation information
-void create_reservation(Socket& sock, const string& room, const string& username, bool& open) {
-    sock.send_info(RESERVATION_REQUEST + ('\n' + room));
+void create_reservation(reservation_client& client, const string& room, const string& username, bool& open) {
+    future<reservation_result> pending = client.reserve(room);
     cout<<username<<" sent a reservation request to the main server.\n";
 
-    string result = sock.recv_info();
+    reservation_result answer = pending.get();
+    const string& result = answer.code;
 
     if(result == USER_NOT_MEMBER) {
         cout<<"Permission denied: Guest cannot make a reservation.\n";
     } else {
-        cout<<"The client received the response from the main server using TCP over port "<<sock.bound_port()<<".\n";
+        cout<<"The client received the response from the main server using TCP over port "<<answer.port<<".\n";
 
         if(result == ROOM_AVAILABLE) {
             cout<<"Congratulation! The reservation for Room "<<room<<" has been made.\n";
@@ -117,6 +116,8 @@ void create_reservation(Socket& sock, const string& room, const string& username
             cout<<"Not able to detect a requested room.\n";
         } else if(result == INVALID_REQUEST) {
             cout<<"The main server detected an invalid request.\n";
+        } else if(result == BACKEND_TIMEOUT) {
+            cout<<"The backend server did not respond in time.\n";
         } else if(result == CLOSED_CONNECTION) {
             cout<<"The main server has closed the connection.\n";
             open = false;
@@ -158,22 +159,18 @@ string input_request() {
 
 // client program receives requests from the user and communicates with the main server to satisfy these requests
 int main() {
-    constexpr bool debug = false;
-
     try {
-        // create the client TCP socket
-        Socket sock {-1, SOCK_STREAM, -1, debug};
+        // a person makes one request at a time, so a single connection serves them
+        reservation_client client {1};
         cout<<"Client is up and running.\n";
 
-        sock.connect_socket(serverM_client);
-
         bool open = true;
         string username {};
 
         // repeatedly prompt until the user is succesfully authenticated, or if the connection is closed
         bool success = false;
         while(open && !success) {
-            success = authenticate(sock, username, open);
+            success = authenticate(client, username, open);
         }
 
         // repeatedly prompt for requests until the connection is closed
@@ -181,8 +178,8 @@ int main() {
             string room = input_room();
             string request = input_request();
 
-            if(request == "Availability") check_availability(sock, room, username, open);
-            else if(request == "Reservation") create_reservation(sock, room, username, open);
+            if(request == "Availability") check_availability(client, room, username, open);
+            else if(request == "Reservation") create_reservation(client, room, username, open);
             else cout<<"Invalid request entered.\n\n";
 
             if(open) cout<<"-----Start a new request-----\n";
@@ -193,5 +190,8 @@ int main() {
     } catch(socket_exception& se) {
         cout<<se.what()<<endl;
         return 1;
+    } catch(reservation_client_exception& rce) {
+        cout<<rce.what()<<endl;
+        return 1;
     }
 }
@@ -0,0 +1,31 @@
+#include <string>
+
+#include "client_protocol.h"
+#include "constants.h"
+#include "encrypt.h"
+
+using namespace std;
+using namespace socket_constants;
+
+
+string authentication_message(const string& username, const string& password) {
+    string e_password {""};
+    if(password != "") e_password = encrypt(password);
+
+    return encrypt(username) + '\n' + e_password;
+}
+
+
+string availability_message(const string& room) {
+    return AVAILABILITY_REQUEST + ('\n' + room);
+}
+
+
+string reservation_message(const string& room) {
+    return RESERVATION_REQUEST + ('\n' + room);
+}
+
+
+bool authenticated(const string& result) {
+    return result == VALID_MEMBER || result == VALID_GUEST;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+/*
+ * the legacy client protocol spoken to the main server, shared by the interactive client and the load generator
+ *
+ * every message is sent whole in a single write, and answered by a single result code,
+ * so a client waits for each result before sending its next message
+ */
+
+// message authenticating a member, or a guest when the password is empty
+// the credentials are encrypted as the main server stores them
+std::string authentication_message(const std::string& username, const std::string& password);
+
+// message asking whether a room is available
+std::string availability_message(const std::string& room);
+
+// message reserving a room
+std::string reservation_message(const std::string& room);
+
+// returns whether an authentication result admits the user, as a member or as a guest
+bool authenticated(const std::string& result);
@@ -1,3 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
 namespace socket_constants {
     // port numbers
     constexpr int serverS = 41626;
@@ -9,19 +13,85 @@ namespace socket_constants {
     // a received empty string notifies of a closed TCP connection
     constexpr char CLOSED_CONNECTION[] = "";
 
-    // book status send complete
-    constexpr char FINISH_STATUS[] = "0";
+    // backend servers send their room status as a transfer of sequenced chunks, each chunk starting with a line of
+    // this prefix followed by the transfer id, the chunk sequence number and the chunk count, separated by commas
+    // the main server acknowledges with the prefix, the transfer id and the sequence number of the next chunk it expects
+    constexpr char TRANSFER_CHUNK[] = "@";
+
+    // most room status bytes carried by a single chunk
+    constexpr unsigned int TRANSFER_CHUNK_SIZE = 32768;
+
+    // chunks a backend server sends ahead of the acknowledgements, which the main server keeps if received out of order
+    constexpr unsigned int TRANSFER_WINDOW = 16;
 
     // authorization codes
     constexpr char VALID_MEMBER[] = "0";
     constexpr char VALID_GUEST[] = "1";
     constexpr char INVALID_PASSWORD[] = "2";
     constexpr char INVALID_USER[] = "3";
+    constexpr char INVALID_TOKEN[] = "4";
+
+    // names of the authorization codes, in the order of their values, as reported by stats
+    constexpr const char* AUTHORIZATION_CODE_NAMES[] = {"valid_member", "valid_guest", "invalid_password", "invalid_user", "invalid_token"};
+
+    // a request to a backend server may begin with a line of this prefix followed by a request id,
+    // the backend server echoes the line at the start of its response
+    constexpr char REQUEST_ID[] = "#";
 
     // request type codes
     constexpr char AVAILABILITY_REQUEST[] = "A";
     constexpr char RESERVATION_REQUEST[] = "R";
 
+    // batch requests carry one room per line, and are answered with one response per line in the same order
+    // a successful reservation is answered with the response code and the updated count, separated by a comma
+    constexpr char BATCH_AVAILABILITY_REQUEST[] = "a";
+    constexpr char BATCH_RESERVATION_REQUEST[] = "r";
+
+    // group reservations are two phase: the rooms of every backend server involved are first held,
+    // then the holds are made final by a commit or released by an abort
+    // each of these requests carries a transaction id line, a prepare request also carries one room per line
+    constexpr char PREPARE_REQUEST[] = "P";
+    constexpr char COMMIT_REQUEST[] = "C";
+    constexpr char ABORT_REQUEST[] = "X";
+
+    // rooms are rebalanced between backend servers by moving them out of one and adopting them into another
+    // a move request carries one room per line and is answered with a line of each room and its count, separated by a comma
+    // an adopt request carries those lines as they were answered
+    // a room held by a group reservation is not moved, and is answered with HELD_COUNT in place of its count
+    // once moved out, a room is answered with ROOM_MOVED_OUT, and its requests are sent again to the backend server adopting it
+    constexpr char MOVE_REQUEST[] = "M";
+    constexpr char ADOPT_REQUEST[] = "O";
+    constexpr int HELD_COUNT = -1;
+
+    // a stats request is answered with the counters and stage latencies of the backend server, in the Prometheus text format
+    constexpr char STATS_REQUEST[] = "S";
+
+    // backend servers only serve requests sent from the backend port of the main server, or from a port it registered,
+    // such as the socket of a worker thread or a forked child
+    // a register request is sent from the backend port of the main server, carries one port per line,
+    // and is answered with ROOM_AVAILABLE once the ports are accepted
+    // an unregister request is sent from the backend port of the main server once the sockets of the ports it carries are closed,
+    // one port per line, and is not answered
+    constexpr char REGISTER_REQUEST[] = "W";
+    constexpr char UNREGISTER_REQUEST[] = "Q";
+
+    // framed protocol message types, a response carries the type and id of its request
+    constexpr uint8_t FRAME_AUTHENTICATION = 'L';
+    constexpr uint8_t FRAME_AVAILABILITY = 'A';
+    constexpr uint8_t FRAME_RESERVATION = 'R';
+    constexpr uint8_t FRAME_BATCH_AVAILABILITY = 'a';
+    constexpr uint8_t FRAME_BATCH_RESERVATION = 'r';
+    constexpr uint8_t FRAME_GROUP_RESERVATION = 'g';
+
+    // a successful framed authentication is answered with the authorization code followed by a line of a session token,
+    // which a later connection sends in a resume frame instead of authenticating again,
+    // pipelining its first requests right behind it
+    constexpr uint8_t FRAME_RESUME = 'T';
+
+    // a stats frame is answered with the counters and stage latencies of the main server, in the Prometheus text format,
+    // and is accepted before authentication so monitoring can scrape it without an account
+    constexpr uint8_t FRAME_STATS = 'S';
+
     // availability and reservation codes
     constexpr char ROOM_AVAILABLE[] = "0";
     constexpr char ROOM_NOT_AVAILABLE[] = "1";
@@ -30,4 +100,11 @@ namespace socket_constants {
     constexpr char REQUEST_EMPTY[] = "4";
     constexpr char ROOM_EMPTY[] = "5";
     constexpr char INVALID_REQUEST[] = "6";
+    constexpr char BACKEND_TIMEOUT[] = "7";
+    constexpr char ROOM_MOVED_OUT[] = "8";
+
+    // names of the availability and reservation codes, in the order of their values, as reported by stats
+    constexpr const char* RESPONSE_CODE_NAMES[] = {"room_available", "room_not_available", "room_not_found", "user_not_member",
+                                                   "request_empty", "room_empty", "invalid_request", "backend_timeout",
+                                                   "room_moved_out"};
 }
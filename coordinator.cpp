@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <fstream>
+#include <set>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#include "coordinator.h"
+#include "constants.h"
+#include "logger.h"
+
+using namespace std;
+using namespace socket_constants;
+
+
+map<int, char> get_topology(const string& topology_filename, bool& by_prefix) {
+    ifstream f {topology_filename};
+    by_prefix = !f.good();
+    if(by_prefix) return {{serverS, 'S'}, {serverD, 'D'}, {serverU, 'U'}};
+
+    map<int, char> backend {};
+    set<char> names {};
+
+    string name;
+    int port;
+    string next_line;
+    while(f.good() && getline(f, name, ',') && f >> port) {
+        // a backend server is placed on the hash ring by name, so names must be unique as well as ports
+        bool valid = name.size() == 1 && port > 0 && port <= 65535 && port != serverM_backend && port != serverM_client;
+        if(!valid || !names.insert(name[0]).second || !backend.emplace(port, name[0]).second) {
+            throw coordinator_exception {"coordinator exception: get_topology: invalid backend server " + name + " in " + topology_filename};
+        }
+
+        getline(f, next_line);
+    }
+
+    if(backend.empty()) throw coordinator_exception {"coordinator exception: get_topology: no backend server in " + topology_filename};
+    return backend;
+}
+
+
+coordinator::coordinator(Socket& ssock, map<int, char>& bknd, backend_directory& dir, status_receiver& sr, port_registrar& pr,
+                         room_table& rs, uint32_t& request_ids, const hash_ring& hr, const string& filename):
+    server_sock {ssock}, backend {bknd}, directory {dir}, transfers {sr}, registrar {pr},
+    ring {hr}, balancer {ssock, bknd, rs, request_ids, hr}, topology_filename {filename}, reload_signal {-1}, waiting_ring {}, added {} {
+
+    sigset_t sighup;
+    sigemptyset(&sighup);
+    sigaddset(&sighup, SIGHUP);
+
+    int status = pthread_sigmask(SIG_BLOCK, &sighup, nullptr);
+    if(status != 0) throw coordinator_exception {string {"coordinator exception: pthread_sigmask: "} + strerror(status)};
+
+    reload_signal = signalfd(-1, &sighup, SFD_NONBLOCK | SFD_CLOEXEC);
+    if(reload_signal == -1) throw coordinator_exception {string {"coordinator exception: signalfd: "} + strerror(errno)};
+}
+
+
+void coordinator::rebalance(const vector<pair<string, int>>& stray_rooms) {
+    balancer.start(ring, stray_rooms);
+}
+
+
+bool coordinator::settled() const {
+    return balancer.settled();
+}
+
+
+int coordinator::descriptor() const {
+    return reload_signal;
+}
+
+
+void coordinator::reload() {
+    signalfd_siginfo info;
+    while(read(reload_signal, &info, sizeof(info)) == sizeof(info));
+
+    logging::info()<<"The main server is reading "<<topology_filename<<" again.";
+
+    bool by_prefix = false;
+    map<int, char> topology {};
+    try {
+        topology = get_topology(topology_filename, by_prefix);
+    } catch(coordinator_exception& ce) {
+        logging::error()<<ce.what()<<", keeping the current topology.";
+        return;
+    }
+
+    if(by_prefix) {
+        logging::warning()<<"The main server found no "<<topology_filename<<", keeping the current topology.";
+        return;
+    }
+
+    // the backend servers of the ring are told apart by name, and answer the main server from their ports,
+    // so a backend server keeps both while the main server runs
+    for(const pair<const int, char>& b : topology) {
+        map<int, char>::const_iterator renamed = backend.find(b.first);
+        map<int, char>::const_iterator moved = find_if(backend.begin(), backend.end(), [&](const pair<const int, char>& known) {
+            return known.second == b.second && known.first != b.first;
+        });
+
+        if((renamed != backend.end() && renamed->second != b.second) || moved != backend.end()) {
+            logging::error()<<"The main server cannot take Server "<<b.second<<" with port "<<b.first<<" in while serving, keeping the current topology.";
+            return;
+        }
+    }
+
+    for(const pair<const int, char>& b : topology) {
+        if(!backend.emplace(b.first, b.second).second) continue;
+
+        // an added backend server sends its room status like one that restarted, and serves the registered ports once told to
+        directory.add(b.first, b.second);
+        transfers.add(b.first);
+        registrar.renew(b.first);
+        added.push_back(b.first);
+
+        logging::info()<<"The main server added Server "<<b.second<<" with port "<<b.first<<".";
+    }
+
+    // an added backend server left out of the topology again is no longer waited on
+    added.erase(remove_if(added.begin(), added.end(), [&](int port) { return topology.count(port) == 0; }), added.end());
+
+    for(const pair<const int, char>& b : backend) {
+        if(topology.count(b.first) == 0) logging::info()<<"The main server is moving the rooms of Server "<<b.second<<" to the other Servers.";
+    }
+
+    waiting_ring.emplace(topology, false);
+    start_waiting();
+}
+
+
+void coordinator::start_waiting() {
+    if(!waiting_ring) return;
+    // a backend server still sending its room status drops the requests it is sent
+    if(!all_of(added.begin(), added.end(), [&](int port) { return transfers.received(port) && registrar.answered(port); })) return;
+
+    ring = std::move(*waiting_ring);
+    waiting_ring.reset();
+    balancer.start(ring);
+    added.clear();
+}
+
+
+bool coordinator::receive(const msg_port& rec) {
+    // a backend server that restarted or was added sends its room status, and has every port registered with it once it arrives
+    if(status_receiver::is_chunk(rec.msg)) {
+        if(transfers.receive(server_sock, rec)) {
+            registrar.renew(rec.port);
+            start_waiting();
+        }
+        return true;
+    }
+
+    if(registrar.receive(rec)) {
+        start_waiting();
+        return true;
+    }
+
+    return balancer.receive(rec);
+}
+
+
+void coordinator::expire() {
+    registrar.expire();
+    balancer.expire();
+    start_waiting();
+}
+
+
+int coordinator::next_timeout() const {
+    int registering = registrar.next_timeout();
+    int rebalancing = balancer.next_timeout();
+
+    if(registering == -1) return rebalancing;
+    if(rebalancing == -1) return registering;
+    return min(registering, rebalancing);
+}
+
+
+coordinator::~coordinator() {
+    if(reload_signal != -1) close(reload_signal);
+}
+
+
+coordinator_exception::coordinator_exception(const string& err) : std::runtime_error{err} {}
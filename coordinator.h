@@ -0,0 +1,110 @@
+#pragma once
+
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "backend_directory.h"
+#include "hash_ring.h"
+#include "port_registrar.h"
+#include "rebalancer.h"
+#include "room_table.h"
+#include "socket.h"
+#include "status_receiver.h"
+
+// read the backend servers from the given file, one name and port per line separated by a comma,
+// and map their ports to their names
+// without a topology file, the three backend servers of the default setup are used, and by_prefix is set,
+// so their rooms stay routed by the first character of their code, as the stock room status files expect
+std::map<int, char> get_topology(const std::string& topology_filename, bool& by_prefix);
+
+/*
+ * class coordinator carries out the duties of the backend port of the main server while clients are served:
+ * it takes in the room status of backend servers that restart, registers the ports of worker threads and forked children,
+ * and moves rooms between backend servers as the topology changes
+ *
+ * the topology file is read again on SIGHUP, a backend server added to it takes part without a restart,
+ * and a backend server left out of it has its rooms moved to the others, while it stays known by name
+ * rooms only move to an added backend server once it sent its room status and serves every registered port
+ */
+class coordinator {
+private:
+    // backend facing UDP socket bound to the backend port of the main server
+    Socket& server_sock;
+
+    // collection of backend servers ever part of the topology, mapping their port to their names
+    std::map<int, char>& backend;
+
+    // the same backend servers, named in memory shared with every process and thread
+    backend_directory& directory;
+
+    // room status transfers of the backend servers
+    status_receiver& transfers;
+
+    // registrations of the ports of worker threads and forked children
+    port_registrar& registrar;
+
+    // ring of the current topology, mapping each room to the port of the backend server it belongs to
+    hash_ring ring;
+
+    // moves of rooms to their owners on the ring
+    rebalancer balancer;
+
+    std::string topology_filename;
+
+    // signalfd reporting SIGHUP, which asks for the topology file to be read again
+    int reload_signal;
+
+    // ring of a topology read again, waiting for its added backend servers to send their room status and serve every registered port
+    std::optional<hash_ring> waiting_ring;
+    std::vector<int> added;
+
+    // start moving rooms to the ring waiting on added backend servers, once they sent their room status and serve every registered port
+    void start_waiting();
+
+public:
+    // constructor, SIGHUP is blocked in the calling thread, and in the threads and processes it starts afterwards,
+    // so the signal is only ever taken in through the descriptor of the coordinator
+    coordinator(Socket& server_sock, std::map<int, char>& backend, backend_directory& directory,
+                status_receiver& transfers, port_registrar& registrar, room_table& room_status,
+                uint32_t& request_ids, const hash_ring& ring, const std::string& topology_filename);
+
+    // disallow copy operations to maintain unique ownership of the signal descriptor
+    coordinator(const coordinator&) = delete;
+    coordinator& operator=(const coordinator&) = delete;
+
+    // move the rooms held by a backend server other than their owner to their owner, as well as stray copies out of
+    // the backend servers holding them, such as after the topology changed while the main server was down
+    void rebalance(const std::vector<std::pair<std::string, int>>& stray_rooms);
+
+    // returns whether no rooms are being moved
+    bool settled() const;
+
+    // descriptor becoming readable once SIGHUP is received, to be watched along with the backend port
+    int descriptor() const;
+
+    // read the topology file again, taking in added backend servers and moving rooms to their new owners
+    // a topology file that is missing, malformed or moves a known backend server to another port is ignored
+    void reload();
+
+    // take in a datagram received on the backend port of the main server
+    // returns whether it was a room status chunk, or answered a registration or a rebalancing request
+    bool receive(const msg_port& rec);
+
+    // send again the requests whose backend server has not answered in time
+    void expire();
+
+    // milliseconds until a request is due to be sent again, or -1 if none is
+    int next_timeout() const;
+
+    // close the signal descriptor
+    ~coordinator();
+};
+
+class coordinator_exception : public std::runtime_error {
+public:
+    coordinator_exception(const std::string& err);
+};
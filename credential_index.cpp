@@ -0,0 +1,323 @@
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "credential_index.h"
+
+using namespace std;
+
+
+// an index starts with a header, followed by the slots of the hash table and then by the records,
+// each record being the lengths of a username and its password followed by the two of them
+// the header is as large as a cache line, so the slots stay aligned
+struct index_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved_flags;
+
+    uint64_t capacity;
+    uint64_t users;
+
+    // size of the whole index, checked against the size of a mapped file
+    uint64_t size;
+
+    char reserved[24];
+};
+
+static_assert(sizeof(index_header) == 64, "index header must keep slots aligned");
+
+constexpr char INDEX_MAGIC[8] = {'C', 'R', 'E', 'D', 'I', 'N', 'D', 'X'};
+
+// bumped whenever the layout or the hash function changes, so older indexes are rejected
+constexpr uint32_t INDEX_VERSION = 1;
+
+// a slot keeps the record offset in its low bits, enough for an index of a terabyte,
+// and the top bits of the username hash above them, so most mismatches are skipped without reading the record
+// a free slot is zero, as no record starts at offset zero
+constexpr int OFFSET_BITS = 40;
+constexpr uint64_t OFFSET_MASK = (uint64_t {1} << OFFSET_BITS) - 1;
+
+// lengths of the username and password that start every record
+constexpr size_t RECORD_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+
+// FNV-1a hash of a username, with its bits spread over the whole word
+// so both the slot, picked by the low bits, and the tag, taken from the top bits, depend on all of them
+static uint64_t hash_username(string_view username) {
+    uint64_t h = 14695981039346656037ull;
+    for(unsigned char c : username) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+
+    return h;
+}
+
+
+// the username of the record at the provided offset
+static string_view record_username(const char* base, uint64_t offset) {
+    uint32_t length;
+    memcpy(&length, base + offset, sizeof(length));
+
+    return {base + offset + RECORD_HEADER_SIZE, length};
+}
+
+
+// the password of the record at the provided offset
+static string_view record_password(const char* base, uint64_t offset) {
+    uint32_t lengths[2];
+    memcpy(lengths, base + offset, sizeof(lengths));
+
+    return {base + offset + RECORD_HEADER_SIZE + lengths[0], lengths[1]};
+}
+
+
+// returns whether the record at the provided offset lies within the records of an index of the provided size
+// the offsets of a loaded index are checked as they are used, so its pages are still read only once needed
+static bool record_fits(const char* base, size_t size, uint64_t records, uint64_t offset) {
+    if(offset < records || offset > size || size - offset < RECORD_HEADER_SIZE) return false;
+
+    uint32_t lengths[2];
+    memcpy(lengths, base + offset, sizeof(lengths));
+
+    return uint64_t {lengths[0]} + lengths[1] <= size - offset - RECORD_HEADER_SIZE;
+}
+
+
+// call the provided function with the username and password of every line of a member file,
+// splitting each line at its first comma and skipping the character following it
+// lines without a comma hold no user and are skipped
+template <typename Function>
+static void for_each_member(string_view contents, Function f) {
+    while(!contents.empty()) {
+        size_t end = contents.find('\n');
+        string_view line = contents.substr(0, end);
+        contents.remove_prefix(end == string_view::npos ? contents.size() : end + 1);
+
+        size_t comma = line.find(',');
+        if(comma == string_view::npos) continue;
+
+        string_view password = line.substr(min(comma + 2, line.size()));
+        f(line.substr(0, comma), password);
+    }
+}
+
+
+credential_index::credential_index(void* region, size_t region_size): region {region}, region_size {region_size} {
+    const index_header* header = static_cast<const index_header*>(region);
+
+    slots = reinterpret_cast<const uint64_t*>(static_cast<const char*>(region) + sizeof(index_header));
+    capacity = header->capacity;
+    users = header->users;
+}
+
+
+credential_index::credential_index(credential_index&& index):
+    region {index.region}, region_size {index.region_size}, slots {index.slots}, capacity {index.capacity}, users {index.users} {
+    index.region = nullptr;
+}
+
+
+credential_index credential_index::build(const string& member_path) {
+    int fd = open(member_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd == -1) throw credential_index_exception {"credential_index exception: build: " + member_path + ": " + strerror(errno)};
+
+    struct stat info;
+    if(fstat(fd, &info) == -1) {
+        close(fd);
+        throw credential_index_exception {"credential_index exception: build: " + member_path + ": " + strerror(errno)};
+    }
+
+    // the member file is scanned in place, so no line is ever copied into a string of its own
+    size_t file_size = info.st_size;
+    void* file = file_size == 0 ? nullptr : mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(file == MAP_FAILED) throw credential_index_exception {"credential_index exception: build: " + member_path + ": " + strerror(errno)};
+
+    string_view contents {static_cast<const char*>(file), file_size};
+
+    // a first pass sizes the index, so it is laid out in a single block
+    size_t lines = 0;
+    size_t records_size = 0;
+    for_each_member(contents, [&](string_view username, string_view password) {
+        lines++;
+        records_size += RECORD_HEADER_SIZE + username.size() + password.size();
+    });
+
+    // keep the table at most half full so probe sequences stay short
+    size_t slot_count = 16;
+    while(slot_count < lines * 2) slot_count *= 2;
+
+    size_t size = sizeof(index_header) + slot_count * sizeof(uint64_t) + records_size;
+    if(size > OFFSET_MASK) {
+        if(file != nullptr) munmap(file, file_size);
+        throw credential_index_exception {"credential_index exception: build: " + member_path + " is too large to index"};
+    }
+
+    // anonymous memory starts zeroed, which marks every slot as free
+    void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(region == MAP_FAILED) {
+        if(file != nullptr) munmap(file, file_size);
+        throw credential_index_exception {string {"credential_index exception: build: "} + strerror(errno)};
+    }
+
+    char* base = static_cast<char*>(region);
+    uint64_t* slots = reinterpret_cast<uint64_t*>(base + sizeof(index_header));
+    uint64_t mask = slot_count - 1;
+    uint64_t next = sizeof(index_header) + slot_count * sizeof(uint64_t);
+    size_t users = 0;
+
+    for_each_member(contents, [&](string_view username, string_view password) {
+        uint32_t lengths[2] = {static_cast<uint32_t>(username.size()), static_cast<uint32_t>(password.size())};
+        memcpy(base + next, lengths, sizeof(lengths));
+        memcpy(base + next + RECORD_HEADER_SIZE, username.data(), username.size());
+        memcpy(base + next + RECORD_HEADER_SIZE + username.size(), password.data(), password.size());
+
+        uint64_t h = hash_username(username);
+        uint64_t tag = h >> OFFSET_BITS;
+
+        for(uint64_t i = h & mask;; i = (i + 1) & mask) {
+            if(slots[i] == 0) {
+                slots[i] = tag << OFFSET_BITS | next;
+                users++;
+                break;
+            }
+
+            // a username listed again replaces its earlier password
+            if(slots[i] >> OFFSET_BITS == tag && record_username(base, slots[i] & OFFSET_MASK) == username) {
+                slots[i] = tag << OFFSET_BITS | next;
+                break;
+            }
+        }
+
+        next += RECORD_HEADER_SIZE + username.size() + password.size();
+    });
+
+    if(file != nullptr) munmap(file, file_size);
+
+    index_header* header = reinterpret_cast<index_header*>(base);
+    memcpy(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header->version = INDEX_VERSION;
+    header->capacity = slot_count;
+    header->users = users;
+    header->size = size;
+
+    return credential_index {region, size};
+}
+
+
+credential_index credential_index::load(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd == -1) throw credential_index_exception {"credential_index exception: load: " + path + ": " + strerror(errno)};
+
+    struct stat info;
+    if(fstat(fd, &info) == -1) {
+        close(fd);
+        throw credential_index_exception {"credential_index exception: load: " + path + ": " + strerror(errno)};
+    }
+
+    size_t size = info.st_size;
+    if(size < sizeof(index_header)) {
+        close(fd);
+        throw credential_index_exception {"credential_index exception: load: " + path + " is not a credential index"};
+    }
+
+    // a shared read-only mapping keeps a single copy of the index in the page cache for every process
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED) throw credential_index_exception {"credential_index exception: load: " + path + ": " + strerror(errno)};
+
+    const index_header* header = static_cast<const index_header*>(mapped);
+    uint64_t capacity = header->capacity;
+
+    bool valid = memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0
+              && header->version == INDEX_VERSION
+              && capacity >= 16 && (capacity & (capacity - 1)) == 0
+              && header->users * 2 <= capacity
+              && header->size == size
+              && size >= sizeof(index_header) + capacity * sizeof(uint64_t);
+
+    if(!valid) {
+        munmap(mapped, size);
+        throw credential_index_exception {"credential_index exception: load: " + path + " is not a compatible credential index"};
+    }
+
+    return credential_index {mapped, size};
+}
+
+
+optional<string_view> credential_index::find(string_view username) const {
+    const char* base = static_cast<const char*>(region);
+    uint64_t mask = capacity - 1;
+
+    uint64_t h = hash_username(username);
+    uint64_t tag = h >> OFFSET_BITS;
+
+    // records follow the slots, so no valid record starts before them
+    uint64_t records = sizeof(index_header) + capacity * sizeof(uint64_t);
+
+    // linear probing until the username or a free slot is found,
+    // a loaded index is not checked for a free slot, so the probes stop once every slot is seen
+    for(uint64_t i = h & mask, probes = 0; probes < capacity; i = (i + 1) & mask, probes++) {
+        uint64_t slot = slots[i];
+        if(slot == 0) return nullopt;
+
+        uint64_t offset = slot & OFFSET_MASK;
+        if(slot >> OFFSET_BITS != tag) continue;
+
+        // a corrupt offset is never read through, leaving its username unknown
+        if(!record_fits(base, region_size, records, offset)) return nullopt;
+        if(record_username(base, offset) == username) return record_password(base, offset);
+    }
+
+    return nullopt;
+}
+
+
+size_t credential_index::size() const {
+    return users;
+}
+
+
+void credential_index::save(const string& path) const {
+    // write beside the old index and swap it in, so the main server never maps a partial index
+    const string temp_path = path + ".tmp";
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd == -1) throw credential_index_exception {"credential_index exception: save: " + temp_path + ": " + strerror(errno)};
+
+    const char* data = static_cast<const char*>(region);
+    size_t written = 0;
+    while(written < region_size) {
+        ssize_t n = write(fd, data + written, region_size - written);
+
+        if(n == -1 && errno == EINTR) continue;
+        if(n == -1) {
+            close(fd);
+            throw credential_index_exception {"credential_index exception: save: " + temp_path + ": " + strerror(errno)};
+        }
+
+        written += n;
+    }
+
+    if(fsync(fd) == -1 || close(fd) == -1 || rename(temp_path.c_str(), path.c_str()) == -1) {
+        throw credential_index_exception {"credential_index exception: save: " + path + ": " + strerror(errno)};
+    }
+}
+
+
+credential_index::~credential_index() {
+    if(region != nullptr) munmap(region, region_size);
+}
+
+
+credential_index_exception::credential_index_exception(const string& err) : std::runtime_error{err} {}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/*
+ * class credential_index maps encrypted usernames to their encrypted passwords,
+ * searched in place within a single block of memory rather than held as one allocation per user
+ *
+ * the block is an open addressing hash table of record offsets followed by the records themselves,
+ * laid out identically in an index file, so a prebuilt index is mapped as is and shared by every
+ * forked child and worker thread, and startup and resident memory stay flat however many members there are
+ */
+class credential_index {
+private:
+    // mapped memory holding the index
+    void* region;
+    size_t region_size;
+
+    // slots of the hash table, each holding a record offset in its low bits and part of the username hash above it
+    const uint64_t* slots;
+    size_t capacity;
+    size_t users;
+
+    // adopt an index laid out in mapped memory
+    credential_index(void* region, size_t region_size);
+
+public:
+    // read a member file of comma separated usernames and passwords and lay out its index in memory
+    // a username listed twice keeps its last password
+    static credential_index build(const std::string& member_path);
+
+    // map an index file written by save, reading its pages from the file as they are first used
+    // record offsets are checked as they are looked up, so a corrupt index never reads past its mapping
+    static credential_index load(const std::string& path);
+
+    // disallow copy operations to maintain unique ownership of the mapped memory
+    credential_index(const credential_index&) = delete;
+    credential_index& operator=(const credential_index&) = delete;
+
+    // allow moving, leaving the source without memory
+    credential_index(credential_index&& index);
+
+    // returns the password saved for the username, or nothing if the username is unknown
+    std::optional<std::string_view> find(std::string_view username) const;
+
+    // number of users held
+    size_t size() const;
+
+    // write the index to a file, replacing it only once completely written
+    void save(const std::string& path) const;
+
+    // release the mapped memory
+    ~credential_index();
+};
+
+class credential_index_exception : public std::runtime_error {
+public:
+    credential_index_exception(const std::string& err);
+};
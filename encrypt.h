@@ -1,8 +1,13 @@
 #include <string>
+#include <vector>
 
 // encrypt determines the method of user credential encryption
 std::string encrypt(const std::string& s);
 
+// encrypt several strings at once, returning what encrypt returns for each, in order
+// a method may encrypt them together, faster than one at a time
+std::vector<std::string> encrypt_many(const std::string* s, size_t count);
+
 // user_filename is the file which contains the encrypted user credentials
 // using the specified encryption method
 extern const std::string user_filename;
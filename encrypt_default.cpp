@@ -15,4 +15,12 @@ string encrypt(const string& s) {
     return encrypted;
 }
 
+// the default method is cheap enough to apply to one string at a time
+vector<string> encrypt_many(const string* in, size_t count) {
+    vector<string> encrypted {};
+    for(size_t i = 0; i < count; i++) encrypted.push_back(encrypt(in[i]));
+
+    return encrypted;
+}
+
 const string user_filename {"member.txt"};
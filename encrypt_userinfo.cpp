@@ -1,17 +1,269 @@
-#include <fstream>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
 #include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
+#include "credential_index.h"
 #include "encrypt.h"
 
 using namespace std;
 
-int main() {
-    ifstream f {"member_unencrypted.txt"};
+// bytes of the unencrypted file each worker encrypts at a time, extended to the end of its last line
+constexpr size_t CHUNK_SIZE = 4 << 20;
 
-    string username, password;
-    while(f.good() && getline(f, username, ',') && f.ignore() && getline(f, password, '\r')) {
-        cout<<encrypt(username)<<", "<<encrypt(password)<<'\n';
-        f.ignore();
+// chunks encrypted ahead of the one being written, per worker, bounding the memory held by finished chunks
+constexpr size_t CHUNKS_AHEAD = 4;
+
+// lines whose credentials are encrypted together, so the hashes are computed several at a time
+constexpr size_t LINES_PER_BATCH = 128;
+
+
+/*
+ * struct chunk_queue hands the chunks of the unencrypted file to the workers in order,
+ * and their encrypted text back to the writer in the same order
+ */
+struct chunk_queue {
+    // offsets of the chunks within the file, chunk i spans from bounds[i] to bounds[i + 1]
+    vector<size_t> bounds {};
+
+    // encrypted text and users of every chunk, released once written
+    vector<string> encrypted {};
+    vector<size_t> users {};
+    vector<bool> done {};
+
+    mutex lock;
+    condition_variable finished;
+    condition_variable written;
+
+    size_t next_chunk {0};
+    size_t next_write {0};
+    size_t window {0};
+};
+
+
+// split the file into chunks that end on line boundaries
+vector<size_t> chunk_bounds(string_view contents) {
+    vector<size_t> bounds {0};
+
+    size_t start = 0;
+    while(start < contents.size()) {
+        size_t end = min(start + CHUNK_SIZE, contents.size());
+        if(end < contents.size()) {
+            size_t newline = contents.find('\n', end - 1);
+            end = newline == string_view::npos ? contents.size() : newline + 1;
+        }
+
+        bounds.push_back(end);
+        start = end;
     }
 
+    return bounds;
+}
+
+
+// encrypt the credentials of every line of a chunk, written as the username and password separated by a comma and a space
+// lines end in a carriage return and a newline, lines without a comma hold no user and are skipped
+// returns the number of users encrypted
+size_t encrypt_chunk(string_view chunk, string& out) {
+    out.reserve(chunk.size() * 4);
+
+    // credentials of a batch of lines, usernames and passwords alternating, encrypted together
+    vector<string> credentials(2 * LINES_PER_BATCH);
+    size_t batched = 0;
+    size_t users = 0;
+
+    auto flush = [&]() {
+        vector<string> encrypted = encrypt_many(credentials.data(), batched);
+
+        for(size_t i = 0; i < batched; i += 2) {
+            out += encrypted[i];
+            out += ", ";
+            out += encrypted[i + 1];
+            out += '\n';
+        }
+
+        users += batched / 2;
+        batched = 0;
+    };
+
+    while(!chunk.empty()) {
+        size_t end = chunk.find('\n');
+        string_view line = chunk.substr(0, end);
+        chunk.remove_prefix(end == string_view::npos ? chunk.size() : end + 1);
+
+        if(!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+        size_t comma = line.find(',');
+        if(comma == string_view::npos) continue;
+
+        credentials[batched++].assign(line.substr(0, comma));
+        credentials[batched++].assign(line.substr(min(comma + 2, line.size())));
+        if(batched == credentials.size()) flush();
+    }
+
+    if(batched > 0) flush();
+    return users;
+}
+
+
+// workers take the next chunk as the writer makes room for it, and hand back its encrypted text
+void run_worker(string_view contents, chunk_queue& queue) {
+    size_t chunks = queue.bounds.size() - 1;
+
+    while(true) {
+        size_t index;
+        {
+            unique_lock<mutex> guard {queue.lock};
+            queue.written.wait(guard, [&]() { return queue.next_chunk >= chunks || queue.next_chunk < queue.next_write + queue.window; });
+            if(queue.next_chunk >= chunks) return;
+
+            index = queue.next_chunk++;
+        }
+
+        string encrypted {};
+        size_t users = encrypt_chunk(contents.substr(queue.bounds[index], queue.bounds[index + 1] - queue.bounds[index]), encrypted);
+
+        {
+            lock_guard<mutex> guard {queue.lock};
+            queue.encrypted[index] = std::move(encrypted);
+            queue.users[index] = users;
+            queue.done[index] = true;
+        }
+        queue.finished.notify_all();
+    }
+}
+
+
+// write the whole buffer, retrying partial writes
+void write_all(int fd, const string& data) {
+    size_t written = 0;
+    while(written < data.size()) {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if(n == -1 && errno == EINTR) continue;
+        if(n == -1) throw runtime_error {string {"encrypt_userinfo: write: "} + strerror(errno)};
+
+        written += n;
+    }
+}
+
+
+// encrypt the credentials of an unencrypted member file into the member file the main server reads,
+// writing to the standard output unless a member file is named, and building its index as well if one is named
+// the file is mapped and split into chunks encrypted by a worker per CPU, then written in their order
+int main(int argc, char* argv[]) {
+    if(argc > 4) {
+        cout<<"usage: encrypt_userinfo [unencrypted file] [member file] [index file]\n";
+        return 1;
+    }
+
+    const string input = argc > 1 ? argv[1] : "member_unencrypted.txt";
+    const string output = argc > 2 ? argv[2] : "";
+    const string index = argc > 3 ? argv[3] : "";
+
+    // the index is built from the member file, so it cannot be written to the standard output
+    if(!index.empty() && output.empty()) {
+        cout<<"encrypt_userinfo: an index needs a member file to be named\n";
+        return 1;
+    }
+
+    try {
+        int in_fd = open(input.c_str(), O_RDONLY);
+        if(in_fd == -1) throw runtime_error {"encrypt_userinfo: " + input + ": " + strerror(errno)};
+
+        struct stat info;
+        if(fstat(in_fd, &info) == -1) {
+            close(in_fd);
+            throw runtime_error {"encrypt_userinfo: " + input + ": " + strerror(errno)};
+        }
+
+        // the file is read in place, an empty file maps nothing
+        size_t size = info.st_size;
+        void* mapped = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, in_fd, 0) : nullptr;
+        close(in_fd);
+        if(mapped == MAP_FAILED) throw runtime_error {"encrypt_userinfo: " + input + ": " + strerror(errno)};
+        if(mapped != nullptr) madvise(mapped, size, MADV_SEQUENTIAL);
+
+        string_view contents {static_cast<const char*>(mapped), size};
+
+        int out_fd = STDOUT_FILENO;
+        if(!output.empty()) {
+            out_fd = open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if(out_fd == -1) throw runtime_error {"encrypt_userinfo: " + output + ": " + strerror(errno)};
+        }
+
+        chunk_queue queue {};
+        queue.bounds = chunk_bounds(contents);
+        size_t chunks = queue.bounds.size() - 1;
+        queue.encrypted.resize(chunks);
+        queue.users.resize(chunks);
+        queue.done.resize(chunks);
+
+        unsigned int workers = max(1u, thread::hardware_concurrency());
+        workers = static_cast<unsigned int>(min<size_t>(workers, max<size_t>(chunks, 1)));
+        queue.window = workers * CHUNKS_AHEAD;
+
+        vector<thread> threads {};
+        for(unsigned int i = 0; i < workers; i++) threads.emplace_back(run_worker, contents, ref(queue));
+
+        // the chunks are written in the order of the file, each as soon as it and every chunk before it is encrypted
+        size_t users = 0;
+        try {
+            for(size_t i = 0; i < chunks; i++) {
+                string encrypted {};
+                {
+                    unique_lock<mutex> guard {queue.lock};
+                    queue.finished.wait(guard, [&]() { return queue.done[i]; });
+
+                    encrypted.swap(queue.encrypted[i]);
+                    users += queue.users[i];
+                    queue.next_write = i + 1;
+                }
+                queue.written.notify_all();
+
+                write_all(out_fd, encrypted);
+            }
+        } catch(runtime_error& e) {
+            // a failed write leaves no chunk for the workers to take, so they finish before the file is unmapped
+            {
+                lock_guard<mutex> guard {queue.lock};
+                queue.next_chunk = chunks;
+            }
+            queue.written.notify_all();
+
+            for(thread& t : threads) t.join();
+            if(mapped != nullptr) munmap(mapped, size);
+            if(out_fd != STDOUT_FILENO) close(out_fd);
+            throw;
+        }
+
+        for(thread& t : threads) t.join();
+        if(mapped != nullptr) munmap(mapped, size);
+
+        if(out_fd != STDOUT_FILENO && close(out_fd) == -1) throw runtime_error {"encrypt_userinfo: " + output + ": " + strerror(errno)};
+        if(!output.empty()) cout<<"Encrypted "<<users<<" users from "<<input<<" to "<<output<<".\n";
+
+        // the index is built from the member file just written, which is still in the page cache
+        if(!index.empty()) {
+            credential_index user_info = credential_index::build(output);
+            user_info.save(index);
+            cout<<"Saved "<<user_info.size()<<" users from "<<output<<" to "<<index<<".\n";
+        }
+
+        return 0;
+
+    } catch(runtime_error& e) {
+        cout<<e.what()<<endl;
+        return 1;
+    }
 }
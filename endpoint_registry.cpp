@@ -0,0 +1,87 @@
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+
+#include "addr_list.h"
+#include "endpoint_registry.h"
+
+using namespace std;
+
+
+// hosts of the ports, read from the environment once per process
+struct host_config {
+    string fallback {"localhost"};
+    unordered_map<int, string> hosts {};
+    string bind {"localhost"};
+};
+
+
+// parse the RESERVATION_HOSTS and RESERVATION_BIND environment variables, ignoring malformed host entries
+static host_config read_host_config() {
+    host_config config {};
+
+    const char* bind = getenv("RESERVATION_BIND");
+    if(bind != nullptr && *bind != 0) config.bind = bind;
+
+    const char* variable = getenv("RESERVATION_HOSTS");
+    if(variable == nullptr) return config;
+
+    string entry;
+    istringstream sstream {variable};
+    while(getline(sstream, entry, ',')) {
+        size_t equals = entry.find('=');
+        if(equals == string::npos || equals + 1 == entry.size()) continue;
+
+        const string port = entry.substr(0, equals);
+        const string host = entry.substr(equals + 1);
+
+        if(port == "*") {
+            config.fallback = host;
+            continue;
+        }
+
+        char* end;
+        long number = strtol(port.c_str(), &end, 10);
+        if(!port.empty() && *end == 0) config.hosts[number] = host;
+    }
+
+    return config;
+}
+
+
+endpoint_registry::endpoint_registry(int stype): socktype {stype}, resolved {} {}
+
+
+const endpoint& endpoint_registry::resolve(int port) {
+    unordered_map<int, endpoint>::const_iterator found = resolved.find(port);
+    if(found != resolved.end()) return found->second;
+
+    address_list addresses {};
+    addresses.populate(socktype, port, host(port));
+
+    // the first address returned by the resolver is kept
+    endpoint peer {};
+    memcpy(&peer.addr, addresses.info->ai_addr, addresses.info->ai_addrlen);
+    peer.addrlen = addresses.info->ai_addrlen;
+
+    return resolved.emplace(port, peer).first->second;
+}
+
+
+// the host configuration, initialized on first use, safely even when several threads get here at once
+static const host_config& config() {
+    static const host_config config = read_host_config();
+    return config;
+}
+
+
+const string& endpoint_registry::host(int port) {
+    unordered_map<int, string>::const_iterator found = config().hosts.find(port);
+    return found == config().hosts.end() ? config().fallback : found->second;
+}
+
+
+const string& endpoint_registry::bind_host() {
+    return config().bind;
+}
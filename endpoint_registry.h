@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <sys/socket.h>
+#include <unordered_map>
+
+// a resolved peer address, ready to be passed to the send system calls
+struct endpoint {
+    sockaddr_storage addr;
+    socklen_t addrlen;
+};
+
+/*
+ * class endpoint_registry resolves the address of each peer port once and caches it,
+ * so sending to a peer never waits on the resolver
+ *
+ * only the fixed ports of the servers are resolved here, replies to a received datagram go back to its sender's address
+ * every port is on localhost, unless the RESERVATION_HOSTS environment variable places it elsewhere
+ * as a comma separated list of port=host entries, where the entry *=host applies to every port not listed
+ * sockets bind localhost, unless the RESERVATION_BIND environment variable names another host, such as 0.0.0.0
+ */
+class endpoint_registry {
+private:
+    // socket type the addresses are resolved for, TCP or UDP
+    int socktype;
+
+    // addresses resolved so far, keyed by port
+    std::unordered_map<int, endpoint> resolved;
+
+public:
+    // constructor
+    explicit endpoint_registry(int socktype);
+
+    // returns the address of the provided port, resolving it on first use
+    const endpoint& resolve(int port);
+
+    // returns the host of the provided port, as configured for the process
+    static const std::string& host(int port);
+
+    // returns the host sockets of the process bind to
+    static const std::string& bind_host();
+};
@@ -0,0 +1,55 @@
+#include <cstring>
+#include <errno.h>
+#include <string>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "event_loop.h"
+
+using namespace std;
+
+event_loop::event_loop(): epfd {epoll_create1(EPOLL_CLOEXEC)} {
+    if(epfd == -1) {
+        throw event_loop_exception {string {"event_loop exception: event_loop: "} + strerror(errno)};
+    }
+}
+
+void event_loop::control(int op, int fd, uint32_t events, const char* caller) {
+    epoll_event ev {};
+    ev.events = events;
+    ev.data.fd = fd;
+
+    if(epoll_ctl(epfd, op, fd, &ev) == -1) {
+        throw event_loop_exception {string {"event_loop exception: "} + caller + ": " + strerror(errno)};
+    }
+}
+
+void event_loop::add(int fd, uint32_t events) {
+    control(EPOLL_CTL_ADD, fd, events, "add");
+}
+
+void event_loop::modify(int fd, uint32_t events) {
+    control(EPOLL_CTL_MOD, fd, events, "modify");
+}
+
+void event_loop::remove(int fd) {
+    control(EPOLL_CTL_DEL, fd, 0, "remove");
+}
+
+int event_loop::wait(epoll_event* events, int timeout_ms) {
+    int ready = epoll_wait(epfd, events, MAXEVENTS, timeout_ms);
+
+    if(ready == -1) {
+        // a signal such as SIGCHLD interrupted the wait
+        if(errno == EINTR) return 0;
+        throw event_loop_exception {string {"event_loop exception: wait: "} + strerror(errno)};
+    }
+
+    return ready;
+}
+
+event_loop::~event_loop() {
+    close(epfd);
+}
+
+event_loop_exception::event_loop_exception(const string& err) : std::runtime_error{err} {}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+
+/*
+ * class event_loop wraps an epoll instance,
+ * notifying the owner of readiness events on registered file descriptors
+ */
+class event_loop {
+private:
+    // epoll file descriptor
+    int epfd;
+
+    // register, update or remove interest in a file descriptor
+    void control(int op, int fd, uint32_t events, const char* caller);
+
+public:
+    // maximum number of events returned by a single wait
+    constexpr static int MAXEVENTS = 64;
+
+    // constructor
+    event_loop();
+
+    // disallow copy operations to maintain unique ownership of the epoll instance
+    event_loop(const event_loop&) = delete;
+    event_loop& operator=(const event_loop&) = delete;
+
+    // start watching a file descriptor for the provided events
+    void add(int fd, uint32_t events);
+
+    // change the events watched on a registered file descriptor
+    void modify(int fd, uint32_t events);
+
+    // stop watching a file descriptor
+    void remove(int fd);
+
+    // wait for events, at most MAXEVENTS are written to the provided array
+    // returns the number of ready events, or 0 on timeout or interruption
+    int wait(epoll_event* events, int timeout_ms = -1);
+
+    // close the epoll instance
+    ~event_loop();
+};
+
+class event_loop_exception : public std::runtime_error {
+public:
+    event_loop_exception(const std::string& err);
+};
@@ -0,0 +1,55 @@
+#include <string>
+
+#include "framing.h"
+
+using namespace std;
+
+
+// write a 32 bit integer in big endian order
+static void put_uint32(string& out, uint32_t n) {
+    for(int i = 3; i >= 0; i--) out += static_cast<char>((n >> (8*i)) & 0xff);
+}
+
+
+// read a 32 bit integer in big endian order
+static uint32_t get_uint32(const string& in, size_t offset) {
+    uint32_t n = 0;
+    for(int i = 0; i < 4; i++) n = (n << 8) | static_cast<unsigned char>(in[offset + i]);
+
+    return n;
+}
+
+
+void framing::encode(string& out, uint8_t type, uint32_t id, string_view payload) {
+    if(payload.size() > MAX_PAYLOAD) throw framing_exception {"framing exception: encode: payload too large"};
+
+    out.reserve(out.size() + HEADER_SIZE + payload.size());
+
+    // the length counts everything after the length field itself
+    put_uint32(out, HEADER_SIZE - 4 + payload.size());
+    out += static_cast<char>(type);
+    put_uint32(out, id);
+    out.append(payload);
+}
+
+
+bool framing::decode(const string& in, size_t& offset, frame& out) {
+    if(in.size() - offset < HEADER_SIZE) return false;
+
+    uint32_t length = get_uint32(in, offset);
+    if(length < HEADER_SIZE - 4 || length - (HEADER_SIZE - 4) > MAX_PAYLOAD) {
+        throw framing_exception {"framing exception: decode: invalid frame length " + to_string(length)};
+    }
+
+    if(in.size() - offset < length + 4) return false;
+
+    out.type = static_cast<uint8_t>(in[offset + 4]);
+    out.id = get_uint32(in, offset + 5);
+    out.payload.assign(in, offset + HEADER_SIZE, length - (HEADER_SIZE - 4));
+
+    offset += length + 4;
+    return true;
+}
+
+
+framing_exception::framing_exception(const string& err) : std::runtime_error{err} {}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/*
+ * struct frame is a single message of the framed client protocol
+ *
+ * on the wire a frame is a 4 byte big endian length of the rest of the frame,
+ * a 1 byte message type, a 4 byte big endian request id, and the payload
+ * since lengths are far below 2^24, a frame always begins with a zero byte,
+ * which tells a framed connection apart from a legacy text connection
+ */
+struct frame {
+    uint8_t type;
+    uint32_t id;
+    std::string payload;
+};
+
+namespace framing {
+    // bytes of the length, type and id fields
+    constexpr size_t HEADER_SIZE = 9;
+
+    // largest payload a frame may carry
+    constexpr uint32_t MAX_PAYLOAD = 1 << 20;
+
+    // append the encoding of a frame to the output buffer
+    void encode(std::string& out, uint8_t type, uint32_t id, std::string_view payload);
+
+    // decode the next complete frame of the input buffer, starting at offset
+    // on success the frame is written to out, offset is moved past it and true is returned
+    // returns false if the buffer does not yet hold a complete frame
+    bool decode(const std::string& in, size_t& offset, frame& out);
+}
+
+class framing_exception : public std::runtime_error {
+public:
+    framing_exception(const std::string& err);
+};
@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <string>
+
+#include "hash_ring.h"
+
+using namespace std;
+
+
+// FNV-1a hash of a string, followed by a finalizer spreading short and similar codes over the whole ring
+static uint64_t ring_hash(string_view key) {
+    uint64_t h = 14695981039346656037ull;
+    for(unsigned char c : key) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+
+    return h;
+}
+
+
+hash_ring::hash_ring(const map<int, char>& backend, bool by_prefix): points {}, prefixes {} {
+    if(by_prefix) {
+        for(const pair<const int, char>& b : backend) prefixes.emplace(b.second, b.first);
+        return;
+    }
+
+    // points are derived from the name rather than the port, so a backend server keeps its rooms if its port changes
+    for(const pair<const int, char>& b : backend) {
+        for(int i = 0; i < VIRTUAL_NODES; i++) {
+            points.emplace_back(ring_hash(string {b.second} + '#' + to_string(i)), b.first);
+        }
+    }
+
+    sort(points.begin(), points.end());
+}
+
+
+int hash_ring::owner(string_view room) const {
+    if(!prefixes.empty()) {
+        map<char, int>::const_iterator named = room.empty() ? prefixes.end() : prefixes.find(room[0]);
+        return named == prefixes.end() ? -1 : named->second;
+    }
+
+    vector<pair<uint64_t, int>>::const_iterator point = lower_bound(points.begin(), points.end(), make_pair(ring_hash(room), 0));
+
+    // the ring wraps around past its last point
+    if(point == points.end()) point = points.begin();
+    return point->second;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * class hash_ring maps room codes to backend servers through consistent hashing
+ *
+ * every backend server is placed on the ring at many points, derived from its name,
+ * and a room belongs to the backend server of the first point at or after the hash of its code,
+ * so adding or removing a backend server only moves the rooms of the ranges next to its points
+ *
+ * a ring routing by prefix places no points, and maps a room to the backend server named by the first character of its code,
+ * as the default setup does without a topology file
+ */
+class hash_ring {
+private:
+    // points on the ring along with the port of their backend server, sorted by position
+    std::vector<std::pair<uint64_t, int>> points;
+
+    // ports of the backend servers keyed by their names, when routing by prefix
+    std::map<char, int> prefixes;
+
+public:
+    // points placed on the ring for each backend server, evening out the share of rooms each one gets
+    constexpr static int VIRTUAL_NODES = 128;
+
+    // place the provided backend servers, mapping their port to their names, on the ring
+    // or route by the first character of room codes instead, with by_prefix
+    explicit hash_ring(const std::map<int, char>& backend, bool by_prefix = false);
+
+    // returns the port of the backend server owning the room
+    // returns -1 when routing by prefix and no backend server is named by the first character of the room
+    int owner(std::string_view room) const;
+};
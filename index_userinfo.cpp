@@ -0,0 +1,31 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "credential_index.h"
+#include "encrypt.h"
+
+using namespace std;
+
+// build the index of an encrypted member file, which the main server maps at startup instead of reading the file
+// the index is written beside the file by default, such as member.idx for member.txt
+int main(int argc, char* argv[]) {
+    if(argc > 3) {
+        cout<<"usage: index_userinfo [member file] [index file]\n";
+        return 1;
+    }
+
+    const string filename = argc > 1 ? argv[1] : user_filename;
+    const string index = argc == 3 ? argv[2] : filename.substr(0, filename.rfind('.')) + ".idx";
+
+    try {
+        credential_index user_info = credential_index::build(filename);
+
+        user_info.save(index);
+        cout<<"Saved "<<user_info.size()<<" users from "<<filename<<" to "<<index<<".\n";
+        return 0;
+
+    } catch(runtime_error& e) {
+        cout<<e.what()<<endl;
+        return 1;
+    }
+}
@@ -0,0 +1,507 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+#include "client_protocol.h"
+#include "constants.h"
+#include "event_loop.h"
+#include "socket.h"
+#include "stats.h"
+
+using namespace std;
+using namespace socket_constants;
+
+// positions of the stages within the stats registry of the load generator
+constexpr size_t AUTHENTICATION_STAGE = 0;
+constexpr size_t AVAILABILITY_STAGE = 1;
+constexpr size_t RESERVATION_STAGE = 2;
+
+// positions of the counters within the stats registry of the load generator
+// response codes are counted from RESPONSE_COUNTERS on, by the value of the code
+constexpr size_t FAILED_AUTHENTICATION_COUNTER = 0;
+constexpr size_t CLOSED_CONNECTION_COUNTER = 1;
+constexpr size_t UNKNOWN_RESPONSE_COUNTER = 2;
+constexpr size_t RESPONSE_COUNTERS = 3;
+
+// longest time responses still outstanding at the end of a run are waited for, so their latencies are recorded
+constexpr chrono::seconds DRAIN_TIMEOUT {5};
+
+// sessions connecting and authenticating at once, kept below the listen backlog of the main server,
+// as a connection beyond the backlog is dropped and only attempted again a second or more later
+constexpr size_t MAX_CONNECTING = 8;
+
+// longest time a single wait for events blocks, so the end of a run is noticed
+constexpr int WAIT_TIMEOUT_MS = 100;
+
+const string usage {"usage: loadgen [sessions=N] [duration=SECONDS] [rate=REQUESTS_PER_SECOND] [members=FRACTION] "
+                    "[reservations=FRACTION] [hot=FRACTION] [hot_rooms=N] [rooms=FILE,...] [users=FILE] [seed=N]"};
+
+
+struct load_options {
+    // concurrent sessions, each with a connection of its own
+    size_t sessions {1000};
+
+    // seconds requests are sent for once every session is authenticated
+    double duration {10};
+
+    // requests started per second, spread evenly over the run, or 0 for each session to send its next request
+    // as soon as its last one is answered
+    double rate {0};
+
+    // fraction of the sessions authenticating as members, the others authenticate as guests
+    double members {0.5};
+
+    // fraction of the requests that are reservations, the others are availability requests
+    double reservations {0.2};
+
+    // fraction of the requests for one of the hot rooms, the others pick any other room
+    double hot {0.9};
+    size_t hot_rooms {16};
+
+    // room status files the rooms are read from, and the unencrypted credentials of the members
+    vector<string> room_files {"single.txt", "double.txt", "suite.txt"};
+    string users {"member_unencrypted.txt"};
+
+    uint64_t seed {1};
+};
+
+
+enum class load_state { authenticating, idle, waiting, closed };
+
+struct load_session {
+    Socket sock;
+    load_state state {load_state::authenticating};
+
+    // stage of the request awaiting a response, and the time it was meant to start
+    size_t stage {AUTHENTICATION_STAGE};
+    chrono::steady_clock::time_point started {chrono::steady_clock::now()};
+};
+
+
+class load_exception : public runtime_error {
+public:
+    load_exception(const string& err) : runtime_error{err} {}
+};
+
+
+// parse arguments of the form name=value, leaving the defaults of the names absent
+load_options parse_options(int argc, char* argv[]) {
+    load_options options {};
+
+    for(int i = 1; i < argc; i++) {
+        string arg {argv[i]};
+        size_t eq = arg.find('=');
+        if(eq == string::npos) throw load_exception {usage};
+
+        string name = arg.substr(0, eq), value = arg.substr(eq + 1);
+        try {
+            if(name == "sessions") options.sessions = stoull(value);
+            else if(name == "duration") options.duration = stod(value);
+            else if(name == "rate") options.rate = stod(value);
+            else if(name == "members") options.members = stod(value);
+            else if(name == "reservations") options.reservations = stod(value);
+            else if(name == "hot") options.hot = stod(value);
+            else if(name == "hot_rooms") options.hot_rooms = stoull(value);
+            else if(name == "users") options.users = value;
+            else if(name == "seed") options.seed = stoull(value);
+            else if(name == "rooms") {
+                options.room_files.clear();
+                istringstream files {value};
+                for(string file; getline(files, file, ',');) options.room_files.push_back(file);
+            }
+            else throw load_exception {usage};
+        } catch(logic_error&) {
+            throw load_exception {usage};
+        }
+    }
+
+    if(options.sessions == 0 || options.duration <= 0 || options.rate < 0) throw load_exception {usage};
+    return options;
+}
+
+
+// read the room codes of the room status files, the code being the text before the comma of each line
+vector<string> read_rooms(const vector<string>& files) {
+    vector<string> rooms {};
+    for(const string& filename : files) {
+        ifstream f {filename};
+        if(!f) throw load_exception {"Failed to read room status file " + filename};
+
+        for(string line; getline(f, line);) {
+            string code = line.substr(0, line.find(','));
+            if(!code.empty()) rooms.push_back(code);
+        }
+    }
+
+    if(rooms.empty()) throw load_exception {"The room status files hold no rooms."};
+    return rooms;
+}
+
+
+// read the usernames and passwords of an unencrypted member file, separated by a comma and a space
+// lines end with a carriage return and a newline, as the member files the encrypted ones are made from do
+vector<pair<string, string>> read_users(const string& filename) {
+    ifstream f {filename};
+    if(!f) throw load_exception {"Failed to read member file " + filename};
+
+    vector<pair<string, string>> users {};
+    for(string line; getline(f, line);) {
+        if(!line.empty() && line.back() == '\r') line.pop_back();
+
+        size_t comma = line.find(", ");
+        if(comma != string::npos) users.emplace_back(line.substr(0, comma), line.substr(comma + 2));
+    }
+
+    return users;
+}
+
+
+// thousands of connections need more file descriptors than a process is usually allowed by default
+void raise_descriptor_limit(size_t sessions) {
+    rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == -1) return;
+
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    if(limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < sessions + 16) {
+        cout<<"Only "<<limit.rlim_cur<<" file descriptors are allowed, some sessions may fail to connect.\n";
+    }
+}
+
+
+// allocate the counters and stage histograms of the load generator, named in the order of their positions
+stats_registry make_stats() {
+    vector<string> counters {"failed_authentications_total", "closed_connections_total", "unknown_responses_total"};
+    for(const char* code : RESPONSE_CODE_NAMES) counters.push_back(string {"responses_total{code=\""} + code + "\"}");
+
+    return stats_registry {"loadgen", counters, {"authentication", "availability", "reservation"}};
+}
+
+
+/*
+ * class load_generator drives many sessions against the main server through a single epoll loop,
+ * each session sending one request at a time over the legacy client protocol
+ *
+ * in closed loop mode every session sends its next request as soon as the last one is answered,
+ * measuring the throughput the servers sustain at that concurrency
+ * in open loop mode requests start at a fixed rate whether or not the servers keep up,
+ * a request waiting for an idle session is timed from when it was meant to start,
+ * so a server falling behind shows in the latencies rather than slowing the arrivals
+ */
+class load_generator {
+private:
+    const load_options& options;
+    const vector<string>& rooms;
+    stats_registry& stats;
+
+    event_loop loop {};
+    vector<load_session> sessions {};
+
+    // session of each file descriptor
+    vector<size_t> session_of {};
+
+    mt19937_64 random;
+
+    // sessions without a request to answer, and open loop requests without an idle session to send them
+    vector<size_t> idle {};
+    deque<chrono::steady_clock::time_point> arrivals {};
+    size_t most_arrivals {0};
+
+    // whether new requests may still start, and how many were answered while they could
+    bool running {false};
+    size_t completed {0};
+
+    // sessions waiting for a response, and for their authentication result
+    size_t outstanding {0};
+    size_t authenticating {0};
+
+    // pick a request according to the mix, and send it through an idle session
+    void send_request(size_t index, chrono::steady_clock::time_point started) {
+        load_session& s = sessions[index];
+
+        uniform_real_distribution<double> fraction {0, 1};
+        bool reservation = fraction(random) < options.reservations;
+
+        // the hot rooms are the first of the rooms, the cold ones the rest
+        size_t hot_rooms = min(options.hot_rooms, rooms.size());
+        bool hot = hot_rooms == rooms.size() || (hot_rooms > 0 && fraction(random) < options.hot);
+        size_t room = hot ? uniform_int_distribution<size_t> {0, hot_rooms - 1}(random)
+                          : uniform_int_distribution<size_t> {hot_rooms, rooms.size() - 1}(random);
+
+        send_message(s, reservation ? reservation_message(rooms[room]) : availability_message(rooms[room]));
+        s.state = load_state::waiting;
+        s.stage = reservation ? RESERVATION_STAGE : AVAILABILITY_STAGE;
+        s.started = started;
+        outstanding++;
+    }
+
+    // a message is a handful of bytes sent on a connection with nothing else queued, so it is sent whole
+    void send_message(load_session& s, const string& msg) {
+        if(s.sock.try_send_info(msg.data(), msg.size()) != msg.size()) {
+            throw load_exception {"The load generator failed to send a whole message."};
+        }
+    }
+
+    // hand a session that has nothing left to wait for its next request
+    void ready(size_t index) {
+        load_session& s = sessions[index];
+        s.state = load_state::idle;
+        if(!running) return;
+
+        if(options.rate == 0) {
+            send_request(index, chrono::steady_clock::now());
+        } else if(!arrivals.empty()) {
+            send_request(index, arrivals.front());
+            arrivals.pop_front();
+        } else {
+            idle.push_back(index);
+        }
+    }
+
+    void close(size_t index) {
+        load_session& s = sessions[index];
+        if(s.state == load_state::waiting) outstanding--;
+        if(s.state == load_state::authenticating) authenticating--;
+
+        loop.remove(s.sock.descriptor());
+        s.sock.close_socket();
+        s.state = load_state::closed;
+        stats.count(CLOSED_CONNECTION_COUNTER);
+    }
+
+    // receive the response of a session and record its latency
+    void receive(size_t index) {
+        load_session& s = sessions[index];
+
+        optional<string> result = s.sock.try_recv_info();
+        if(!result) return;
+
+        if(*result == CLOSED_CONNECTION) {
+            close(index);
+            return;
+        }
+
+        stats.record_since(s.stage, s.started);
+
+        if(s.state == load_state::authenticating) {
+            if(!authenticated(*result)) {
+                stats.count(FAILED_AUTHENTICATION_COUNTER);
+                close(index);
+                return;
+            }
+
+            authenticating--;
+            ready(index);
+            return;
+        }
+
+        outstanding--;
+        if(running) completed++;
+
+        size_t value = (*result)[0] - '0';
+        if(result->size() == 1 && value < size(RESPONSE_CODE_NAMES)) stats.count(RESPONSE_COUNTERS + value);
+        else stats.count(UNKNOWN_RESPONSE_COUNTER);
+
+        ready(index);
+    }
+
+    // wait for events until the provided time, handling the responses received
+    void poll(chrono::steady_clock::time_point until) {
+        chrono::steady_clock::duration left = until - chrono::steady_clock::now();
+        int timeout_ms = static_cast<int>(clamp<long long>(chrono::ceil<chrono::milliseconds>(left).count(), 0, WAIT_TIMEOUT_MS));
+
+        epoll_event events[event_loop::MAXEVENTS];
+        int n = loop.wait(events, timeout_ms);
+        for(int i = 0; i < n; i++) receive(session_of[events[i].data.fd]);
+    }
+
+public:
+    load_generator(const load_options& o, const vector<string>& r, stats_registry& st):
+        options {o}, rooms {r}, stats {st}, random {o.seed} {}
+
+    // connect every session and authenticate it, returning the number authenticated
+    size_t authenticate(const vector<pair<string, string>>& users) {
+        sessions.reserve(options.sessions);
+
+        size_t members = static_cast<size_t>(options.sessions * options.members + 0.5);
+        if(members > 0 && users.empty()) throw load_exception {"The member file holds no members to authenticate."};
+
+        chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + DRAIN_TIMEOUT;
+        for(size_t i = 0, member_count = 0; i < options.sessions; i++) {
+            while(authenticating >= MAX_CONNECTING && chrono::steady_clock::now() < deadline) poll(deadline);
+            if(authenticating >= MAX_CONNECTING) break;
+            deadline = chrono::steady_clock::now() + DRAIN_TIMEOUT;
+
+            Socket sock {-1, SOCK_STREAM};
+            sock.connect_socket(serverM_client);
+            sock.set_nonblocking();
+
+            int fd = sock.descriptor();
+            if(session_of.size() <= static_cast<size_t>(fd)) session_of.resize(fd + 1);
+            session_of[fd] = sessions.size();
+
+            loop.add(fd, EPOLLIN);
+            sessions.push_back(load_session {std::move(sock)});
+
+            // members are spread over the sessions rather than all coming first
+            bool member = i * members / options.sessions != (i + 1) * members / options.sessions;
+            const pair<string, string>* user = member ? &users[member_count++ % users.size()] : nullptr;
+            send_message(sessions.back(), user ? authentication_message(user->first, user->second) : authentication_message("guest" + to_string(i), ""));
+            sessions.back().started = chrono::steady_clock::now();
+            authenticating++;
+        }
+
+        // every session is answered or given up on before requests start
+        while(authenticating > 0 && chrono::steady_clock::now() < deadline) poll(deadline);
+
+        size_t ready_sessions = 0;
+        for(size_t i = 0; i < sessions.size(); i++) {
+            if(sessions[i].state == load_state::idle) {
+                idle.push_back(i);
+                ready_sessions++;
+            }
+        }
+
+        return ready_sessions;
+    }
+
+    // send requests for the duration of the run, returning the number answered within it
+    size_t run() {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        chrono::steady_clock::time_point end = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double> {options.duration});
+        running = true;
+
+        // in closed loop mode every session starts at once, in open loop mode requests start on schedule
+        if(options.rate == 0) {
+            for(size_t index : idle) send_request(index, start);
+            idle.clear();
+        }
+
+        chrono::steady_clock::duration interval = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double> {options.rate > 0 ? 1 / options.rate : 0});
+        chrono::steady_clock::time_point next_arrival = start;
+
+        while(true) {
+            chrono::steady_clock::time_point now = chrono::steady_clock::now();
+            if(now >= end) break;
+
+            if(options.rate > 0) {
+                while(next_arrival <= now && next_arrival < end) {
+                    if(!idle.empty()) {
+                        size_t index = idle.back();
+                        idle.pop_back();
+                        send_request(index, next_arrival);
+                    } else {
+                        arrivals.push_back(next_arrival);
+                        most_arrivals = max(most_arrivals, arrivals.size());
+                    }
+                    next_arrival += interval;
+                }
+            }
+
+            poll(options.rate > 0 ? min(next_arrival, end) : end);
+        }
+
+        running = false;
+
+        // responses still outstanding are waited for, so the slowest requests are not left out of the latencies
+        chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + DRAIN_TIMEOUT;
+        while(outstanding > 0 && chrono::steady_clock::now() < deadline) poll(deadline);
+
+        return completed;
+    }
+
+    // requests that were due but never sent, as no session was idle
+    size_t unsent() const {
+        return arrivals.size();
+    }
+
+    // most requests that waited for an idle session at once
+    size_t most_waiting() const {
+        return most_arrivals;
+    }
+
+    size_t still_outstanding() const {
+        return outstanding;
+    }
+};
+
+
+// print the count and latency quantiles of a stage, in milliseconds
+void report_stage(const stats_registry& stats, const char* name, size_t stage) {
+    auto ms = [&](double q) { return chrono::duration<double, milli> {stats.quantile(stage, q)}.count(); };
+    printf("%-16s %10llu %10.3f %10.3f %10.3f %10.3f\n", name, static_cast<unsigned long long>(stats.recorded(stage)),
+           ms(0.5), ms(0.99), ms(0.999), ms(1));
+}
+
+
+// drive concurrent sessions against the main server and report the throughput and latencies reached
+// usage: loadgen [name=value...], run from the directory holding the room status and member files
+int main(int argc, char* argv[]) {
+    try {
+        load_options options = parse_options(argc, argv);
+
+        vector<string> rooms = read_rooms(options.room_files);
+        vector<pair<string, string>> users {};
+        if(options.members > 0) users = read_users(options.users);
+
+        raise_descriptor_limit(options.sessions);
+
+        stats_registry stats = make_stats();
+        load_generator generator {options, rooms, stats};
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        size_t ready = generator.authenticate(users);
+        double auth_seconds = chrono::duration<double> {chrono::steady_clock::now() - start}.count();
+
+        printf("%zu of %zu sessions authenticated in %.2f s\n", ready, options.sessions, auth_seconds);
+        if(ready == 0) return 1;
+
+        if(options.rate == 0) printf("closed loop over %zu sessions for %.1f s\n", ready, options.duration);
+        else printf("open loop at %.0f requests/s over %zu sessions for %.1f s\n", options.rate, ready, options.duration);
+
+        size_t completed = generator.run();
+
+        printf("%zu requests answered, %.1f requests/s\n", completed, completed / options.duration);
+        if(options.rate > 0) {
+            printf("%zu requests never sent for lack of an idle session, at most %zu waited at once\n", generator.unsent(), generator.most_waiting());
+        }
+        if(generator.still_outstanding() > 0) printf("%zu requests were never answered\n", generator.still_outstanding());
+
+        printf("\n%-16s %10s %10s %10s %10s %10s\n", "stage", "count", "p50 ms", "p99 ms", "p999 ms", "max ms");
+        report_stage(stats, "authentication", AUTHENTICATION_STAGE);
+        report_stage(stats, "availability", AVAILABILITY_STAGE);
+        report_stage(stats, "reservation", RESERVATION_STAGE);
+
+        printf("\n");
+        for(size_t i = 0; i < size(RESPONSE_CODE_NAMES); i++) {
+            if(stats.counted(RESPONSE_COUNTERS + i) > 0) printf("%-20s %10llu\n", RESPONSE_CODE_NAMES[i], static_cast<unsigned long long>(stats.counted(RESPONSE_COUNTERS + i)));
+        }
+        printf("%-20s %10llu\n", "failed_logins", static_cast<unsigned long long>(stats.counted(FAILED_AUTHENTICATION_COUNTER)));
+        printf("%-20s %10llu\n", "closed_connections", static_cast<unsigned long long>(stats.counted(CLOSED_CONNECTION_COUNTER)));
+        printf("%-20s %10llu\n", "unknown_responses", static_cast<unsigned long long>(stats.counted(UNKNOWN_RESPONSE_COUNTER)));
+
+        return 0;
+
+    } catch(load_exception& le) {
+        cout<<le.what()<<endl;
+        return 1;
+    } catch(socket_exception& se) {
+        cout<<se.what()<<endl;
+        return 1;
+    } catch(event_loop_exception& ee) {
+        cout<<ee.what()<<endl;
+        return 1;
+    } catch(stats_exception& se) {
+        cout<<se.what()<<endl;
+        return 1;
+    }
+}
@@ -0,0 +1,457 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <memory>
+#include <mutex>
+#include <pthread.h>
+#include <signal.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "logger.h"
+
+using namespace std;
+
+
+// bytes of the ring buffer of each thread
+constexpr size_t RING_SIZE = 1 << 20;
+
+// records start at multiples of this size, so a record header never wraps around the end of a ring buffer
+constexpr size_t RECORD_ALIGNMENT = 16;
+
+// level of a record filling the end of a ring buffer that the next record did not fit in
+constexpr uint8_t PADDING_RECORD = 0xff;
+
+// time the flusher waits after writing, letting lines gather so they are written together
+constexpr chrono::milliseconds FLUSH_INTERVAL {1};
+
+// longest time the flusher sleeps without looking at the ring buffers
+constexpr chrono::milliseconds IDLE_INTERVAL {100};
+
+// longest time logging::flush waits for the flusher
+constexpr chrono::milliseconds FLUSH_TIMEOUT {1000};
+
+
+// a record is a header followed by the text of its line
+struct record_header {
+    // bytes of the record including its header and alignment
+    uint32_t size;
+
+    uint16_t length;
+    uint8_t level;
+    uint8_t reserved;
+
+    // wall clock time the line was logged, in nanoseconds
+    int64_t time;
+};
+
+static_assert(sizeof(record_header) == RECORD_ALIGNMENT, "record headers must keep records aligned");
+static_assert(LOG_LINE_SIZE <= UINT16_MAX, "log lines must fit the length of a record");
+
+
+// a ring buffer written by a single thread and read by the flusher only
+struct log_ring {
+    unique_ptr<char[]> data {new char[RING_SIZE]};
+
+    // number of the thread within the process, in the order threads first logged
+    unsigned int thread;
+
+    // position of the next record to read, along with the writer's copy of it
+    alignas(64) atomic<uint64_t> head {0};
+    uint64_t cached_head {0};
+
+    // position of the next record to write
+    alignas(64) atomic<uint64_t> tail {0};
+
+    // lines skipped because the ring buffer was full
+    atomic<uint64_t> dropped {0};
+
+    // whether the thread has exited, so the ring buffer is forgotten once read
+    atomic<bool> retired {false};
+
+    explicit log_ring(unsigned int t): thread {t} {}
+};
+
+
+// the ring buffers of every thread, and the flusher writing them out
+struct logger_state {
+    log_level level {log_level::info};
+    bool json {false};
+
+    // guards the ring buffers and the flusher
+    mutex lock;
+    unique_ptr<condition_variable> wakeup {new condition_variable {}};
+
+    vector<shared_ptr<log_ring>> rings {};
+    unsigned int next_thread {0};
+
+    thread* flusher {nullptr};
+    atomic<bool> running {false};
+    bool stopping {false};
+
+    // whether the flusher is waiting for lines, and needs to be woken up
+    atomic<bool> sleeping {false};
+
+    // rounds the flusher has written, each reading every ring buffer, signalled after every round
+    uint64_t rounds {0};
+    unique_ptr<condition_variable> flushed {new condition_variable {}};
+
+    logger_state();
+    ~logger_state();
+};
+
+
+static logger_state& state() {
+    static logger_state s {};
+    return s;
+}
+
+
+// the ring buffer of a thread, marked retired as the thread exits
+struct ring_holder {
+    shared_ptr<log_ring> ring {};
+
+    ~ring_holder() {
+        if(ring) ring->retired.store(true, memory_order_release);
+    }
+};
+
+static thread_local ring_holder local {};
+
+
+// returns the level named by the provided string, or the default level if the name is unknown
+static log_level parse_level(const char* name) {
+    if(name == nullptr) return log_level::info;
+
+    string level {name};
+    if(level == "debug") return log_level::debug;
+    if(level == "warning") return log_level::warning;
+    if(level == "error") return log_level::error;
+
+    return log_level::info;
+}
+
+
+static const char* level_name(uint8_t level) {
+    switch(static_cast<log_level>(level)) {
+        case log_level::debug: return "debug";
+        case log_level::info: return "info";
+        case log_level::warning: return "warning";
+        default: return "error";
+    }
+}
+
+
+// append a line to the output, as is or as a JSON object
+static void format_line(string& out, bool json, uint8_t level, int64_t time, unsigned int thread, string_view text) {
+    if(!json) {
+        out += text;
+        out += '\n';
+        return;
+    }
+
+    out += "{\"time\":";
+    out += to_string(time);
+    out += ",\"level\":\"";
+    out += level_name(level);
+    out += "\",\"thread\":";
+    out += to_string(thread);
+    out += ",\"message\":\"";
+
+    for(unsigned char c : text) {
+        if(c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if(c < 0x20) {
+            constexpr char digits[] = "0123456789abcdef";
+            out += "\\u00";
+            out += digits[c >> 4];
+            out += digits[c & 0xf];
+        } else {
+            out += c;
+        }
+    }
+
+    out += "\"}\n";
+}
+
+
+// read every record of a ring buffer into the output, returning whether any was read
+static bool drain(log_ring& ring, string& out, bool json) {
+    uint64_t h = ring.head.load(memory_order_relaxed);
+    uint64_t t = ring.tail.load(memory_order_acquire);
+    if(h == t) return false;
+
+    while(h != t) {
+        record_header header;
+        const char* record = ring.data.get() + (h & (RING_SIZE - 1));
+        memcpy(&header, record, sizeof(header));
+
+        if(header.level != PADDING_RECORD) {
+            format_line(out, json, header.level, header.time, ring.thread, {record + sizeof(header), header.length});
+        }
+
+        h += header.size;
+    }
+
+    ring.head.store(h, memory_order_release);
+    return true;
+}
+
+
+// write the whole output, giving up on an output that fails
+static void write_out(const string& out) {
+    size_t written = 0;
+    while(written < out.size()) {
+        ssize_t n = write(STDOUT_FILENO, out.data() + written, out.size() - written);
+
+        if(n == -1 && errno == EINTR) continue;
+        if(n <= 0) return;
+
+        written += n;
+    }
+}
+
+
+// the flusher writes the lines of every ring buffer until the logger stops
+static void flush_lines() {
+    logger_state& s = state();
+    string out {};
+    vector<shared_ptr<log_ring>> rings {};
+
+    while(true) {
+        bool stopping;
+        {
+            lock_guard<mutex> guard {s.lock};
+            rings = s.rings;
+            stopping = s.stopping;
+        }
+
+        bool read = false;
+        uint64_t dropped = 0;
+        for(shared_ptr<log_ring>& r : rings) {
+            read |= drain(*r, out, s.json);
+            dropped += r->dropped.exchange(0, memory_order_relaxed);
+        }
+
+        if(dropped > 0) {
+            int64_t time = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+            format_line(out, s.json, static_cast<uint8_t>(log_level::warning), time, 0, "The logger dropped " + to_string(dropped) + " lines.");
+        }
+
+        if(!out.empty()) {
+            write_out(out);
+            out.clear();
+        }
+
+        // ring buffers of exited threads are forgotten once empty, checked again after a last read
+        {
+            lock_guard<mutex> guard {s.lock};
+            s.rings.erase(remove_if(s.rings.begin(), s.rings.end(), [](const shared_ptr<log_ring>& r) {
+                return r->retired.load(memory_order_acquire) && r->head.load(memory_order_relaxed) == r->tail.load(memory_order_acquire);
+            }), s.rings.end());
+
+            s.rounds++;
+        }
+        s.flushed->notify_all();
+
+        if(read) {
+            this_thread::sleep_for(FLUSH_INTERVAL);
+            continue;
+        }
+
+        if(stopping) return;
+
+        // sleep until a line is logged, announcing it before looking at the ring buffers one last time,
+        // so a writer either sees the flusher sleeping or its line is seen by the flusher
+        unique_lock<mutex> guard {s.lock};
+        s.sleeping.store(true, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        bool pending = s.stopping || any_of(s.rings.begin(), s.rings.end(), [](const shared_ptr<log_ring>& r) {
+            return r->head.load(memory_order_relaxed) != r->tail.load(memory_order_relaxed);
+        });
+        if(!pending) s.wakeup->wait_for(guard, IDLE_INTERVAL);
+
+        s.sleeping.store(false, memory_order_relaxed);
+    }
+}
+
+
+// start the flusher of the process, unless it is already running
+static void start_flusher(logger_state& s) {
+    lock_guard<mutex> guard {s.lock};
+    if(s.running.load(memory_order_relaxed)) return;
+
+    // the flusher starts with every signal blocked, so signals such as SIGCHLD reach the threads waiting for them
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    s.flusher = new thread {flush_lines};
+    pthread_sigmask(SIG_SETMASK, &saved, nullptr);
+
+    s.running.store(true, memory_order_release);
+}
+
+
+// the ring buffer of the calling thread, created as the thread first logs
+static log_ring& local_ring(logger_state& s) {
+    if(!local.ring) {
+        lock_guard<mutex> guard {s.lock};
+        local.ring = make_shared<log_ring>(s.next_thread++);
+        s.rings.push_back(local.ring);
+    }
+
+    return *local.ring;
+}
+
+
+// copy a line into the ring buffer of the calling thread
+// a line of a level below warning is dropped if the ring buffer is full, others wait for the flusher to make room
+static void push(log_level level, const char* text, size_t length) {
+    logger_state& s = state();
+    if(!s.running.load(memory_order_acquire)) start_flusher(s);
+
+    log_ring& ring = local_ring(s);
+
+    size_t size = (sizeof(record_header) + length + RECORD_ALIGNMENT - 1) / RECORD_ALIGNMENT * RECORD_ALIGNMENT;
+    uint64_t t = ring.tail.load(memory_order_relaxed);
+    size_t offset = t & (RING_SIZE - 1);
+
+    // a record never wraps around, the end of the ring buffer is skipped if the record does not fit there
+    size_t skipped = size <= RING_SIZE - offset ? 0 : RING_SIZE - offset;
+
+    while(RING_SIZE - (t - ring.cached_head) < skipped + size) {
+        ring.cached_head = ring.head.load(memory_order_acquire);
+        if(RING_SIZE - (t - ring.cached_head) >= skipped + size) break;
+
+        if(level < log_level::warning) {
+            ring.dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+
+        if(s.sleeping.load(memory_order_relaxed)) {
+            lock_guard<mutex> guard {s.lock};
+            s.wakeup->notify_one();
+        }
+        this_thread::yield();
+    }
+
+    if(skipped > 0) {
+        record_header padding {static_cast<uint32_t>(skipped), 0, PADDING_RECORD, 0, 0};
+        memcpy(ring.data.get() + offset, &padding, sizeof(padding));
+        offset = 0;
+    }
+
+    int64_t time = chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    record_header header {static_cast<uint32_t>(size), static_cast<uint16_t>(length), static_cast<uint8_t>(level), 0, time};
+    memcpy(ring.data.get() + offset, &header, sizeof(header));
+    memcpy(ring.data.get() + offset + sizeof(header), text, length);
+
+    ring.tail.store(t + skipped + size, memory_order_release);
+
+    // pairs with the fence of the flusher going to sleep
+    atomic_thread_fence(memory_order_seq_cst);
+    if(s.sleeping.load(memory_order_relaxed)) {
+        lock_guard<mutex> guard {s.lock};
+        s.wakeup->notify_one();
+    }
+}
+
+
+// a forked child starts without the flusher and the other threads of its parent,
+// and leaves the lines its parent logged before the fork for the parent to write
+static void fork_prepare() {
+    state().lock.lock();
+}
+
+static void fork_parent() {
+    state().lock.unlock();
+}
+
+static void fork_child() {
+    logger_state& s = state();
+
+    // the flusher and the condition it waited on belong to the parent
+    s.flusher = nullptr;
+    s.wakeup.release();
+    s.wakeup.reset(new condition_variable {});
+    s.flushed.release();
+    s.flushed.reset(new condition_variable {});
+    s.running.store(false, memory_order_relaxed);
+    s.sleeping.store(false, memory_order_relaxed);
+
+    s.rings.clear();
+    s.next_thread = 0;
+    if(local.ring) {
+        local.ring->head.store(local.ring->tail.load(memory_order_relaxed), memory_order_relaxed);
+        local.ring->cached_head = local.ring->tail.load(memory_order_relaxed);
+        local.ring->thread = s.next_thread++;
+        s.rings.push_back(local.ring);
+    }
+
+    s.lock.unlock();
+}
+
+
+logger_state::logger_state() {
+    level = parse_level(getenv("LOG_LEVEL"));
+
+    const char* format = getenv("LOG_FORMAT");
+    json = format != nullptr && string {format} == "json";
+
+    pthread_atfork(fork_prepare, fork_parent, fork_child);
+}
+
+
+logger_state::~logger_state() {
+    {
+        lock_guard<mutex> guard {lock};
+        stopping = true;
+        wakeup->notify_one();
+    }
+
+    // the flusher writes whatever is left before returning
+    if(flusher != nullptr) {
+        flusher->join();
+        delete flusher;
+    }
+}
+
+
+log_line::log_line(log_level l): level {l}, enabled {logging::enabled(l)} {}
+
+
+void log_line::append(const char* data, size_t size) {
+    size_t n = min(size, LOG_LINE_SIZE - length);
+    memcpy(text + length, data, n);
+    length += n;
+}
+
+
+log_line::~log_line() {
+    if(enabled) push(level, text, length);
+}
+
+
+bool logging::enabled(log_level level) {
+    return level >= state().level;
+}
+
+
+void logging::flush() {
+    logger_state& s = state();
+    if(!s.running.load(memory_order_acquire)) return;
+
+    // the round under way may have read the ring buffers before the lines were logged, the round after it has not
+    unique_lock<mutex> guard {s.lock};
+    uint64_t target = s.rounds + 2;
+    s.wakeup->notify_one();
+    s.flushed->wait_for(guard, FLUSH_TIMEOUT, [&]() { return s.rounds >= target; });
+}
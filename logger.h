@@ -0,0 +1,82 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+// severity of a log line, lines below the level set by the LOG_LEVEL environment variable are skipped
+enum class log_level : uint8_t { debug, info, warning, error };
+
+// longest log line kept, longer lines are cut short
+constexpr size_t LOG_LINE_SIZE = 1024;
+
+/*
+ * class log_line builds a single log line in place, and hands it to the logger once complete
+ *
+ * the logger copies the line into a ring buffer owned by the calling thread, and a background thread
+ * writes the lines of every ring buffer to the standard output, so logging never waits on the output
+ * lines are written as they are, or as JSON objects with their time, level and thread when LOG_FORMAT is json
+ *
+ * a line of a level that is not logged formats nothing
+ */
+class log_line {
+private:
+    log_level level;
+    bool enabled;
+
+    size_t length {0};
+    char text[LOG_LINE_SIZE];
+
+    // append characters, cutting the line short once full
+    void append(const char* data, size_t size);
+
+public:
+    explicit log_line(log_level level);
+
+    // disallow copy operations, a line is logged once
+    log_line(const log_line&) = delete;
+    log_line& operator=(const log_line&) = delete;
+
+    log_line& operator<<(std::string_view s) {
+        if(enabled) append(s.data(), s.size());
+        return *this;
+    }
+
+    log_line& operator<<(const char* s) {
+        return *this<<std::string_view {s};
+    }
+
+    log_line& operator<<(char c) {
+        if(enabled) append(&c, 1);
+        return *this;
+    }
+
+    template <typename Integer, typename = std::enable_if_t<std::is_integral_v<Integer> && !std::is_same_v<Integer, bool>>>
+    log_line& operator<<(Integer n) {
+        if(enabled) {
+            char digits[24];
+            std::to_chars_result r = std::to_chars(digits, digits + sizeof(digits), n);
+            append(digits, r.ptr - digits);
+        }
+        return *this;
+    }
+
+    // hand the line to the logger
+    ~log_line();
+};
+
+namespace logging {
+    // returns whether lines of the level are logged
+    bool enabled(log_level level);
+
+    // wait until the lines logged so far are written, such as before the process exits without unwinding
+    void flush();
+
+    // start a line of the corresponding level
+    inline log_line debug() { return log_line {log_level::debug}; }
+    inline log_line info() { return log_line {log_level::info}; }
+    inline log_line warning() { return log_line {log_level::warning}; }
+    inline log_line error() { return log_line {log_level::error}; }
+}
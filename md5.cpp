@@ -0,0 +1,230 @@
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "md5.h"
+#include "md5_rounds.h"
+
+#ifdef MD5_X86_KERNELS
+#include "md5_lanes.h"
+#endif
+
+using namespace std;
+
+// two hexadecimal characters for every byte, so a digest is encoded a byte at a time without branches
+struct hex_table {
+    char pairs[512];
+
+    constexpr hex_table(): pairs {} {
+        constexpr char digits[] = "0123456789abcdef";
+        for(int i = 0; i < 256; i++) {
+            pairs[2*i] = digits[i >> 4];
+            pairs[2*i + 1] = digits[i & 0xf];
+        }
+    }
+};
+
+constexpr hex_table HEX {};
+
+// messages md5_hex_many hands to a kernel at a time, so their pointers and digests fit on the stack
+constexpr size_t MANY_CHUNK = 256;
+
+
+template <unsigned int bits>
+inline uint32_t leftrotate(uint32_t F) {
+    return (F << bits) | (F >> (32 - bits));
+}
+
+
+// read a little endian 32 bit integer
+inline uint32_t load_little_endian(const unsigned char* p) {
+    return uint32_t {p[0]} | uint32_t {p[1]} << 8 | uint32_t {p[2]} << 16 | uint32_t {p[3]} << 24;
+}
+
+
+// a single round, its function, word, constant and rotation all known at compile time
+// rather than moving every variable along after each round, the rounds take turns on which variable they update
+template <unsigned int i>
+inline void round_step(uint32_t v[4], const uint32_t message[16]) {
+    constexpr unsigned int a = (4 - i % 4) % 4, b = (a + 1) % 4, c = (a + 2) % 4, d = (a + 3) % 4;
+
+    uint32_t F;
+    if constexpr(i < 16) F = v[d] ^ (v[b] & (v[c] ^ v[d]));
+    else if constexpr(i < 32) F = v[c] ^ (v[d] & (v[b] ^ v[c]));
+    else if constexpr(i < 48) F = v[b] ^ v[c] ^ v[d];
+    else F = v[c] ^ (v[b] | ~v[d]);
+
+    v[a] = v[b] + leftrotate<SHIFTS[i]>(v[a] + F + K[i] + message[message_index(i)]);
+}
+
+
+template <unsigned int... i>
+inline void rounds(uint32_t v[4], const uint32_t message[16], integer_sequence<unsigned int, i...>) {
+    (round_step<i>(v, message), ...);
+}
+
+
+// combine a 512 bit block into the state, through 64 fully unrolled rounds
+static void compress(uint32_t state[4], const unsigned char* block) {
+    uint32_t message[16];
+    for(int i = 0; i < 16; i++) message[i] = load_little_endian(block + 4*i);
+
+    uint32_t v[4] {state[0], state[1], state[2], state[3]};
+    rounds(v, message, make_integer_sequence<unsigned int, 64> {});
+
+    for(int i = 0; i < 4; i++) state[i] += v[i];
+}
+
+
+md5::md5(): state {INITIAL_STATE[0], INITIAL_STATE[1], INITIAL_STATE[2], INITIAL_STATE[3]}, buffer {}, length {0} {}
+
+
+void md5::update(const unsigned char* data, size_t size) {
+    size_t buffered = length % BLOCK_SIZE;
+    length += size;
+
+    // complete the block waiting in the buffer first
+    if(buffered > 0) {
+        size_t n = min(size, BLOCK_SIZE - buffered);
+        memcpy(buffer + buffered, data, n);
+        data += n;
+        size -= n;
+
+        if(buffered + n < BLOCK_SIZE) return;
+        compress(state, buffer);
+    }
+
+    // whole blocks are hashed where they are
+    for(; size >= BLOCK_SIZE; data += BLOCK_SIZE, size -= BLOCK_SIZE) compress(state, data);
+
+    memcpy(buffer, data, size);
+}
+
+
+void md5::update(string_view data) {
+    update(reinterpret_cast<const unsigned char*>(data.data()), data.size());
+}
+
+
+void md5::finish(unsigned char digest[MD5_DIGEST_SIZE]) {
+    uint64_t bits = length * 8;
+    size_t buffered = length % BLOCK_SIZE;
+
+    // append 1, then 0s until the message is 448 bits (mod 512), then its size in bits in little endian format
+    buffer[buffered++] = 0x80;
+    if(buffered > BLOCK_SIZE - 8) {
+        memset(buffer + buffered, 0, BLOCK_SIZE - buffered);
+        compress(state, buffer);
+        buffered = 0;
+    }
+
+    memset(buffer + buffered, 0, BLOCK_SIZE - 8 - buffered);
+    for(int i = 0; i < 8; i++) buffer[BLOCK_SIZE - 8 + i] = (bits >> (8*i)) & 0xff;
+    compress(state, buffer);
+
+    // the digest is the state in little endian format
+    for(int i = 0; i < 16; i++) digest[i] = (state[i / 4] >> (8 * (i % 4))) & 0xff;
+}
+
+
+void md5_hex(const unsigned char digest[MD5_DIGEST_SIZE], char out[MD5_HEX_SIZE]) {
+    for(size_t i = 0; i < MD5_DIGEST_SIZE; i++) memcpy(out + 2*i, HEX.pairs + 2*digest[i], 2);
+}
+
+
+void md5_hex(string_view message, char out[MD5_HEX_SIZE]) {
+    md5 hash {};
+    hash.update(message);
+
+    unsigned char digest[MD5_DIGEST_SIZE];
+    hash.finish(digest);
+    md5_hex(digest, out);
+}
+
+
+// a kernel writes the digest of each message, in order
+typedef void (*digest_kernel)(const unsigned char* const* messages, const size_t* sizes, size_t count, unsigned char* digests);
+
+struct kernel_choice {
+    const char* name;
+    digest_kernel kernel;
+};
+
+
+// hash the messages one after another, on any processor
+static void digest_many_scalar(const unsigned char* const* messages, const size_t* sizes, size_t count, unsigned char* digests) {
+    for(size_t i = 0; i < count; i++) {
+        md5 hash {};
+        hash.update(messages[i], sizes[i]);
+        hash.finish(digests + i * MD5_DIGEST_SIZE);
+    }
+}
+
+
+// the kernels this build holds, widest first, each with whether the processor supports it
+static kernel_choice choose_kernel() {
+    struct candidate {
+        kernel_choice choice;
+        bool supported;
+    };
+
+#ifdef MD5_X86_KERNELS
+    __builtin_cpu_init();
+    const candidate candidates[] {
+        {{"avx512", md5_digest_many_avx512}, static_cast<bool>(__builtin_cpu_supports("avx512f"))},
+        {{"avx2", md5_digest_many_avx2}, static_cast<bool>(__builtin_cpu_supports("avx2"))},
+        {{"sse2", md5_digest_many_sse2}, static_cast<bool>(__builtin_cpu_supports("sse2"))},
+        {{"scalar", digest_many_scalar}, true},
+    };
+#else
+    const candidate candidates[] {
+        {{"scalar", digest_many_scalar}, true},
+    };
+#endif
+
+    // a kernel asked for by name is only used if the processor supports it
+    const char* requested = getenv("MD5_KERNEL");
+    if(requested != nullptr) {
+        for(const candidate& c : candidates) {
+            if(c.supported && string {requested} == c.choice.name) return c.choice;
+        }
+    }
+
+    for(const candidate& c : candidates) {
+        if(c.supported) return c.choice;
+    }
+
+    return candidates[0].choice;
+}
+
+
+static const kernel_choice& chosen_kernel() {
+    static const kernel_choice choice = choose_kernel();
+    return choice;
+}
+
+
+void md5_hex_many(const string_view* messages, size_t count, char* out) {
+    digest_kernel kernel = chosen_kernel().kernel;
+
+    const unsigned char* data[MANY_CHUNK];
+    size_t sizes[MANY_CHUNK];
+    unsigned char digests[MANY_CHUNK * MD5_DIGEST_SIZE];
+
+    for(size_t start = 0; start < count; start += MANY_CHUNK) {
+        size_t n = min(MANY_CHUNK, count - start);
+        for(size_t i = 0; i < n; i++) {
+            data[i] = reinterpret_cast<const unsigned char*>(messages[start + i].data());
+            sizes[i] = messages[start + i].size();
+        }
+
+        kernel(data, sizes, n, digests);
+        for(size_t i = 0; i < n; i++) md5_hex(digests + i * MD5_DIGEST_SIZE, out + (start + i) * MD5_HEX_SIZE);
+    }
+}
+
+
+const char* md5_kernel() {
+    return chosen_kernel().name;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// bytes of an md5 digest, and characters of its hexadecimal form
+constexpr size_t MD5_DIGEST_SIZE = 16;
+constexpr size_t MD5_HEX_SIZE = 32;
+
+/*
+ * class md5 hashes a message fed to it in pieces of any size
+ *
+ * a partial block waits in a fixed buffer of the object until the next piece completes it,
+ * so hashing never copies the message nor allocates, whatever its length
+ */
+class md5 {
+public:
+    // bytes of the blocks the message is hashed in
+    constexpr static size_t BLOCK_SIZE = 64;
+
+private:
+    uint32_t state[4];
+
+    unsigned char buffer[BLOCK_SIZE];
+
+    // bytes fed so far
+    uint64_t length;
+
+public:
+    md5();
+
+    // hash the next piece of the message
+    void update(const unsigned char* data, size_t size);
+    void update(std::string_view data);
+
+    // pad the message and write its digest
+    // the object holds an unspecified state afterwards, and must be constructed again to hash another message
+    void finish(unsigned char digest[MD5_DIGEST_SIZE]);
+};
+
+// write the lowercase hexadecimal form of a digest, without a terminating null character
+void md5_hex(const unsigned char digest[MD5_DIGEST_SIZE], char out[MD5_HEX_SIZE]);
+
+// hash a whole message and write the hexadecimal form of its digest
+void md5_hex(std::string_view message, char out[MD5_HEX_SIZE]);
+
+// hash several whole messages at once and write the hexadecimal form of each digest, one after another
+// independent messages are hashed together in the lanes of vector registers where the processor allows,
+// through the widest kernel it supports, unless the MD5_KERNEL environment variable names another
+void md5_hex_many(const std::string_view* messages, size_t count, char* out);
+
+// returns the name of the kernel md5_hex_many uses: avx512, avx2, sse2 or scalar
+const char* md5_kernel();
@@ -0,0 +1,8 @@
+#include "md5_lanes.h"
+
+// eight messages at a time, in the 256 bit registers of AVX2
+typedef uint32_t lanes __attribute__((vector_size(32)));
+
+void md5_digest_many_avx2(const unsigned char* const* messages, const size_t* sizes, size_t count, unsigned char* digests) {
+    digest_lanes<lanes>(messages, sizes, count, digests);
+}
@@ -0,0 +1,8 @@
+#include "md5_lanes.h"
+
+// sixteen messages at a time, in the 512 bit registers of AVX-512
+typedef uint32_t lanes __attribute__((vector_size(64)));
+
+void md5_digest_many_avx512(const unsigned char* const* messages, const size_t* sizes, size_t count, unsigned char* digests) {
+    digest_lanes<lanes>(messages, sizes, count, digests);
+}
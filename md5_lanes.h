@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include "md5.h"
+#include "md5_rounds.h"
+
+// multi-lane kernels, each hashing several messages at a time in the lanes of the vector registers of an instruction set
+// every kernel writes the digest of each message, in order, and is built in a translation unit of its own
+// with the instruction set it needs, so it may only be called once the processor is known to support it
+void md5_digest_many_sse2(const unsigned char* const* messages, const size_t* sizes, size_t count, unsigned char* digests);
+void md5_digest_many_avx2(const unsigned char* const* messages, const size_t* sizes, size_t count, unsigned char* digests);
+void md5_digest_many_avx512(const unsigned char* const* messages, const size_t* sizes, size_t count, unsigned char* digests);
+
+// the lane code is written once with the vector types of the compiler, and each kernel builds it with its own instruction set
+// it has internal linkage, and calls nothing but the C library, so a build for one instruction set is never shared with another
+namespace {
+
+template <typename V>
+inline V broadcast(uint32_t x) {
+    V v {};
+    return v + x;
+}
+
+
+template <unsigned int bits, typename V>
+inline V rotate_lanes(V x) {
+    return (x << bits) | (x >> (32 - bits));
+}
+
+
+// a single round over every lane, as the single message engine runs it
+template <unsigned int i, typename V>
+inline void round_lanes(V v[4], const V message[16]) {
+    constexpr unsigned int a = (4 - i % 4) % 4, b = (a + 1) % 4, c = (a + 2) % 4, d = (a + 3) % 4;
+
+    V F;
+    if constexpr(i < 16) F = v[d] ^ (v[b] & (v[c] ^ v[d]));
+    else if constexpr(i < 32) F = v[c] ^ (v[d] & (v[b] ^ v[c]));
+    else if constexpr(i < 48) F = v[b] ^ v[c] ^ v[d];
+    else F = v[c] ^ (v[b] | ~v[d]);
+
+    v[a] = v[b] + rotate_lanes<SHIFTS[i]>(v[a] + F + K[i] + message[message_index(i)]);
+}
+
+
+template <typename V, unsigned int... i>
+inline void rounds_lanes(V v[4], const V message[16], std::integer_sequence<unsigned int, i...>) {
+    (round_lanes<i>(v, message), ...);
+}
+
+
+// hash a group of at most as many messages as there are lanes
+// the lanes move through their blocks together, a lane whose message has no block left keeps its state
+template <typename V>
+void digest_group(const unsigned char* const* messages, const size_t* sizes, size_t count, unsigned char* digests) {
+    constexpr size_t LANES = sizeof(V) / sizeof(uint32_t);
+    constexpr size_t BLOCK = md5::BLOCK_SIZE;
+
+    // the padded last blocks of every message, the blocks before them are read in place
+    unsigned char tails[LANES][2 * BLOCK];
+    const unsigned char* data[LANES];
+    size_t full[LANES];
+    uint32_t block_counts[LANES];
+    size_t most = 0;
+
+    for(size_t lane = 0; lane < LANES; lane++) {
+        size_t size = lane < count ? sizes[lane] : 0;
+        data[lane] = lane < count ? messages[lane] : nullptr;
+        full[lane] = size / BLOCK;
+
+        // append 1, then 0s until the message is 448 bits (mod 512), then its size in bits in little endian format
+        size_t rest = size % BLOCK;
+        size_t tail_blocks = rest + 1 + 8 <= BLOCK ? 1 : 2;
+        unsigned char* tail = tails[lane];
+
+        // cleared a vector at a time, as a memset this short may compile to a string instruction slower than the stores
+        const V zero {};
+        for(size_t i = 0; i < 2 * BLOCK; i += sizeof(V)) memcpy(tail + i, &zero, sizeof(V));
+        if(rest > 0) memcpy(tail, data[lane] + full[lane] * BLOCK, rest);
+        tail[rest] = 0x80;
+
+        uint64_t bits = static_cast<uint64_t>(size) * 8;
+        memcpy(tail + tail_blocks * BLOCK - 8, &bits, sizeof(bits));
+
+        block_counts[lane] = static_cast<uint32_t>(full[lane] + tail_blocks);
+        if(full[lane] + tail_blocks > most) most = full[lane] + tail_blocks;
+    }
+
+    V blocks;
+    memcpy(&blocks, block_counts, sizeof(V));
+
+    V state[4];
+    for(int i = 0; i < 4; i++) state[i] = broadcast<V>(INITIAL_STATE[i]);
+
+    for(size_t b = 0; b < most; b++) {
+        // the same word of every lane's block goes into the same register
+        uint32_t words[16][LANES];
+        for(size_t lane = 0; lane < LANES; lane++) {
+            const unsigned char* block = b < full[lane] ? data[lane] + b * BLOCK : tails[lane] + (b < block_counts[lane] ? b - full[lane] : 0) * BLOCK;
+            // the kernels only run on x86, which is little endian like md5 itself
+            uint32_t row[16];
+            memcpy(row, block, sizeof(row));
+            for(int w = 0; w < 16; w++) words[w][lane] = row[w];
+        }
+
+        V message[16];
+        for(int w = 0; w < 16; w++) memcpy(&message[w], words[w], sizeof(V));
+
+        V v[4] {state[0], state[1], state[2], state[3]};
+        rounds_lanes(v, message, std::make_integer_sequence<unsigned int, 64> {});
+
+        // lanes past their last block add nothing
+        V active = (V) (blocks > broadcast<V>(static_cast<uint32_t>(b)));
+        for(int i = 0; i < 4; i++) state[i] += v[i] & active;
+    }
+
+    // the digest is the state in little endian format
+    uint32_t words[4][LANES];
+    for(int i = 0; i < 4; i++) memcpy(words[i], &state[i], sizeof(V));
+
+    for(size_t lane = 0; lane < count; lane++) {
+        uint32_t digest[4] {words[0][lane], words[1][lane], words[2][lane], words[3][lane]};
+        memcpy(digests + lane * MD5_DIGEST_SIZE, digest, MD5_DIGEST_SIZE);
+    }
+}
+
+
+template <typename V>
+void digest_lanes(const unsigned char* const* messages, const size_t* sizes, size_t count, unsigned char* digests) {
+    constexpr size_t LANES = sizeof(V) / sizeof(uint32_t);
+
+    for(size_t i = 0; i < count; i += LANES) {
+        digest_group<V>(messages + i, sizes + i, count - i < LANES ? count - i : LANES, digests + i * MD5_DIGEST_SIZE);
+    }
+}
+
+}
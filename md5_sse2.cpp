@@ -0,0 +1,8 @@
+#include "md5_lanes.h"
+
+// four messages at a time, in the 128 bit registers every x86-64 processor has
+typedef uint32_t lanes __attribute__((vector_size(16)));
+
+void md5_digest_many_sse2(const unsigned char* const* messages, const size_t* sizes, size_t count, unsigned char* digests) {
+    digest_lanes<lanes>(messages, sizes, count, digests);
+}
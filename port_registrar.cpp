@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <string>
+
+#include "port_registrar.h"
+#include "constants.h"
+#include "logger.h"
+
+using namespace std;
+using namespace socket_constants;
+
+
+port_registrar::port_registrar(Socket& ssock, const map<int, char>& bknd, uint32_t& request_ids):
+    server_sock {ssock}, backend {bknd}, ports {}, unanswered {}, silent {}, pending {}, next_request_id {request_ids}, expiry {} {}
+
+
+void port_registrar::add(const vector<int>& added) {
+    for(int port : added) {
+        ports.insert(port);
+
+        // a silent backend server is still sent the registration, but not waited on
+        set<int>& owed = unanswered[port];
+        for(const pair<const int, char>& b : backend) {
+            if(silent.count(b.first) == 0) owed.insert(b.first);
+        }
+        if(owed.empty()) unanswered.erase(port);
+    }
+
+    for(const pair<const int, char>& b : backend) send_registration(b.first, added);
+}
+
+
+void port_registrar::remove(const vector<int>& removed) {
+    string request = string {UNREGISTER_REQUEST} + '\n';
+    for(int port : removed) {
+        ports.erase(port);
+        unanswered.erase(port);
+        request += to_string(port) + '\n';
+    }
+
+    // an unregistration that is lost leaves a port the backend server serves, which is harmless once the socket is closed
+    for(const pair<const int, char>& b : backend) {
+        try {
+            server_sock.send_info_to(b.first, request);
+        } catch(socket_exception& se) {
+            logging::error()<<se.what();
+        }
+    }
+}
+
+
+void port_registrar::renew(int backend_port) {
+    if(ports.empty()) return;
+
+    logging::info()<<"The main server is registering its ports with Server "<<backend.find(backend_port)->second<<".";
+
+    // the backend server is up again, so ports waiting on their registrations wait on it as well
+    silent.erase(backend_port);
+    for(int port : ports) unanswered[port].insert(backend_port);
+
+    send_registration(backend_port, vector<int> {ports.begin(), ports.end()});
+}
+
+
+bool port_registrar::ready(int port) const {
+    return unanswered.count(port) == 0;
+}
+
+
+bool port_registrar::answered(int backend_port) const {
+    return none_of(unanswered.begin(), unanswered.end(), [&](const pair<const int, set<int>>& owed) { return owed.second.count(backend_port) > 0; });
+}
+
+
+void port_registrar::send_registration(int backend_port, const vector<int>& registered) {
+    for(size_t i = 0; i < registered.size(); i += REGISTER_BATCH) {
+        registration r {backend_port, {registered.begin() + i, registered.begin() + min(registered.size(), i + REGISTER_BATCH)}};
+
+        uint32_t request_id = next_request_id++;
+        transmit(request_id, pending.emplace(request_id, std::move(r)).first->second);
+    }
+}
+
+
+void port_registrar::transmit(uint32_t request_id, const registration& r) {
+    string request = REQUEST_ID + to_string(request_id) + '\n' + REGISTER_REQUEST + '\n';
+    for(int port : r.ports) request += to_string(port) + '\n';
+
+    // a registration the socket could not take is sent again once it times out, like one lost on the way
+    try {
+        server_sock.send_info_to(r.backend_port, request);
+    } catch(socket_exception& se) {
+        logging::error()<<se.what();
+    }
+
+    expiry.emplace_back(chrono::steady_clock::now() + REGISTER_TIMEOUT, request_id);
+}
+
+
+bool port_registrar::receive(const msg_port& answer) {
+    size_t id_end = answer.msg.find('\n');
+    if(answer.msg.compare(0, 1, REQUEST_ID) != 0 || id_end == string::npos) return false;
+
+    uint32_t request_id;
+    try {
+        request_id = stoul(answer.msg.substr(1, id_end - 1));
+    } catch(logic_error&) {
+        return false;
+    }
+
+    unordered_map<uint32_t, registration>::iterator found = pending.find(request_id);
+    if(found == pending.end() || found->second.backend_port != answer.port) return false;
+
+    silent.erase(answer.port);
+    for(int port : found->second.ports) {
+        map<int, set<int>>::iterator owed = unanswered.find(port);
+        if(owed == unanswered.end()) continue;
+
+        owed->second.erase(answer.port);
+        if(owed->second.empty()) unanswered.erase(owed);
+    }
+
+    pending.erase(found);
+    return true;
+}
+
+
+void port_registrar::expire() {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    // every registration is given the same timeout, so the expiry queue is ordered by deadline
+    while(!expiry.empty() && expiry.front().first <= now) {
+        uint32_t request_id = expiry.front().second;
+        expiry.pop_front();
+
+        // registrations that were answered are no longer pending
+        unordered_map<uint32_t, registration>::iterator found = pending.find(request_id);
+        if(found == pending.end()) continue;
+
+        // ports removed since the registration was sent are not registered again
+        registration& r = found->second;
+        r.ports.erase(std::remove_if(r.ports.begin(), r.ports.end(), [&](int port) { return ports.count(port) == 0; }), r.ports.end());
+        if(r.ports.empty()) {
+            pending.erase(found);
+            continue;
+        }
+
+        const char server_name = backend.find(r.backend_port)->second;
+
+        if(r.attempt + 1 < REGISTER_ATTEMPTS) {
+            r.attempt++;
+            transmit(request_id, r);
+            continue;
+        }
+
+        // a silent backend server holds up no port, and has every port registered with it again once it restarts
+        logging::warning()<<"The main server could not register its ports with Server "<<server_name<<".";
+        silent.insert(r.backend_port);
+
+        for(int port : r.ports) {
+            map<int, set<int>>::iterator owed = unanswered.find(port);
+            if(owed == unanswered.end()) continue;
+
+            owed->second.erase(r.backend_port);
+            if(owed->second.empty()) unanswered.erase(owed);
+        }
+
+        pending.erase(found);
+    }
+}
+
+
+int port_registrar::next_timeout() const {
+    if(expiry.empty()) return -1;
+
+    chrono::steady_clock::duration left = expiry.front().first - chrono::steady_clock::now();
+    return max<long>(0, chrono::ceil<chrono::milliseconds>(left).count());
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "socket.h"
+
+// a registration of ports sent to a backend server, waiting for its answer
+struct registration {
+    // port of the backend server
+    int backend_port;
+
+    std::vector<int> ports;
+
+    // times the registration was sent before
+    int attempt {0};
+};
+
+/*
+ * class port_registrar has the backend servers serve requests from ports of the main server other than its backend port,
+ * such as the sockets of worker threads and forked children
+ *
+ * registrations are sent from the backend port of the main server, the only port backend servers take them from,
+ * and their answers are taken in as they arrive, so a slow or absent backend server holds nothing else up
+ * a backend server that restarted has forgotten its registrations, so every port is registered with it again
+ * ports are unregistered from the backend port as well, so a process that crashed leaves none of its ports behind
+ */
+class port_registrar {
+private:
+    // backend facing UDP socket bound to the backend port of the main server
+    Socket& server_sock;
+
+    // collection of backend servers, mapping their port to their names
+    const std::map<int, char>& backend;
+
+    // registered ports
+    std::set<int> ports;
+
+    // registered ports along with the backend servers yet to answer their registration
+    std::map<int, std::set<int>> unanswered;
+
+    // backend servers that never answered a registration, which later registrations are not held up by
+    std::set<int> silent;
+
+    // registrations awaiting an answer, keyed by the request id sent along with them
+    // request ids are shared with everything else sending requests from the backend port
+    std::unordered_map<uint32_t, registration> pending;
+    uint32_t& next_request_id;
+
+    // request ids in the order they were sent, along with the time each one is sent again
+    std::deque<std::pair<std::chrono::steady_clock::time_point, uint32_t>> expiry;
+
+    // time a backend server is given to answer a registration before it is sent again
+    constexpr static std::chrono::milliseconds REGISTER_TIMEOUT {500};
+
+    // times a registration is sent before the backend server is taken to be silent
+    constexpr static int REGISTER_ATTEMPTS = 4;
+
+    // most ports carried by a single registration, keeping it within a datagram
+    constexpr static size_t REGISTER_BATCH = 1024;
+
+    // send the registration of ports to a backend server
+    void send_registration(int backend_port, const std::vector<int>& ports);
+
+    // send a registration, starting its timeout
+    void transmit(uint32_t request_id, const registration& r);
+
+public:
+    // constructor, registrations take their request ids from the provided counter
+    port_registrar(Socket& server_sock, const std::map<int, char>& backend, uint32_t& request_ids);
+
+    // register ports with every backend server
+    void add(const std::vector<int>& added);
+
+    // stop every backend server from serving ports whose sockets were closed, the request is not answered
+    void remove(const std::vector<int>& removed);
+
+    // register every port again with a backend server that restarted, or with one added to the topology
+    void renew(int backend_port);
+
+    // returns whether every backend server, besides those found silent, has answered the registration of the port
+    bool ready(int port) const;
+
+    // returns whether a backend server has answered the registration of every port, or was found silent
+    bool answered(int backend_port) const;
+
+    // take in a datagram received on the backend port of the main server
+    // returns whether it answered a registration
+    bool receive(const msg_port& answer);
+
+    // send again the registrations whose backend server has not answered in time,
+    // taking the backend server to be silent once out of attempts
+    void expire();
+
+    // milliseconds until the oldest registration awaiting an answer is due, or -1 if none is
+    int next_timeout() const;
+};
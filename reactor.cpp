@@ -0,0 +1,1317 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <sys/epoll.h>
+
+#include "reactor.h"
+#include "logger.h"
+#include "constants.h"
+
+using namespace std;
+using namespace socket_constants;
+
+
+reactor::reactor(Socket* lsock, Socket& ssock, uint32_t& request_ids, coordinator* co, const backend_directory& bknds,
+                 room_table& rs, const credential_index& ui, token_table& tt, stats_registry& st):
+    loop {}, listener {lsock}, server_sock {ssock}, server_port {ssock.bound_port()}, coord {co}, backends {bknds}, room_status {rs}, user_info {ui}, tokens {tt}, stats {st}, next_request_id {request_ids} {
+
+    if(listener != nullptr) {
+        listener->set_nonblocking();
+        loop.add(listener->descriptor(), EPOLLIN);
+    }
+
+    server_sock.set_nonblocking();
+    loop.add(server_sock.descriptor(), EPOLLIN);
+
+    if(coord != nullptr) loop.add(coord->descriptor(), EPOLLIN);
+}
+
+
+stats_registry reactor::make_stats() {
+    vector<string> counters {"connections_total"};
+    for(const char* type : {"authentication", "resume", "availability", "reservation", "batch_availability", "batch_reservation", "group_reservation", "stats", "invalid"}) {
+        counters.push_back(string {"requests_total{type=\""} + type + "\"}");
+    }
+    counters.push_back("backend_timeouts_total");
+    for(const char* code : AUTHORIZATION_CODE_NAMES) counters.push_back(string {"authentications_total{code=\""} + code + "\"}");
+    for(const char* code : RESPONSE_CODE_NAMES) counters.push_back(string {"responses_total{code=\""} + code + "\"}");
+
+    return stats_registry {"serverM", counters, {"authentication", "credentials", "backend", "send"}};
+}
+
+
+void reactor::adopt(Socket&& client) {
+    stats.count(CONNECTION_COUNTER);
+    client.set_nonblocking();
+    int fd = client.descriptor();
+
+    session s {std::move(client), next_session_id++};
+    sessions.emplace(fd, std::move(s));
+
+    loop.add(fd, EPOLLIN);
+}
+
+
+void reactor::run() {
+    epoll_event events[event_loop::MAXEVENTS];
+
+    while(listener != nullptr || !sessions.empty()) {
+        int ready = loop.wait(events, next_timeout());
+
+        for(int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+
+            if(listener != nullptr && fd == listener->descriptor()) {
+                try {
+                    accept_clients();
+                } catch(socket_exception& se) {
+                    // a reactor out of descriptors keeps serving the connections it has
+                    logging::error()<<se.what();
+                    pause_accepting();
+                }
+                continue;
+            }
+
+            if(fd == server_sock.descriptor()) {
+                read_backend();
+                continue;
+            }
+
+            if(coord != nullptr && fd == coord->descriptor()) {
+                coord->reload();
+                continue;
+            }
+
+            // the connection may have been closed by an earlier event in this batch
+            unordered_map<int, session>::iterator found = sessions.find(fd);
+            if(found == sessions.end()) continue;
+
+            // a hangup or error is reported on every wait until the connection is closed, even when it is not read from
+            // while waiting on backend servers, so it is closed right away and its requests in flight find it gone
+            if(events[i].events & (EPOLLHUP | EPOLLERR)) {
+                logging::info()<<"The client with port "<<found->second.sock.connected_port<<" has closed the connection.";
+                close_client(fd);
+                continue;
+            }
+
+            try {
+                if(events[i].events & EPOLLOUT) flush_client(found->second);
+                if(events[i].events & EPOLLIN) read_client(found->second);
+            } catch(socket_exception& se) {
+                // a failing connection must not bring down the others
+                logging::error()<<se.what();
+                close_client(fd);
+            }
+        }
+
+        expire_requests();
+        reroute_requests();
+        resume_accepting();
+        if(coord != nullptr) coord->expire();
+    }
+}
+
+
+int reactor::next_timeout() const {
+    int coordinating = coord != nullptr ? coord->next_timeout() : -1;
+    if(expiry.empty() && rerouted.empty() && !accept_paused) return coordinating;
+
+    chrono::steady_clock::time_point due = chrono::steady_clock::time_point::max();
+    if(!expiry.empty()) due = expiry.front().first;
+    if(!rerouted.empty()) due = min(due, rerouted.front().first);
+    if(accept_paused) due = min(due, accept_resume);
+
+    chrono::steady_clock::duration left = due - chrono::steady_clock::now();
+    int timeout = max<long>(0, chrono::ceil<chrono::milliseconds>(left).count());
+    return coordinating == -1 ? timeout : min(timeout, coordinating);
+}
+
+
+void reactor::expire_requests() {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    // every request is given the same timeout, so the expiry queue is ordered by deadline
+    while(!expiry.empty() && expiry.front().first <= now) {
+        uint32_t request_id = expiry.front().second;
+        expiry.pop_front();
+
+        // requests that were answered are no longer pending
+        unordered_map<uint32_t, backend_waiter>::iterator found = pending.find(request_id);
+        if(found == pending.end()) continue;
+
+        // the datagram of the request or of its response may have been dropped, so the request is sent again with its id,
+        // which the backend server answers with the response it kept if it handled the request already
+        if(found->second.group_id == 0 && found->second.attempt + 1 < MAX_BACKEND_ATTEMPTS) {
+            logging::warning()<<"The main server did not receive a response from Server "<<backends.name(found->second.port)<<" in time, sending the request again.";
+            found->second.attempt++;
+            transmit(request_id, found->second);
+            continue;
+        }
+
+        backend_waiter w = std::move(found->second);
+        pending.erase(found);
+        release(w.port);
+
+        logging::warning()<<"The main server did not receive a response from Server "<<backends.name(w.port)<<" in time.";
+        stats.count(BACKEND_TIMEOUT_COUNTER);
+
+        if(w.batch_id != 0) {
+            batch_response(w, "");
+            continue;
+        }
+
+        if(w.group_id != 0) {
+            group_response(w, "");
+            continue;
+        }
+
+        fail_request(w, BACKEND_TIMEOUT);
+    }
+}
+
+
+void reactor::reroute(backend_waiter&& w, bool waited) {
+    if(w.batch_id != 0) {
+        unordered_map<uint32_t, batch_request>::iterator found = batches.find(w.batch_id);
+        if(found == batches.end()) return;
+
+        batch_request& b = found->second;
+
+        // the rooms of a part may have moved to different backend servers
+        map<int, vector<size_t>> routed {};
+        vector<size_t> unmoved {};
+        for(size_t i : w.indices) {
+            int port = route(b.rooms[i]);
+
+            if(port == -1) b.results[i] = ROOM_NOT_FOUND;
+            else if(w.reroutes >= MAX_REROUTES) b.results[i] = BACKEND_TIMEOUT;
+            else if(port == w.port && !waited) unmoved.push_back(i);
+            else routed[port].push_back(i);
+        }
+
+        for(const pair<const int, vector<size_t>>& part : routed) send_batch(w.batch_id, b, part.first, part.second, w.reroutes + 1);
+
+        if(!unmoved.empty()) {
+            backend_waiter later = w;
+            later.indices = std::move(unmoved);
+            later.reroutes++;
+
+            // a part waiting to be sent again is still outstanding
+            b.remaining++;
+            rerouted.emplace_back(chrono::steady_clock::now() + REROUTE_DELAY, std::move(later));
+        }
+        return;
+    }
+
+    // a client that left while its request waited books nothing
+    unordered_map<int, session>::iterator client = sessions.find(w.fd);
+    if(client == sessions.end() || client->second.id != w.session_id) return;
+
+    if(w.reroutes >= MAX_REROUTES) {
+        logging::warning()<<"The main server found no Server taking over Room "<<w.room<<" in time.";
+        stats.count(BACKEND_TIMEOUT_COUNTER);
+        fail_request(w, BACKEND_TIMEOUT);
+        return;
+    }
+
+    int port = route(w.room);
+    if(port == -1) {
+        logging::warning()<<"The main server found no corresponding Server for room "<<w.room<<".";
+        fail_request(w, ROOM_NOT_FOUND);
+        return;
+    }
+
+    w.reroutes++;
+
+    if(port == w.port && !waited) {
+        rerouted.emplace_back(chrono::steady_clock::now() + REROUTE_DELAY, std::move(w));
+        return;
+    }
+
+    // the request goes out under a new id, since the backend server it is sent to may have seen the old one from elsewhere
+    uint32_t request_id = next_request_id++;
+    w.port = port;
+    w.attempt = 0;
+    w.request = REQUEST_ID + to_string(request_id) + '\n' + w.request.substr(w.request.find('\n') + 1);
+
+    send_backend(request_id, std::move(w));
+    logging::info()<<"The main server sent a request to Server "<<backends.name(port)<<".";
+}
+
+
+void reactor::reroute_requests() {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    // every rerouted request waits the same time, so the queue is ordered by the time each one is due
+    while(!rerouted.empty() && rerouted.front().first <= now) {
+        backend_waiter w = std::move(rerouted.front().second);
+        rerouted.pop_front();
+
+        if(w.group_id != 0) {
+            restart_group(w.group_id);
+            continue;
+        }
+
+        if(w.batch_id == 0) {
+            reroute(std::move(w), true);
+            continue;
+        }
+
+        unordered_map<uint32_t, batch_request>::iterator found = batches.find(w.batch_id);
+        if(found == batches.end()) continue;
+
+        uint32_t batch_id = w.batch_id;
+        reroute(std::move(w), true);
+        if(--found->second.remaining == 0) finish_batch(batch_id);
+    }
+}
+
+
+void reactor::fail_request(const backend_waiter& w, const string& code) {
+    unordered_map<int, session>::iterator client = sessions.find(w.fd);
+    if(client == sessions.end() || client->second.id != w.session_id) return;
+
+    session& s = client->second;
+
+    try {
+        reply(s, w.frame_type, w.frame_id, code);
+
+        if(w.request_type == AVAILABILITY_REQUEST) logging::info()<<"The main server sent the availability information to the client.";
+        else logging::info()<<"The main server sent the reservation result to the client.";
+
+        request_done(s);
+    } catch(socket_exception& se) {
+        logging::error()<<se.what();
+        close_client(w.fd);
+    }
+}
+
+
+void reactor::send_backend(uint32_t request_id, backend_waiter&& w) {
+    backend_channel& c = channels[w.port];
+    backend_waiter& stored = pending.emplace(request_id, std::move(w)).first->second;
+
+    if(c.in_flight >= MAX_BACKEND_IN_FLIGHT) {
+        c.queued.push_back(request_id);
+        return;
+    }
+
+    c.in_flight++;
+    stored.sent = chrono::steady_clock::now();
+    transmit(request_id, stored);
+}
+
+
+void reactor::transmit(uint32_t request_id, backend_waiter& w) {
+    // a request the socket could not take is sent again once it times out, like a request lost on the way
+    try {
+        server_sock.send_info_to(w.port, w.request);
+    } catch(socket_exception& se) {
+        logging::error()<<se.what();
+    }
+
+    expiry.emplace_back(chrono::steady_clock::now() + RESPONSE_TIMEOUT, request_id);
+}
+
+
+void reactor::release(int port) {
+    backend_channel& c = channels[port];
+    c.in_flight--;
+
+    while(c.in_flight < MAX_BACKEND_IN_FLIGHT && !c.queued.empty()) {
+        uint32_t request_id = c.queued.front();
+        c.queued.pop_front();
+
+        unordered_map<uint32_t, backend_waiter>::iterator found = pending.find(request_id);
+        if(found == pending.end()) continue;
+
+        c.in_flight++;
+        found->second.sent = chrono::steady_clock::now();
+        transmit(request_id, found->second);
+    }
+}
+
+
+void reactor::accept_clients() {
+    while(optional<Socket> child = listener->try_accept_socket()) {
+        adopt(std::move(*child));
+    }
+}
+
+
+void reactor::pause_accepting() {
+    accept_paused = true;
+    accept_resume = chrono::steady_clock::now() + ACCEPT_PAUSE;
+    loop.modify(listener->descriptor(), 0);
+}
+
+
+void reactor::resume_accepting() {
+    if(!accept_paused || chrono::steady_clock::now() < accept_resume) return;
+
+    accept_paused = false;
+    loop.modify(listener->descriptor(), EPOLLIN);
+}
+
+
+void reactor::read_client(session& s) {
+    // a legacy connection waiting on a backend response is not read from,
+    // the legacy protocol allows only one outstanding request
+    if(s.state == session_state::waiting) return;
+
+    optional<string> msg = s.sock.try_recv_info();
+    if(!msg) return;
+
+    // mark connection as closed if an empty string is received
+    if(*msg == CLOSED_CONNECTION) {
+        logging::info()<<"The client with port "<<s.sock.connected_port<<" has closed the connection.";
+        close_client(s.sock.descriptor());
+        return;
+    }
+
+    // a frame length always begins with a zero byte, which legacy text never does
+    if(s.protocol == session_protocol::unknown) {
+        s.protocol = (*msg)[0] == 0 ? session_protocol::framed : session_protocol::legacy;
+    }
+
+    if(s.protocol == session_protocol::framed) {
+        s.pending_in += *msg;
+        read_frames(s);
+        return;
+    }
+
+    // each legacy message arrives in a single read
+    if(s.state == session_state::authenticating) {
+        count_request(FRAME_AUTHENTICATION);
+        authenticate(s, *msg, 0);
+        return;
+    }
+
+    string request_type, room;
+    istringstream sstream {*msg};
+    getline(sstream, request_type);
+
+    // a legacy request type is the frame type of the same request
+    bool single = request_type == AVAILABILITY_REQUEST || request_type == RESERVATION_REQUEST;
+    count_request(single ? request_type[0] : 0);
+
+    if(!getline(sstream, room)) {
+        logging::warning()<<"The main server received a request with a missing room using TCP over port "<<serverM_client<<".";
+        reply(s, 0, 0, ROOM_EMPTY);
+        return;
+    }
+
+    accept_request(s, request_type, room, 0);
+}
+
+
+bool reactor::read_frames(session& s) {
+    size_t offset = 0;
+    frame f;
+
+    try {
+        // frames beyond the in flight limit stay buffered until responses free up room
+        while(s.in_flight < MAX_IN_FLIGHT && framing::decode(s.pending_in, offset, f)) {
+            handle_frame(s, f);
+        }
+    } catch(framing_exception& fe) {
+        logging::warning()<<"The main server received a malformed frame from the client with port "<<s.sock.connected_port<<".";
+        close_client(s.sock.descriptor());
+        return false;
+    }
+
+    s.pending_in.erase(0, offset);
+    return true;
+}
+
+
+void reactor::handle_frame(session& s, const frame& f) {
+    count_request(f.type);
+
+    if(f.type == FRAME_STATS) {
+        logging::info()<<"The main server received a stats request using TCP over port "<<serverM_client<<".";
+        reply(s, FRAME_STATS, f.id, stats.report());
+        return;
+    }
+
+    if(f.type == FRAME_AUTHENTICATION) {
+        authenticate(s, f.payload, f.id);
+        return;
+    }
+
+    if(f.type == FRAME_RESUME) {
+        resume(s, f.payload, f.id);
+        return;
+    }
+
+    if(f.type == FRAME_BATCH_AVAILABILITY || f.type == FRAME_BATCH_RESERVATION) {
+        if(s.state == session_state::authenticating) {
+            logging::warning()<<"The main server received a request before authentication using TCP over port "<<serverM_client<<".";
+            reply(s, f.type, f.id, INVALID_REQUEST);
+            return;
+        }
+
+        accept_batch(s, f);
+        return;
+    }
+
+    if(f.type == FRAME_GROUP_RESERVATION) {
+        if(s.state == session_state::authenticating) {
+            logging::warning()<<"The main server received a request before authentication using TCP over port "<<serverM_client<<".";
+            reply(s, f.type, f.id, INVALID_REQUEST);
+            return;
+        }
+
+        accept_group(s, f);
+        return;
+    }
+
+    string request_type;
+    if(f.type == FRAME_AVAILABILITY) request_type = AVAILABILITY_REQUEST;
+    else if(f.type == FRAME_RESERVATION) request_type = RESERVATION_REQUEST;
+    else {
+        logging::warning()<<"The main server received an invalid request type using TCP over port "<<serverM_client<<".";
+        reply(s, f.type, f.id, INVALID_REQUEST);
+        return;
+    }
+
+    if(s.state == session_state::authenticating) {
+        logging::warning()<<"The main server received a request before authentication using TCP over port "<<serverM_client<<".";
+        reply(s, f.type, f.id, INVALID_REQUEST);
+        return;
+    }
+
+    if(f.payload.empty()) {
+        logging::warning()<<"The main server received a request with a missing room using TCP over port "<<serverM_client<<".";
+        reply(s, f.type, f.id, ROOM_EMPTY);
+        return;
+    }
+
+    accept_request(s, request_type, f.payload, f.id);
+}
+
+
+void reactor::read_backend() {
+    while(optional<msg_port> response = server_sock.try_recv_info_from()) {
+        // a backend server that restarted sends its room status again before serving, and waits on the acknowledgements
+        if(coord != nullptr && status_receiver::is_chunk(response->msg)) {
+            try {
+                coord->receive(*response);
+            } catch(socket_exception& se) {
+                // an acknowledgement the socket could not take is sent again with the chunk the backend server resends
+                logging::error()<<se.what();
+            }
+            continue;
+        }
+
+        // the first line of a response carries the id of the request it answers
+        size_t id_end = response->msg.find('\n');
+        uint32_t request_id = 0;
+        bool tagged = response->msg.compare(0, 1, REQUEST_ID) == 0 && id_end != string::npos;
+
+        if(tagged) {
+            try {
+                request_id = stoul(response->msg.substr(1, id_end - 1));
+            } catch(logic_error&) {
+                tagged = false;
+            }
+        }
+
+        unordered_map<uint32_t, backend_waiter>::iterator found = pending.end();
+        if(tagged) found = pending.find(request_id);
+
+        // stale responses to expired requests are dropped along with unexpected ones,
+        // besides the answers to the registrations and rebalancing requests of the coordinator
+        if(found == pending.end() || found->second.port != response->port) {
+            if(coord != nullptr && coord->receive(*response)) continue;
+
+            logging::warning()<<"The main server has received a response from an unexpected Server with port "<<response->port<<".";
+            continue;
+        }
+
+        backend_waiter w = std::move(found->second);
+        pending.erase(found);
+        release(w.port);
+        response->msg.erase(0, id_end + 1);
+        stats.record_since(BACKEND_STAGE, w.sent);
+
+        if(w.batch_id != 0) {
+            batch_response(w, response->msg);
+            continue;
+        }
+
+        if(w.group_id != 0) {
+            group_response(w, response->msg);
+            continue;
+        }
+
+        // the client may have left while its request was in flight
+        unordered_map<int, session>::iterator client = sessions.find(w.fd);
+        if(client == sessions.end() || client->second.id != w.session_id) continue;
+
+        // a room that moved out of the backend server is asked of the backend server it moved to
+        if(response->msg.compare(0, response->msg.find('\n'), ROOM_MOVED_OUT) == 0) {
+            logging::info()<<"The main server found Room "<<w.room<<" moved out of Server "<<backends.name(w.port)<<".";
+            reroute(std::move(w), false);
+            continue;
+        }
+
+        session& s = client->second;
+
+        try {
+            if(w.request_type == AVAILABILITY_REQUEST) availability_response(s, w, *response);
+            else reservation_response(s, w, *response);
+
+            request_done(s);
+        } catch(socket_exception& se) {
+            logging::error()<<se.what();
+            close_client(w.fd);
+        }
+    }
+}
+
+
+bool reactor::request_done(session& s) {
+    if(s.protocol == session_protocol::framed) {
+        s.in_flight--;
+
+        // frames held back while the session had too many requests outstanding can now be handled
+        if(!s.pending_in.empty() && !read_frames(s)) return false;
+    } else {
+        s.state = session_state::requesting;
+    }
+
+    watch(s);
+    return true;
+}
+
+
+void reactor::reply(session& s, uint8_t frame_type, uint32_t frame_id, const string& code) {
+    count_reply(frame_type, code);
+
+    if(s.protocol != session_protocol::framed) {
+        send_client(s, code);
+        return;
+    }
+
+    string out;
+    framing::encode(out, frame_type, frame_id, code);
+    send_client(s, out);
+}
+
+
+void reactor::count_request(uint8_t frame_type) {
+    switch(frame_type) {
+        case FRAME_AUTHENTICATION: stats.count(AUTHENTICATION_COUNTER); break;
+        case FRAME_RESUME: stats.count(RESUME_COUNTER); break;
+        case FRAME_AVAILABILITY: stats.count(AVAILABILITY_COUNTER); break;
+        case FRAME_RESERVATION: stats.count(RESERVATION_COUNTER); break;
+        case FRAME_BATCH_AVAILABILITY: stats.count(BATCH_AVAILABILITY_COUNTER); break;
+        case FRAME_BATCH_RESERVATION: stats.count(BATCH_RESERVATION_COUNTER); break;
+        case FRAME_GROUP_RESERVATION: stats.count(GROUP_RESERVATION_COUNTER); break;
+        case FRAME_STATS: stats.count(STATS_COUNTER); break;
+        default: stats.count(INVALID_COUNTER);
+    }
+}
+
+
+void reactor::count_reply(uint8_t frame_type, const string& code) {
+    if(frame_type == FRAME_STATS || code.empty()) return;
+
+    // an authentication reply is a single code, possibly followed by a session token
+    if(frame_type == FRAME_AUTHENTICATION || frame_type == FRAME_RESUME) {
+        size_t value = code[0] - '0';
+        if(value < size(AUTHORIZATION_CODE_NAMES)) stats.count(AUTHORIZATION_COUNTERS + value);
+        return;
+    }
+
+    // batch and group replies carry a code per room, one per line
+    size_t line = 0;
+    while(line < code.size()) {
+        size_t value = code[line] - '0';
+        if(value < size(RESPONSE_CODE_NAMES)) stats.count(RESPONSE_COUNTERS + value);
+
+        size_t end = code.find('\n', line);
+        if(end == string::npos) break;
+        line = end + 1;
+    }
+}
+
+
+void reactor::send_client(session& s, const string& msg) {
+    if(s.pending_out.empty()) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        size_t sent = s.sock.try_send_info(msg.data(), msg.size());
+        stats.record_since(SEND_STAGE, start);
+        if(sent < msg.size()) s.pending_out.append(msg, sent, string::npos);
+    } else {
+        // preserve ordering behind information that is already queued
+        s.pending_out += msg;
+    }
+
+    watch(s);
+}
+
+
+void reactor::flush_client(session& s) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    size_t sent = s.sock.try_send_info(s.pending_out.data(), s.pending_out.size());
+    stats.record_since(SEND_STAGE, start);
+    s.pending_out.erase(0, sent);
+
+    watch(s);
+}
+
+
+void reactor::watch(session& s) {
+    uint32_t events = 0;
+
+    if(s.protocol == session_protocol::framed) {
+        if(s.in_flight < MAX_IN_FLIGHT) events |= EPOLLIN;
+    } else if(s.state != session_state::waiting) {
+        events |= EPOLLIN;
+    }
+
+    if(!s.pending_out.empty()) events |= EPOLLOUT;
+
+    loop.modify(s.sock.descriptor(), events);
+}
+
+
+void reactor::close_client(int fd) {
+    unordered_map<int, session>::iterator found = sessions.find(fd);
+    if(found == sessions.end()) return;
+
+    // closing the socket removes it from the epoll interest list
+    sessions.erase(found);
+}
+
+
+void reactor::authenticate(session& s, const string& auth, uint32_t frame_id) {
+    string password;
+    istringstream sstream {auth};
+
+    getline(sstream, s.username);
+
+    if(getline(sstream, password)) {
+        // a password implies a member request
+        logging::info()<<"The main server received the authentication for "<<s.username<<" using TCP over port "<<serverM_client<<".";
+
+        // lookup the user info for the valid user credentials
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        optional<string_view> saved_password = user_info.find(s.username);
+        bool valid = saved_password && *saved_password == password;
+        stats.record_since(CREDENTIALS_STAGE, start);
+
+        if(saved_password) {
+            if(valid) {
+                admit(s, true);
+                grant(s, frame_id, VALID_MEMBER);
+            } else {
+                reply(s, FRAME_AUTHENTICATION, frame_id, INVALID_PASSWORD);
+            }
+        } else {
+            reply(s, FRAME_AUTHENTICATION, frame_id, INVALID_USER);
+        }
+        logging::info()<<"The main server sent the authentication result to the client.";
+    } else {
+        // an empty password implies a guest request
+        logging::info()<<"The main server has received the guest request for "<<s.username<<" using TCP over port "<<serverM_client<<".";
+        admit(s, false);
+        logging::info()<<"The main server accepts "<<s.username<<" as a guest.";
+
+        grant(s, frame_id, VALID_GUEST);
+
+        logging::info()<<"The main server sent the guest response to the client.";
+    }
+}
+
+
+void reactor::admit(session& s, bool member) {
+    // a session authenticating again is only timed the first time
+    if(s.state == session_state::authenticating) stats.record_since(AUTHENTICATION_STAGE, s.accepted);
+
+    s.member = member;
+    s.state = session_state::requesting;
+}
+
+
+void reactor::grant(session& s, uint32_t frame_id, const string& code) {
+    // legacy clients expect the bare code, and have no way to send a token back
+    if(s.protocol != session_protocol::framed) {
+        reply(s, FRAME_AUTHENTICATION, frame_id, code);
+        return;
+    }
+
+    string token = tokens.issue(s.username, s.member);
+    reply(s, FRAME_AUTHENTICATION, frame_id, token.empty() ? code : code + '\n' + token);
+}
+
+
+void reactor::resume(session& s, const string& token, uint32_t frame_id) {
+    logging::info()<<"The main server received a session token using TCP over port "<<serverM_client<<".";
+
+    optional<token_grant> granted = tokens.redeem(token);
+    if(!granted) {
+        logging::warning()<<"The main server rejected an unknown or expired session token.";
+        reply(s, FRAME_RESUME, frame_id, INVALID_TOKEN);
+        return;
+    }
+
+    s.username = std::move(granted->username);
+    admit(s, granted->member);
+    logging::info()<<"The main server resumed the session of "<<(s.member ? "member " : "guest ")<<s.username<<".";
+
+    reply(s, FRAME_RESUME, frame_id, s.member ? VALID_MEMBER : VALID_GUEST);
+}
+
+
+void reactor::accept_request(session& s, const string& request_type, const string& room, uint32_t frame_id) {
+    if(request_type == AVAILABILITY_REQUEST) {
+        logging::info()<<"The main server has received the availability request on Room "<<room<<" from "<<s.username<<" using TCP over port "<<serverM_client<<".";
+        if(!local_availability(s, room, frame_id)) forward_request(s, request_type, room, FRAME_AVAILABILITY, frame_id);
+    } else if(request_type == RESERVATION_REQUEST) {
+        logging::info()<<"The main server has received the reservation request on Room "<<room<<" from "<<s.username<<" using TCP over port "<<serverM_client<<".";
+
+        // a guest cannot make a reservation
+        if(!s.member) {
+            logging::info()<<s.username<<" cannot make a reservation.";
+            reply(s, FRAME_RESERVATION, frame_id, USER_NOT_MEMBER);
+
+            logging::info()<<"The main server sent the error message to the client.";
+            return;
+        }
+
+        forward_request(s, request_type, room, FRAME_RESERVATION, frame_id);
+    } else {
+        logging::warning()<<"The main server received an invalid request type using TCP over port "<<serverM_client<<".";
+        reply(s, 0, frame_id, INVALID_REQUEST);
+    }
+}
+
+
+bool reactor::local_availability(session& s, const string& room, uint32_t frame_id) {
+    // room codes the table cannot hold are left for their backend server to answer
+    if(!room_table::storable(room)) return false;
+
+    const room_slot* slot = room_status.find(room);
+
+    if(slot == nullptr) {
+        logging::info()<<"The main server found no Room "<<room<<" in the room status.";
+        reply(s, FRAME_AVAILABILITY, frame_id, ROOM_NOT_FOUND);
+    } else if(slot->count.load(memory_order_relaxed) > 0) {
+        logging::info()<<"The main server found Room "<<room<<" available in the room status.";
+        reply(s, FRAME_AVAILABILITY, frame_id, ROOM_AVAILABLE);
+    } else {
+        logging::info()<<"The main server found Room "<<room<<" not available in the room status.";
+        reply(s, FRAME_AVAILABILITY, frame_id, ROOM_NOT_AVAILABLE);
+    }
+
+    logging::info()<<"The main server sent the availability information to the client.";
+    return true;
+}
+
+
+int reactor::route(const string& room) const {
+    // every room of every backend server is in the table, so a room missing from it does not exist
+    const room_slot* slot = room_status.find(room);
+    if(slot == nullptr) return -1;
+
+    return slot->owner.load(memory_order_acquire);
+}
+
+
+void reactor::forward_request(session& s, const string& request_type, const string& room, uint8_t frame_type, uint32_t frame_id) {
+    int port = route(room);
+
+    if(port == -1) {
+        logging::warning()<<"The main server found no corresponding Server for room "<<room<<".";
+        reply(s, frame_type, frame_id, ROOM_NOT_FOUND);
+
+        if(request_type == AVAILABILITY_REQUEST) logging::info()<<"The main server sent the availability information to the client.";
+        else logging::info()<<"The main server sent the reservation result to the client.";
+        return;
+    }
+
+    // tag the request with an id, so the response is matched to this client regardless of arrival order
+    uint32_t request_id = next_request_id++;
+    backend_waiter w {s.id, s.sock.descriptor(), port, request_type, room, frame_type, frame_id};
+    w.request = REQUEST_ID + to_string(request_id) + '\n' + request_type + '\n' + room;
+
+    send_backend(request_id, std::move(w));
+    logging::info()<<"The main server sent a request to Server "<<backends.name(port)<<".";
+
+    // a legacy client is not read from until the backend server responds,
+    // a framed client may keep sending requests up to the in flight limit
+    if(s.protocol == session_protocol::framed) s.in_flight++;
+    else s.state = session_state::waiting;
+
+    watch(s);
+}
+
+
+void reactor::accept_batch(session& s, const frame& f) {
+    const bool reservation = f.type == FRAME_BATCH_RESERVATION;
+
+    batch_request b {s.id, s.sock.descriptor(), f.type, f.id, {}, {}};
+
+    string room;
+    istringstream sstream {f.payload};
+    while(getline(sstream, room)) b.rooms.push_back(room);
+
+    if(b.rooms.empty() || b.rooms.size() > MAX_BATCH_ROOMS) {
+        logging::warning()<<"The main server received a batch request of invalid size using TCP over port "<<serverM_client<<".";
+        reply(s, f.type, f.id, INVALID_REQUEST);
+        return;
+    }
+
+    logging::info()<<"The main server has received the batch "<<(reservation ? "reservation" : "availability")<<" request on "<<b.rooms.size()<<" rooms from "<<s.username<<" using TCP over port "<<serverM_client<<".";
+
+    b.results.resize(b.rooms.size());
+
+    // rooms answered locally are filled in directly, the others are grouped by their backend server
+    map<int, vector<size_t>> routed {};
+    for(size_t i = 0; i < b.rooms.size(); i++) {
+        const string& r = b.rooms[i];
+
+        if(r == "") {
+            b.results[i] = ROOM_EMPTY;
+        } else if(reservation && !s.member) {
+            b.results[i] = USER_NOT_MEMBER;
+        } else if(!reservation && room_table::storable(r)) {
+            const room_slot* slot = room_status.find(r);
+            if(slot == nullptr) b.results[i] = ROOM_NOT_FOUND;
+            else b.results[i] = slot->count.load(memory_order_relaxed) > 0 ? ROOM_AVAILABLE : ROOM_NOT_AVAILABLE;
+        } else {
+            int port = route(r);
+            if(port == -1) b.results[i] = ROOM_NOT_FOUND;
+            else routed[port].push_back(i);
+        }
+    }
+
+    if(reservation && !s.member) logging::info()<<s.username<<" cannot make a reservation.";
+
+    if(routed.empty()) {
+        string out;
+        for(const string& r : b.results) out += r + '\n';
+        reply(s, f.type, f.id, out);
+
+        logging::info()<<"The main server sent the batch result to the client.";
+        return;
+    }
+
+    uint32_t batch_id = next_batch_id++;
+    if(next_batch_id == 0) next_batch_id = 1;
+
+    // one datagram per backend server, split further only if the rooms would not fit a single datagram
+    for(const pair<const int, vector<size_t>>& part : routed) send_batch(batch_id, b, part.first, part.second, 0);
+
+    batches.emplace(batch_id, std::move(b));
+
+    s.in_flight++;
+    watch(s);
+}
+
+
+void reactor::send_batch(uint32_t batch_id, batch_request& b, int port, const vector<size_t>& indices, int reroutes) {
+    const string request_type = b.frame_type == FRAME_BATCH_RESERVATION ? BATCH_RESERVATION_REQUEST : BATCH_AVAILABILITY_REQUEST;
+
+    size_t i = 0;
+    while(i < indices.size()) {
+        uint32_t request_id = next_request_id++;
+        string request = REQUEST_ID + to_string(request_id) + '\n' + request_type + '\n';
+        vector<size_t> part {};
+
+        for(; i < indices.size(); i++) {
+            const string& r = b.rooms[indices[i]];
+            if(!part.empty() && request.size() + r.size() + 1 >= Socket::MAXDATAGRAMSIZE / 2) break;
+
+            request += r + '\n';
+            part.push_back(indices[i]);
+        }
+
+        backend_waiter w {b.session_id, b.fd, port, request_type, "", b.frame_type, b.frame_id, batch_id, std::move(part)};
+        w.reroutes = reroutes;
+        w.request = std::move(request);
+
+        send_backend(request_id, std::move(w));
+        logging::info()<<"The main server sent a batch request to Server "<<backends.name(port)<<".";
+        b.remaining++;
+    }
+}
+
+
+void reactor::batch_response(const backend_waiter& w, const string& response) {
+    unordered_map<uint32_t, batch_request>::iterator found = batches.find(w.batch_id);
+    if(found == batches.end()) return;
+
+    batch_request& b = found->second;
+    const char server_name = backends.name(w.port);
+
+    // rooms that moved out of the backend server are sent again to the backend servers they moved to
+    vector<size_t> moved {};
+
+    if(response == "") {
+        for(size_t i : w.indices) b.results[i] = BACKEND_TIMEOUT;
+    } else {
+        logging::info()<<"The main server received the batch response from Server "<<server_name<<" using UDP over port "<<server_port<<".";
+
+        string line;
+        istringstream sstream {response};
+        for(size_t i : w.indices) {
+            if(!getline(sstream, line) || line == "") {
+                b.results[i] = ROOM_NOT_FOUND;
+                continue;
+            }
+
+            // a successful reservation carries the updated count after a comma
+            size_t comma = line.find(',');
+            b.results[i] = line.substr(0, comma);
+
+            if(b.results[i] == ROOM_MOVED_OUT) {
+                moved.push_back(i);
+                continue;
+            }
+
+            if(comma != string::npos && b.results[i] == ROOM_AVAILABLE) {
+                room_slot* slot = room_status.find(b.rooms[i]);
+                if(slot != nullptr) slot->count.store(atoi(line.c_str() + comma + 1), memory_order_relaxed);
+            }
+        }
+    }
+
+    if(!moved.empty()) {
+        backend_waiter part = w;
+        part.indices = std::move(moved);
+        reroute(std::move(part), false);
+    }
+
+    if(--b.remaining > 0) return;
+
+    finish_batch(w.batch_id);
+}
+
+
+void reactor::finish_batch(uint32_t batch_id) {
+    unordered_map<uint32_t, batch_request>::iterator found = batches.find(batch_id);
+    batch_request done = std::move(found->second);
+    batches.erase(found);
+
+    // the client may have left while the batch was in flight
+    unordered_map<int, session>::iterator client = sessions.find(done.fd);
+    if(client == sessions.end() || client->second.id != done.session_id) return;
+
+    session& s = client->second;
+
+    try {
+        string out;
+        for(const string& r : done.results) out += r + '\n';
+        reply(s, done.frame_type, done.frame_id, out);
+
+        logging::info()<<"The main server sent the batch result to the client.";
+        request_done(s);
+    } catch(socket_exception& se) {
+        logging::error()<<se.what();
+        close_client(done.fd);
+    }
+}
+
+
+void reactor::accept_group(session& s, const frame& f) {
+    group_request g {s.id, s.sock.descriptor(), f.id, {}, {}};
+
+    string room;
+    istringstream sstream {f.payload};
+    while(getline(sstream, room)) g.rooms.push_back(room);
+
+    if(g.rooms.empty() || g.rooms.size() > MAX_BATCH_ROOMS) {
+        logging::warning()<<"The main server received a group reservation of invalid size using TCP over port "<<serverM_client<<".";
+        reply(s, f.type, f.id, INVALID_REQUEST);
+        return;
+    }
+
+    logging::info()<<"The main server has received the group reservation request on "<<g.rooms.size()<<" rooms from "<<s.username<<" using TCP over port "<<serverM_client<<".";
+
+    // a guest cannot make a reservation
+    if(!s.member) {
+        logging::info()<<s.username<<" cannot make a reservation.";
+        reply(s, f.type, f.id, USER_NOT_MEMBER);
+
+        logging::info()<<"The main server sent the error message to the client.";
+        return;
+    }
+
+    if(!route_group(g)) {
+        string out = string {ROOM_NOT_FOUND} + '\n';
+        for(const string& r : g.results) out += r + '\n';
+        reply(s, f.type, f.id, out);
+
+        logging::info()<<"The main server sent the group reservation result to the client.";
+        return;
+    }
+
+    prepare_group(std::move(g));
+
+    s.in_flight++;
+    watch(s);
+}
+
+
+bool reactor::route_group(group_request& g) {
+    g.results.assign(g.rooms.size(), ROOM_AVAILABLE);
+    g.participants.clear();
+
+    // nothing is held if any room has no backend server
+    bool routable = true;
+    for(size_t i = 0; i < g.rooms.size(); i++) {
+        int port = route(g.rooms[i]);
+
+        if(port == -1) {
+            g.results[i] = g.rooms[i] == "" ? ROOM_EMPTY : ROOM_NOT_FOUND;
+            routable = false;
+        } else {
+            g.participants[port].push_back(i);
+        }
+    }
+
+    if(!routable) logging::warning()<<"The main server found no corresponding Server for a room of the group reservation.";
+    return routable;
+}
+
+
+void reactor::prepare_group(group_request&& g) {
+    uint32_t group_id = next_group_id++;
+    if(next_group_id == 0) next_group_id = 1;
+
+    group_request& stored = groups.emplace(group_id, std::move(g)).first->second;
+    for(const pair<const int, vector<size_t>>& part : stored.participants) {
+        send_group_message(group_id, stored, part.first, PREPARE_REQUEST, 0);
+    }
+}
+
+
+void reactor::restart_group(uint32_t group_id) {
+    unordered_map<uint32_t, group_request>::iterator found = groups.find(group_id);
+    if(found == groups.end()) return;
+
+    group_request g = std::move(found->second);
+    groups.erase(found);
+
+    // a client that left while the group waited books nothing
+    unordered_map<int, session>::iterator client = sessions.find(g.fd);
+    if(client == sessions.end() || client->second.id != g.session_id) return;
+
+    // the backend servers have decided the aborted transaction, so the group is prepared under a new one
+    g.phase = group_phase::preparing;
+    g.prepared = true;
+    g.uncertain = false;
+    g.moved = false;
+    g.remaining = 0;
+    g.reroutes++;
+
+    if(!route_group(g)) {
+        reply_group(g, ROOM_NOT_FOUND);
+        return;
+    }
+
+    logging::info()<<"The main server is sending the group reservation of "<<g.rooms.size()<<" rooms again, after a room moved.";
+    prepare_group(std::move(g));
+}
+
+
+void reactor::send_group_message(uint32_t group_id, group_request& g, int port, const string& request_type, int attempt) {
+    const vector<size_t>& indices = g.participants[port];
+
+    uint32_t request_id = next_request_id++;
+    string request = REQUEST_ID + to_string(request_id) + '\n' + request_type + '\n' + to_string(group_id) + '\n';
+    if(request_type == PREPARE_REQUEST) {
+        for(size_t i : indices) request += g.rooms[i] + '\n';
+    }
+
+    backend_waiter w {g.session_id, g.fd, port, request_type, "", FRAME_GROUP_RESERVATION, g.frame_id};
+    w.group_id = group_id;
+    w.attempt = attempt;
+    w.indices = indices;
+    w.request = std::move(request);
+
+    send_backend(request_id, std::move(w));
+
+    if(request_type == PREPARE_REQUEST) logging::info()<<"The main server sent a group reservation request to Server "<<backends.name(port)<<".";
+    else if(request_type == COMMIT_REQUEST) logging::info()<<"The main server sent a group reservation commit to Server "<<backends.name(port)<<".";
+    else logging::info()<<"The main server sent a group reservation abort to Server "<<backends.name(port)<<".";
+
+    // a resent message replaces the one that timed out
+    if(attempt == 0) g.remaining++;
+}
+
+
+void reactor::group_response(const backend_waiter& w, const string& response) {
+    unordered_map<uint32_t, group_request>::iterator found = groups.find(w.group_id);
+    if(found == groups.end()) return;
+
+    group_request& g = found->second;
+    const char server_name = backends.name(w.port);
+    string line;
+    istringstream sstream {response};
+
+    if(g.phase == group_phase::preparing) {
+        if(response == "") {
+            for(size_t i : w.indices) g.results[i] = BACKEND_TIMEOUT;
+            g.prepared = false;
+        } else {
+            logging::info()<<"The main server received the group reservation response from Server "<<server_name<<" using UDP over port "<<server_port<<".";
+
+            for(size_t i : w.indices) {
+                if(!getline(sstream, line) || line == "") line = ROOM_NOT_FOUND;
+                g.results[i] = line;
+                if(line != ROOM_AVAILABLE) g.prepared = false;
+                if(line == ROOM_MOVED_OUT) g.moved = true;
+            }
+        }
+
+        if(--g.remaining > 0) return;
+
+        // every backend server has answered, decide the outcome of the group
+        // a backend server that timed out may still hold its rooms, so it is sent the abort as well
+        g.phase = g.prepared ? group_phase::committing : group_phase::aborting;
+        const string decision = g.prepared ? COMMIT_REQUEST : ABORT_REQUEST;
+
+        for(const pair<const int, vector<size_t>>& part : g.participants) {
+            send_group_message(w.group_id, g, part.first, decision, 0);
+        }
+        return;
+    }
+
+    if(response == "") {
+        // the decision is final, so it is repeated until acknowledged
+        if(w.attempt + 1 < MAX_DECISION_ATTEMPTS) {
+            send_group_message(w.group_id, g, w.port, w.request_type, w.attempt + 1);
+            return;
+        }
+
+        if(g.phase == group_phase::committing) g.uncertain = true;
+    } else if(g.phase == group_phase::committing) {
+        // a commit acknowledgement carries the updated count of each room
+        getline(sstream, line);
+        if(line != ROOM_AVAILABLE) g.uncertain = true;
+
+        while(getline(sstream, line)) {
+            size_t comma = line.find(',');
+            if(comma == string::npos) continue;
+
+            room_slot* slot = room_status.find(string_view {line}.substr(0, comma));
+            if(slot != nullptr) slot->count.store(atoi(line.c_str() + comma + 1), memory_order_relaxed);
+        }
+    }
+
+    if(--g.remaining > 0) return;
+
+    finish_group(w.group_id);
+}
+
+
+void reactor::finish_group(uint32_t group_id) {
+    unordered_map<uint32_t, group_request>::iterator found = groups.find(group_id);
+
+    // a group that found a room moved out is prepared again once its holds are released, routed to where its rooms went
+    if(found->second.phase == group_phase::aborting && found->second.moved) {
+        if(found->second.reroutes < MAX_REROUTES) {
+            backend_waiter later {found->second.session_id, found->second.fd, -1, PREPARE_REQUEST, "", FRAME_GROUP_RESERVATION, found->second.frame_id};
+            later.group_id = group_id;
+            rerouted.emplace_back(chrono::steady_clock::now() + REROUTE_DELAY, std::move(later));
+            return;
+        }
+
+        // a room that never found its new backend server fails the group like a backend server that never answered
+        replace(found->second.results.begin(), found->second.results.end(), string {ROOM_MOVED_OUT}, string {BACKEND_TIMEOUT});
+    }
+
+    group_request g = std::move(found->second);
+    groups.erase(found);
+
+    string outcome;
+    if(g.phase == group_phase::committing) {
+        outcome = g.uncertain ? BACKEND_TIMEOUT : ROOM_AVAILABLE;
+        if(g.uncertain) logging::warning()<<"The main server could not confirm the group reservation with every Server.";
+        else logging::info()<<"The main server committed the group reservation of "<<g.rooms.size()<<" rooms.";
+    } else {
+        // the group fails with the first reason a room could not be held
+        outcome = *find_if(g.results.begin(), g.results.end(), [](const string& r) { return r != ROOM_AVAILABLE; });
+        logging::info()<<"The main server aborted the group reservation of "<<g.rooms.size()<<" rooms.";
+    }
+
+    reply_group(g, outcome);
+}
+
+
+void reactor::reply_group(const group_request& g, const string& outcome) {
+    // the client may have left while the group was in progress
+    unordered_map<int, session>::iterator client = sessions.find(g.fd);
+    if(client == sessions.end() || client->second.id != g.session_id) return;
+
+    session& s = client->second;
+
+    try {
+        string out = outcome + '\n';
+        for(const string& r : g.results) out += r + '\n';
+        reply(s, FRAME_GROUP_RESERVATION, g.frame_id, out);
+
+        logging::info()<<"The main server sent the group reservation result to the client.";
+        request_done(s);
+    } catch(socket_exception& se) {
+        logging::error()<<se.what();
+        close_client(g.fd);
+    }
+}
+
+
+void reactor::availability_response(session& s, const backend_waiter& w, const msg_port& response) {
+    const char server_name = backends.name(response.port);
+    logging::info()<<"The main server received the response from Server "<<server_name<<" using UDP over port "<<server_port<<".";
+
+    if(response.msg != "") {
+        reply(s, w.frame_type, w.frame_id, response.msg);
+    } else {
+        logging::warning()<<"The backend Server "<<server_name<<" has sent an empty response.";
+        reply(s, w.frame_type, w.frame_id, ROOM_NOT_FOUND);
+    }
+
+    logging::info()<<"The main server sent the availability information to the client.";
+}
+
+
+void reactor::reservation_response(session& s, const backend_waiter& w, const msg_port& response) {
+    const char server_name = backends.name(response.port);
+
+    string response_code;
+    istringstream sstream {response.msg};
+    getline(sstream, response_code);
+
+    // if a successful reservation is made, update the room status
+    if(response_code == ROOM_AVAILABLE) {
+        logging::info()<<"The main server received the response and the updated room status from Server "<<server_name<<" using UDP over port "<<server_port<<".";
+
+        int status;
+        if(!(sstream >> status)) status = 0;
+
+        // the backend server reports the count after the reservation, keeping every reactor's view current
+        room_slot* slot = room_status.find(w.room);
+        if(slot != nullptr) slot->count.store(status, memory_order_relaxed);
+        logging::info()<<"The room status of Room "<<w.room<<" has been updated.";
+
+        reply(s, w.frame_type, w.frame_id, response_code);
+    } else {
+        logging::info()<<"The main server received the response from Server "<<server_name<<" using UDP over port "<<server_port<<".";
+
+        if(response_code != "") {
+            reply(s, w.frame_type, w.frame_id, response_code);
+        } else {
+            logging::warning()<<"The backend Server "<<server_name<<" has sent an empty response.";
+            reply(s, w.frame_type, w.frame_id, ROOM_NOT_FOUND);
+        }
+    }
+
+    logging::info()<<"The main server sent the reservation result to the client.";
+}
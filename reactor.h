@@ -0,0 +1,429 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "backend_directory.h"
+#include "coordinator.h"
+#include "credential_index.h"
+#include "event_loop.h"
+#include "framing.h"
+#include "room_table.h"
+#include "socket.h"
+#include "stats.h"
+#include "token_table.h"
+
+// the stage a client connection has reached within the main server
+enum class session_state { authenticating, requesting, waiting };
+
+// the protocol a client speaks, decided by the first bytes it sends
+// legacy clients send one newline separated message at a time, framed clients may pipeline requests
+enum class session_protocol { unknown, legacy, framed };
+
+/*
+ * struct session tracks a single client connection driven by the reactor
+ */
+struct session {
+    Socket sock;
+
+    // unique identity, since file descriptors are reused once closed
+    uint64_t id;
+
+    session_state state {session_state::authenticating};
+    session_protocol protocol {session_protocol::unknown};
+    bool member {false};
+    std::string username {};
+
+    // time the connection was accepted, until it is first authenticated
+    std::chrono::steady_clock::time_point accepted {std::chrono::steady_clock::now()};
+
+    // received bytes not yet forming a complete frame
+    std::string pending_in {};
+
+    // information not yet accepted by the socket send buffer
+    std::string pending_out {};
+
+    // framed requests forwarded to a backend server and not yet answered
+    unsigned int in_flight {0};
+};
+
+// a client request forwarded to a backend server, waiting for its response
+struct backend_waiter {
+    uint64_t session_id;
+    int fd;
+
+    // port of the backend server the request was sent to
+    int port;
+
+    std::string request_type;
+    std::string room;
+
+    // type and id of the client frame to answer, for framed sessions
+    uint8_t frame_type;
+    uint32_t frame_id;
+
+    // for a part of a batch request, the batch it belongs to and the positions of its rooms in the batch
+    uint32_t batch_id {0};
+    std::vector<size_t> indices {};
+
+    // for a message of a group reservation, the group it belongs to
+    uint32_t group_id {0};
+
+    // times the request was sent before, a request sent again keeps its id so the backend server answers it only once
+    // a message of a group reservation sent again is a new request of its own
+    int attempt {0};
+
+    // times the request was sent again or waited on after its room moved out of the backend server it was sent to
+    int reroutes {0};
+
+    // time the request was first sent to the backend server
+    std::chrono::steady_clock::time_point sent {};
+
+    // datagram of the request, kept until answered so it can be sent again
+    std::string request {};
+};
+
+// the requests of a reactor to a single backend server
+// only so many are in flight at once, so a burst of client requests never overruns the receive buffer of the backend server
+struct backend_channel {
+    // requests sent and not yet answered or expired
+    unsigned int in_flight {0};
+
+    // ids of the requests waiting for one in flight to finish, in the order they were made
+    std::deque<uint32_t> queued {};
+};
+
+// a batch request from a client, split into one request per backend server
+struct batch_request {
+    uint64_t session_id;
+    int fd;
+
+    uint8_t frame_type;
+    uint32_t frame_id;
+
+    std::vector<std::string> rooms;
+
+    // response code of each room, in the order of the request
+    std::vector<std::string> results;
+
+    // parts still waiting on a backend server
+    unsigned int remaining {0};
+};
+
+// the phase of a group reservation
+// rooms are first held by every backend server involved, then the holds are committed if all succeeded, or aborted
+enum class group_phase { preparing, committing, aborting };
+
+// a group reservation from a client, booking all of its rooms across backend servers or none of them
+struct group_request {
+    uint64_t session_id;
+    int fd;
+    uint32_t frame_id;
+
+    std::vector<std::string> rooms;
+
+    // response code of each room, in the order of the request
+    std::vector<std::string> results;
+
+    // positions of the rooms owned by each backend server involved
+    std::map<int, std::vector<size_t>> participants {};
+
+    group_phase phase {group_phase::preparing};
+
+    // whether every backend server has held its rooms so far
+    bool prepared {true};
+
+    // whether a backend server failed to acknowledge the commit
+    bool uncertain {false};
+
+    // whether a room moved out of the backend server asked to hold it, so the group is prepared again once aborted,
+    // and the times it was prepared again
+    bool moved {false};
+    int reroutes {0};
+
+    // messages of the current phase still waiting on a backend server
+    unsigned int remaining {0};
+};
+
+/*
+ * class reactor drives many non-blocking client connections from a single thread,
+ * running authentication and requests as per-connection state machines
+ */
+class reactor {
+private:
+    event_loop loop;
+
+    // client facing listening socket, absent when the reactor only serves adopted connections
+    Socket* listener;
+
+    // backend facing UDP socket, and the port it is bound to
+    Socket& server_sock;
+    int server_port;
+
+    // duties of the backend port of the main server, carried out by the reactor whose socket is that port,
+    // absent for the reactors of worker threads and forked children, whose sockets never receive a transfer
+    coordinator* coord;
+
+    // names of the backend servers, shared by every reactor
+    const backend_directory& backends;
+
+    // table of each room's backend server and count, shared by every reactor
+    // a room is routed to the backend server its slot names, which changes as rooms are moved between backend servers
+    room_table& room_status;
+
+    // index between usernames and corresponding passwords
+    const credential_index& user_info;
+
+    // session tokens issued to authenticated clients, shared by every reactor
+    token_table& tokens;
+
+    // counters and stage latencies, shared by every reactor
+    stats_registry& stats;
+
+    // whether the listener is left unwatched after accepting failed, such as when out of file descriptors,
+    // and the time it is watched again
+    bool accept_paused {false};
+    std::chrono::steady_clock::time_point accept_resume {};
+
+    // open connections, keyed by their file descriptors
+    std::unordered_map<int, session> sessions;
+    uint64_t next_session_id {0};
+
+    // requests awaiting a backend response, keyed by the request id sent along with them
+    // request ids are shared with everything else sending requests from the backend facing socket
+    std::unordered_map<uint32_t, backend_waiter> pending;
+    uint32_t& next_request_id;
+
+    // requests in flight and queued for each backend server, keyed by its port
+    std::unordered_map<int, backend_channel> channels;
+
+    // batch requests with parts waiting on backend servers, keyed by batch id, which starts at 1
+    std::unordered_map<uint32_t, batch_request> batches;
+    uint32_t next_batch_id {1};
+
+    // group reservations in progress, keyed by group id, which is also their transaction id with the backend servers
+    std::unordered_map<uint32_t, group_request> groups;
+    uint32_t next_group_id {1};
+
+    // request ids in the order they were sent, along with the time each one expires
+    std::deque<std::pair<std::chrono::steady_clock::time_point, uint32_t>> expiry;
+
+    // requests and group reservations whose rooms moved out of the backend server they were sent to,
+    // before the rooms were adopted by another, along with the time each one is sent again
+    std::deque<std::pair<std::chrono::steady_clock::time_point, backend_waiter>> rerouted;
+
+    // time the listener is left unwatched after accepting failed, so pending connections wait in the backlog
+    // while descriptors or buffers are released
+    constexpr static std::chrono::milliseconds ACCEPT_PAUSE {100};
+
+    // time a backend server is given to respond before the request is sent again, or fails
+    constexpr static std::chrono::milliseconds RESPONSE_TIMEOUT {2000};
+
+    // times a request is sent to a backend server before it fails, besides the messages of group reservations
+    constexpr static int MAX_BACKEND_ATTEMPTS = 4;
+
+    // requests a reactor has in flight to each backend server, the rest wait their turn
+    constexpr static unsigned int MAX_BACKEND_IN_FLIGHT = 128;
+
+    // framed requests a session may have outstanding before the reactor stops reading from it
+    constexpr static unsigned int MAX_IN_FLIGHT = 1024;
+
+    // most rooms accepted in a single batch request
+    constexpr static size_t MAX_BATCH_ROOMS = 4096;
+
+    // times a commit or abort is sent to a backend server before giving up on its acknowledgement
+    constexpr static int MAX_DECISION_ATTEMPTS = 3;
+
+    // time a request waits for its room to be adopted by another backend server before it is sent again,
+    // and the times it is sent again or waits before it fails
+    constexpr static std::chrono::milliseconds REROUTE_DELAY {50};
+    constexpr static int MAX_REROUTES = 40;
+
+    // positions of the counters within the stats registry, in the order make_stats names them
+    // requests are counted by type, authorization and response codes from the first of theirs by the value of the code
+    constexpr static size_t CONNECTION_COUNTER = 0;
+    constexpr static size_t AUTHENTICATION_COUNTER = 1;
+    constexpr static size_t RESUME_COUNTER = 2;
+    constexpr static size_t AVAILABILITY_COUNTER = 3;
+    constexpr static size_t RESERVATION_COUNTER = 4;
+    constexpr static size_t BATCH_AVAILABILITY_COUNTER = 5;
+    constexpr static size_t BATCH_RESERVATION_COUNTER = 6;
+    constexpr static size_t GROUP_RESERVATION_COUNTER = 7;
+    constexpr static size_t STATS_COUNTER = 8;
+    constexpr static size_t INVALID_COUNTER = 9;
+    constexpr static size_t BACKEND_TIMEOUT_COUNTER = 10;
+    constexpr static size_t AUTHORIZATION_COUNTERS = 11;
+    constexpr static size_t RESPONSE_COUNTERS = 16;
+
+    // positions of the stages within the stats registry
+    // a connection is authenticated some time after it is accepted, its credentials are checked,
+    // its requests wait on backend servers, and its responses are sent
+    constexpr static size_t AUTHENTICATION_STAGE = 0;
+    constexpr static size_t CREDENTIALS_STAGE = 1;
+    constexpr static size_t BACKEND_STAGE = 2;
+    constexpr static size_t SEND_STAGE = 3;
+
+    // milliseconds until the oldest pending request expires, a rerouted request is due, the listener is watched again,
+    // or the coordinator is due, or -1 if none is
+    int next_timeout() const;
+
+    // send again the requests whose backend server has not responded in time, or fail them once out of attempts
+    void expire_requests();
+
+    // send a request whose room moved out of the backend server it was sent to, to the backend server the room moved to
+    // a request whose room is not adopted yet waits, and once waited is sent wherever the room is,
+    // even back to the backend server it came from, which may have been given the room back
+    void reroute(backend_waiter&& w, bool waited);
+
+    // send again the rerouted requests and group reservations that are due
+    void reroute_requests();
+
+    // reply to a single request that failed without a backend response
+    void fail_request(const backend_waiter& w, const std::string& code);
+
+    // send a request to its backend server, or queue it while the backend server has too many requests in flight
+    void send_backend(uint32_t request_id, backend_waiter&& w);
+
+    // send the datagram of a request to its backend server, starting its timeout
+    void transmit(uint32_t request_id, backend_waiter& w);
+
+    // a request to a backend server is no longer in flight, send the next one queued for it
+    void release(int port);
+
+    // accept all pending connections on the listening socket
+    void accept_clients();
+
+    // stop watching the listener for a while, after accepting failed
+    void pause_accepting();
+
+    // watch the listener again once its pause is over
+    void resume_accepting();
+
+    // read and handle information from a client connection
+    void read_client(session& s);
+
+    // handle the complete frames buffered for a framed session
+    // returns false if the session was closed
+    bool read_frames(session& s);
+
+    // handle a single frame from a framed session
+    void handle_frame(session& s, const frame& f);
+
+    // drain and dispatch all the datagrams queued on the backend socket
+    // chunks of room status from a backend server that restarted are taken in and acknowledged
+    void read_backend();
+
+    // send a response code to a client, framed with the type and id of its request for framed sessions
+    void reply(session& s, uint8_t frame_type, uint32_t frame_id, const std::string& code);
+
+    // queue information for a client and send as much as possible
+    void send_client(session& s, const std::string& msg);
+
+    // send queued information once the client socket is writable
+    void flush_client(session& s);
+
+    // update the events watched for a client connection
+    void watch(session& s);
+
+    // close a client connection and forget about it
+    void close_client(int fd);
+
+    // authenticate the user credentials by comparing it to the stored user information
+    void authenticate(session& s, const std::string& auth, uint32_t frame_id);
+
+    // count a client request by the frame type it has or would have
+    void count_request(uint8_t frame_type);
+
+    // count the authorization or response codes of a reply
+    void count_reply(uint8_t frame_type, const std::string& code);
+
+    // mark a session as authenticated, recording how long it took since the connection was accepted
+    void admit(session& s, bool member);
+
+    // restore the session a token was issued for, in place of authentication
+    void resume(session& s, const std::string& token, uint32_t frame_id);
+
+    // reply to a successful framed authentication with the authorization code and a new session token
+    void grant(session& s, uint32_t frame_id, const std::string& code);
+
+    // accept availability and reservation requests from the client
+    void accept_request(session& s, const std::string& request_type, const std::string& room, uint32_t frame_id);
+
+    // answer an availability request from the room status table, if the table holds the answer
+    bool local_availability(session& s, const std::string& room, uint32_t frame_id);
+
+    // returns the port of the backend server owning the room, or -1 if the room does not exist
+    int route(const std::string& room) const;
+
+    // forward a request to the backend server owning the room
+    void forward_request(session& s, const std::string& request_type, const std::string& room, uint8_t frame_type, uint32_t frame_id);
+
+    // accept a batch availability or reservation request, grouping its rooms by backend server
+    void accept_batch(session& s, const frame& f);
+
+    // send rooms of a batch request to a backend server, split over several datagrams only if they would not fit a single one
+    void send_batch(uint32_t batch_id, batch_request& b, int port, const std::vector<size_t>& indices, int reroutes);
+
+    // reply to the client with the results of a batch request once all its parts are in
+    void finish_batch(uint32_t batch_id);
+
+    // record the backend response for a part of a batch request, replying to the client once all parts are in
+    // an empty response marks a part that timed out
+    void batch_response(const backend_waiter& w, const std::string& response);
+
+    // accept a group reservation, asking every backend server involved to hold its rooms
+    void accept_group(session& s, const frame& f);
+
+    // group the rooms of a group reservation by backend server
+    // returns false if a room has no backend server, marking it in the results
+    bool route_group(group_request& g);
+
+    // ask every backend server of a routed group reservation to hold its rooms, under a new group id
+    void prepare_group(group_request&& g);
+
+    // prepare again a group reservation that was aborted after a room moved out of the backend server asked to hold it
+    void restart_group(uint32_t group_id);
+
+    // send a prepare, commit or abort message of a group reservation to one of its backend servers
+    void send_group_message(uint32_t group_id, group_request& g, int port, const std::string& request_type, int attempt);
+
+    // advance a group reservation with the backend response to one of its messages
+    // an empty response marks a message that timed out
+    void group_response(const backend_waiter& w, const std::string& response);
+
+    // reply to the client with the outcome of a finished group reservation
+    void finish_group(uint32_t group_id);
+
+    // reply to the client of a group reservation with its outcome followed by the result of each room
+    void reply_group(const group_request& g, const std::string& outcome);
+
+    // relay a backend response for an availability request to the client
+    void availability_response(session& s, const backend_waiter& w, const msg_port& response);
+
+    // relay a backend response for a reservation request to the client, updating the room status
+    void reservation_response(session& s, const backend_waiter& w, const msg_port& response);
+
+    // a backend response or timeout has answered one of the session's requests
+    // returns false if the session was closed
+    bool request_done(session& s);
+
+public:
+    // constructor
+    reactor(Socket* listener, Socket& server_sock, uint32_t& request_ids, coordinator* coord,
+            const backend_directory& backends, room_table& room_status,
+            const credential_index& user_info, token_table& tokens, stats_registry& stats);
+
+    // allocate the counters and stage histograms of the main server, named in the order of their positions
+    static stats_registry make_stats();
+
+    // take ownership of an accepted client connection
+    void adopt(Socket&& client);
+
+    // serve connections, returning once no listener exists and all adopted connections are closed
+    void run();
+};
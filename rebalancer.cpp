@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <string>
+#include <string_view>
+
+#include "rebalancer.h"
+#include "constants.h"
+#include "logger.h"
+
+using namespace std;
+using namespace socket_constants;
+
+
+rebalancer::rebalancer(Socket& ssock, const map<int, char>& bknd, room_table& rs, uint32_t& request_ids, hash_ring hr):
+    server_sock {ssock}, backend {bknd}, room_status {rs}, next_request_id {request_ids}, ring {std::move(hr)},
+    moves {}, replan {false}, strays {}, moving {false}, current {}, step {move_step::moving}, given {},
+    request_id {0}, request_port {0}, request {}, attempt {0}, deadline {},
+    moved {}, held {0}, failed {0}, retry {false}, retry_at {} {}
+
+
+void rebalancer::start(hash_ring target, const vector<pair<string, int>>& stray_rooms) {
+    ring = std::move(target);
+    strays.insert(strays.end(), stray_rooms.begin(), stray_rooms.end());
+
+    // the batches planned for an earlier ring are planned again, once the batch being moved is done
+    replan = true;
+    if(!moving) next();
+}
+
+
+bool rebalancer::settled() const {
+    return !moving;
+}
+
+
+void rebalancer::plan() {
+    // rooms to give away, keyed by the backend server holding them and their owner
+    // rooms without an owner, whose first character names no backend server when routing by prefix, stay where they are
+    map<pair<int, int>, vector<string>> grouped {};
+    room_status.for_each([&](string_view code, const room_slot& slot) {
+        int owner = ring.owner(code);
+        int holder = slot.owner.load(memory_order_relaxed);
+        if(owner != -1 && owner != holder) grouped[{holder, owner}].emplace_back(code);
+    });
+    for(const pair<string, int>& stray : strays) grouped[{stray.second, -1}].push_back(stray.first);
+    strays.clear();
+
+    moves.clear();
+    for(pair<const pair<int, int>, vector<string>>& group : grouped) {
+        vector<string>& rooms = group.second;
+
+        size_t bytes = 0;
+        for(string& room : rooms) {
+            if(moves.empty() || moves.back().holder != group.first.first || moves.back().owner != group.first.second ||
+               moves.back().rooms.size() >= REBALANCE_BATCH || bytes >= Socket::MAXDATAGRAMSIZE / 4) {
+                moves.push_back({group.first.first, group.first.second, {}});
+                bytes = 0;
+            }
+
+            bytes += room.size() + 1;
+            moves.back().rooms.push_back(std::move(room));
+        }
+    }
+}
+
+
+void rebalancer::next() {
+    if(replan) {
+        plan();
+        replan = false;
+    }
+
+    while(!moves.empty()) {
+        current = std::move(moves.front());
+        moves.pop_front();
+
+        // a room may have moved since the batch was planned, such as by a batch of an earlier ring,
+        // so only the rooms still with the holder and owned by the other backend server are moved
+        if(current.owner != -1) {
+            vector<string>& rooms = current.rooms;
+            rooms.erase(remove_if(rooms.begin(), rooms.end(), [&](const string& room) {
+                const room_slot* slot = room_status.find(room);
+                return slot == nullptr || slot->owner.load(memory_order_relaxed) != current.holder || ring.owner(room) != current.owner;
+            }), rooms.end());
+        }
+
+        if(current.rooms.empty()) continue;
+
+        string body = string {MOVE_REQUEST} + '\n';
+        for(const string& room : current.rooms) body += room + '\n';
+
+        moving = true;
+        step = move_step::moving;
+        given.clear();
+        send(current.holder, std::move(body));
+        return;
+    }
+
+    moving = false;
+    finish_pass();
+}
+
+
+void rebalancer::send(int port, string body) {
+    request_id = next_request_id++;
+    request_port = port;
+    request = REQUEST_ID + to_string(request_id) + '\n' + body;
+    attempt = 0;
+    transmit();
+}
+
+
+void rebalancer::transmit() {
+    // a request the socket could not take is sent again once it times out, like one lost on the way
+    try {
+        server_sock.send_info_to(request_port, request);
+    } catch(socket_exception& se) {
+        logging::error()<<se.what();
+    }
+
+    deadline = chrono::steady_clock::now() + REBALANCE_TIMEOUT;
+}
+
+
+bool rebalancer::receive(const msg_port& answer) {
+    // answers to an earlier attempt carry the same request id and are just as good
+    const string id_line = REQUEST_ID + to_string(request_id) + '\n';
+    if(!moving || answer.port != request_port || answer.msg.compare(0, id_line.size(), id_line) != 0) return false;
+
+    if(step == move_step::moving) {
+        // the rooms the holder gave up are adopted with the counts they left with
+        // a room held by a group reservation stays with its holder, which may still be asked to commit the group
+        string_view rest {answer.msg};
+        rest.remove_prefix(id_line.size());
+
+        while(!rest.empty()) {
+            size_t line_end = rest.find('\n');
+            string_view line = rest.substr(0, line_end);
+            rest.remove_prefix(line_end == string_view::npos ? rest.size() : line_end + 1);
+
+            size_t comma = line.rfind(',');
+            if(comma == string_view::npos) continue;
+
+            int count = atoi(string {line.substr(comma + 1)}.c_str());
+            if(count == HELD_COUNT) held++;
+            else given.emplace_back(line.substr(0, comma), count);
+        }
+
+        if(current.owner == -1 || given.empty()) {
+            moved[{current.holder, current.owner}] += given.size();
+            next();
+            return true;
+        }
+
+        string body = string {ADOPT_REQUEST} + '\n';
+        for(const pair<string, int>& room : given) body += room.first + ',' + to_string(room.second) + '\n';
+
+        step = move_step::adopting;
+        send(current.owner, std::move(body));
+        return true;
+    }
+
+    if(step == move_step::adopting) {
+        // the count goes in before the owner, so a reactor routing to the new owner reads the count the room arrived with
+        for(const pair<string, int>& room : given) {
+            room_slot* slot = room_status.find(room.first);
+            if(slot == nullptr) continue;
+
+            slot->count.store(room.second, memory_order_relaxed);
+            slot->owner.store(current.owner, memory_order_release);
+        }
+
+        moved[{current.holder, current.owner}] += given.size();
+    } else {
+        failed += given.size();
+    }
+
+    next();
+    return true;
+}
+
+
+void rebalancer::expire() {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    if(retry && retry_at <= now) {
+        retry = false;
+        replan = true;
+        if(!moving) next();
+    }
+
+    if(!moving || deadline > now) return;
+
+    if(attempt + 1 < REBALANCE_ATTEMPTS) {
+        attempt++;
+        transmit();
+        return;
+    }
+
+    const char holder_name = backend.find(current.holder)->second;
+
+    if(step == move_step::moving) {
+        // the holder may have moved the rooms out without its answer arriving,
+        // a later pass moves them again, and is answered with the counts they left with
+        logging::warning()<<"The main server could not move "<<current.rooms.size()<<" rooms out of Server "<<holder_name<<".";
+        failed += current.rooms.size();
+        next();
+        return;
+    }
+
+    if(step == move_step::adopting) {
+        // the rooms go back to the backend server they left, rather than being lost between the two
+        logging::warning()<<"The main server could not have Server "<<backend.find(current.owner)->second<<" adopt "<<given.size()<<" rooms, giving them back to Server "<<holder_name<<".";
+
+        string body = request.substr(request.find('\n') + 1);
+        step = move_step::returning;
+        send(current.holder, std::move(body));
+        return;
+    }
+
+    logging::warning()<<"The main server could not give "<<given.size()<<" rooms back to Server "<<holder_name<<".";
+    failed += given.size();
+    next();
+}
+
+
+void rebalancer::finish_pass() {
+    for(const pair<const pair<int, int>, size_t>& m : moved) {
+        const char holder_name = backend.find(m.first.first)->second;
+
+        if(m.first.second == -1) logging::info()<<"The main server removed "<<m.second<<" stray rooms from Server "<<holder_name<<".";
+        else logging::info()<<"The main server moved "<<m.second<<" rooms from Server "<<holder_name<<" to Server "<<backend.find(m.first.second)->second<<".";
+    }
+
+    if(held > 0) logging::warning()<<"The main server left "<<held<<" rooms held by group reservations in place.";
+    if(failed > 0) logging::warning()<<"The main server left "<<failed<<" rooms in place for a Server that did not answer.";
+
+    if(moved.empty() && held == 0 && failed == 0) logging::info()<<"The main server found every room with its owner.";
+
+    // rooms left in place are moved by a later pass, once their group reservations are over or their backend servers are back
+    if(held > 0 || failed > 0) {
+        retry = true;
+        retry_at = chrono::steady_clock::now() + REBALANCE_RETRY;
+    }
+
+    moved.clear();
+    held = 0;
+    failed = 0;
+}
+
+
+int rebalancer::next_timeout() const {
+    if(!moving && !retry) return -1;
+
+    chrono::steady_clock::time_point due = chrono::steady_clock::time_point::max();
+    if(moving) due = deadline;
+    if(retry) due = min(due, retry_at);
+
+    chrono::steady_clock::duration left = due - chrono::steady_clock::now();
+    return max<long>(0, chrono::ceil<chrono::milliseconds>(left).count());
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hash_ring.h"
+#include "room_table.h"
+#include "socket.h"
+
+// rooms moved together from the backend server holding them to their owner, carried by a single request each way
+struct room_move {
+    // port of the backend server holding the rooms
+    int holder;
+
+    // port of the backend server owning the rooms on the ring, or -1 for stray copies, which are only moved out
+    int owner;
+
+    std::vector<std::string> rooms;
+};
+
+// the step a move has reached
+// rooms are moved out of their holder, then adopted by their owner, or adopted back by their holder should their owner not answer
+enum class move_step { moving, adopting, returning };
+
+/*
+ * class rebalancer gives every room whose backend server differs from its owner on the ring to its owner,
+ * so the rooms follow the topology, at startup as well as while clients are served
+ *
+ * rooms are moved a batch at a time, with requests sent from the backend port of the main server,
+ * and their answers are taken in as they arrive, so neither clients nor the transfers and registrations sharing the port wait
+ * a room is routed to the backend server its table slot names, which changes once the room is adopted by its owner,
+ * and until then the backend server it left answers its requests with ROOM_MOVED_OUT, which the reactors send again
+ * rooms held by group reservations, or left in place by a backend server that did not answer, are moved in a later pass
+ */
+class rebalancer {
+private:
+    // backend facing UDP socket bound to the backend port of the main server
+    Socket& server_sock;
+
+    // collection of backend servers, mapping their port to their names
+    const std::map<int, char>& backend;
+
+    // table of each room's backend server and count, shared by every reactor
+    room_table& room_status;
+
+    // id of the next request sent from the backend port, shared with everything else sending requests from it
+    uint32_t& next_request_id;
+
+    // ring of the topology the rooms are moved to
+    hash_ring ring;
+
+    // batches waiting to be moved, planned again from the room table before the next batch when replan is set
+    std::deque<room_move> moves;
+    bool replan;
+
+    // stray copies of rooms to move out with the next plan, along with the backend server holding each one
+    std::vector<std::pair<std::string, int>> strays;
+
+    // batch being moved, if moving, along with the step it reached and the rooms its holder gave up with their counts
+    bool moving;
+    room_move current;
+    move_step step;
+    std::vector<std::pair<std::string, int>> given;
+
+    // request of the current step, sent again with its id while the backend server is silent
+    uint32_t request_id;
+    int request_port;
+    std::string request;
+    int attempt;
+    std::chrono::steady_clock::time_point deadline;
+
+    // rooms moved by the current pass keyed by their holder and owner,
+    // and rooms left in place since they were held by group reservations, or a backend server did not answer
+    std::map<std::pair<int, int>, size_t> moved;
+    size_t held;
+    size_t failed;
+
+    // whether a later pass moves the rooms left in place, and the time it starts
+    bool retry;
+    std::chrono::steady_clock::time_point retry_at;
+
+    // time a backend server is given to answer a rebalancing request, and the times the request is sent
+    constexpr static std::chrono::milliseconds REBALANCE_TIMEOUT {1000};
+    constexpr static int REBALANCE_ATTEMPTS = 5;
+
+    // most rooms carried by a single rebalancing request, keeping the request and its response within a datagram
+    constexpr static size_t REBALANCE_BATCH = 1024;
+
+    // time after a pass that left rooms in place before they are moved again, longer than a group reservation takes
+    constexpr static std::chrono::seconds REBALANCE_RETRY {10};
+
+    // group the rooms whose backend server differs from their owner, and the stray copies, into batches
+    void plan();
+
+    // start moving the next batch, or finish the pass once none is left
+    void next();
+
+    // send a new request of the current batch to a backend server
+    void send(int port, std::string body);
+
+    // send the request of the current step, starting its timeout
+    void transmit();
+
+    // log what the pass moved and left in place, and schedule a later pass for the rooms left in place
+    void finish_pass();
+
+public:
+    // constructor, the rooms are moved to their owners on the provided ring once started
+    rebalancer(Socket& server_sock, const std::map<int, char>& backend, room_table& room_status,
+               uint32_t& request_ids, hash_ring ring);
+
+    // move the rooms to their owners on the provided ring, as well as the stray copies out of the backend servers holding them
+    // a pass already moving rooms finishes its current batch, and goes on with the new ring
+    void start(hash_ring target, const std::vector<std::pair<std::string, int>>& stray_rooms = {});
+
+    // returns whether no batch is left to move, although a later pass may be due for rooms left in place
+    bool settled() const;
+
+    // take in a datagram received on the backend port of the main server
+    // returns whether it answered a rebalancing request
+    bool receive(const msg_port& answer);
+
+    // send again the request of the current step if its backend server has not answered in time,
+    // or go on without it once out of attempts, and start a later pass once due
+    void expire();
+
+    // milliseconds until the current request or a later pass is due, or -1 if neither is
+    int next_timeout() const;
+};
@@ -0,0 +1,396 @@
+#include <cstring>
+#include <errno.h>
+#include <memory>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "client_protocol.h"
+#include "framing.h"
+#include "reservation_client.h"
+
+using namespace std;
+using namespace socket_constants;
+
+
+reservation_client::connection::connection(Socket&& sock): sock {std::move(sock)}, port {this->sock.bound_port()} {}
+
+
+reservation_client::reservation_client(size_t pool_size, int server_port):
+    server_port {server_port}, pool_size {max<size_t>(pool_size, 1)}, wakeup {eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)} {
+
+    if(wakeup == -1) throw reservation_client_exception {string {"reservation client exception: eventfd: "} + strerror(errno)};
+
+    try {
+        loop.add(wakeup, EPOLLIN);
+
+        // the connection carrying the login is given requests from the start,
+        // so requests made before the login are answered by the main server rather than held back
+        connection& c = open_connection();
+        c.ready = true;
+        primary = c.sock.descriptor();
+        ready_connections = 1;
+    } catch(...) {
+        close(wakeup);
+        throw;
+    }
+
+    driver = thread {&reservation_client::run, this};
+}
+
+
+void reservation_client::submit(uint8_t type, string payload, result_callback done) {
+    {
+        lock_guard<mutex> guard {lock};
+        queued.push_back(request {type, std::move(payload), std::move(done)});
+    }
+
+    eventfd_write(wakeup, 1);
+}
+
+
+void reservation_client::login(const string& username, const string& password, result_callback done) {
+    submit(FRAME_AUTHENTICATION, authentication_message(username, password), std::move(done));
+}
+
+
+void reservation_client::check_availability(const string& room, result_callback done) {
+    submit(FRAME_AVAILABILITY, room, std::move(done));
+}
+
+
+void reservation_client::reserve(const string& room, result_callback done) {
+    submit(FRAME_RESERVATION, room, std::move(done));
+}
+
+
+// the future of a request is fulfilled by its callback, which may run before the future is retrieved
+future<reservation_result> reservation_client::login(const string& username, const string& password) {
+    shared_ptr<promise<reservation_result>> result = make_shared<promise<reservation_result>>();
+    login(username, password, [result](const reservation_result& r) { result->set_value(r); });
+    return result->get_future();
+}
+
+
+future<reservation_result> reservation_client::check_availability(const string& room) {
+    shared_ptr<promise<reservation_result>> result = make_shared<promise<reservation_result>>();
+    check_availability(room, [result](const reservation_result& r) { result->set_value(r); });
+    return result->get_future();
+}
+
+
+future<reservation_result> reservation_client::reserve(const string& room) {
+    shared_ptr<promise<reservation_result>> result = make_shared<promise<reservation_result>>();
+    reserve(room, [result](const reservation_result& r) { result->set_value(r); });
+    return result->get_future();
+}
+
+
+size_t reservation_client::connections() const {
+    return ready_connections;
+}
+
+
+void reservation_client::run() {
+    epoll_event events[event_loop::MAXEVENTS];
+
+    while(true) {
+        int ready = loop.wait(events);
+
+        for(int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+
+            if(fd == wakeup) {
+                eventfd_t signals;
+                eventfd_read(wakeup, &signals);
+                send_queued();
+                continue;
+            }
+
+            // the connection may have been closed by an earlier event in this batch
+            unordered_map<int, connection>::iterator found = pool.find(fd);
+            if(found == pool.end()) continue;
+
+            try {
+                if(events[i].events & EPOLLOUT) flush_connection(found->second);
+                if(events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) read_connection(found->second);
+            } catch(socket_exception& se) {
+                // a failing connection leaves the rest of the pool serving requests
+                close_connection(fd);
+            }
+        }
+
+        lock_guard<mutex> guard {lock};
+        if(stopping) break;
+    }
+
+    // every request still waiting is answered, so no callback is left behind
+    while(!pool.empty()) close_connection(pool.begin()->first);
+    send_queued();
+}
+
+
+void reservation_client::send_queued() {
+    vector<request> taken {};
+    bool reopen;
+    {
+        lock_guard<mutex> guard {lock};
+        taken.swap(queued);
+        reopen = !stopping;
+    }
+
+    // requests made while the client shuts down are answered as closed rather than reopening the pool
+    if(reopen && !taken.empty()) reconnect();
+
+    for(request& r : taken) {
+        connection* c = choose(r.type);
+        if(c == nullptr) {
+            r.done(reservation_result {CLOSED_CONNECTION, -1});
+            continue;
+        }
+
+        send_frame(*c, r.type, r.payload, std::move(r.done));
+    }
+
+    flush_pool();
+}
+
+
+void reservation_client::send_frame(connection& c, uint8_t type, const string& payload, result_callback done) {
+    uint32_t id = next_id++;
+    framing::encode(c.pending_out, type, id, payload);
+
+    // the credentials of a login are kept with it, so the pool can rejoin the session once the login succeeds
+    pending[id] = outstanding {c.sock.descriptor(), type, std::move(done), type == FRAME_AUTHENTICATION ? payload : ""};
+    c.in_flight++;
+}
+
+
+void reservation_client::reconnect() {
+    if(primary == -1) {
+        try {
+            connection& c = open_connection();
+            c.ready = true;
+            primary = c.sock.descriptor();
+            ready_connections++;
+
+            // the connection logs in again ahead of the requests sent over it, as the main server may have restarted
+            // and forgotten the session token, and the login grants a new one before the pool is filled again
+            if(!credentials.empty()) {
+                send_frame(c, FRAME_AUTHENTICATION, credentials, nullptr);
+                rejoining = true;
+            }
+        } catch(socket_exception& se) {
+            // the requests are answered as closed until the main server can be reached again
+            return;
+        }
+    }
+
+    // connections of the pool lost since are replaced once the connection carrying the login is back in the session
+    if(!credentials.empty() && !rejoining) fill_pool();
+}
+
+
+reservation_client::connection& reservation_client::open_connection() {
+    Socket sock {-1, SOCK_STREAM};
+    sock.connect_socket(server_port);
+    sock.set_nonblocking();
+
+    int fd = sock.descriptor();
+    connection& c = pool.emplace(fd, std::move(sock)).first->second;
+    loop.add(fd, EPOLLIN);
+
+    return c;
+}
+
+
+reservation_client::connection* reservation_client::choose(uint8_t type) {
+    if(type == FRAME_AUTHENTICATION && primary != -1) return &pool.at(primary);
+
+    connection* chosen = nullptr;
+    for(auto& [fd, c] : pool) {
+        if(c.ready && (chosen == nullptr || c.in_flight < chosen->in_flight)) chosen = &c;
+    }
+
+    return chosen;
+}
+
+
+void reservation_client::fill_pool() {
+    while(pool.size() < pool_size) {
+        int fd = -1;
+
+        try {
+            connection& c = open_connection();
+            fd = c.sock.descriptor();
+
+            // a main server out of session tokens grants none, so the connection authenticates with the credentials instead
+            // a join is sent without a callback, which is how its answer is told apart from a request of the program
+            if(!token.empty()) send_frame(c, FRAME_RESUME, token, nullptr);
+            else send_frame(c, FRAME_AUTHENTICATION, credentials, nullptr);
+
+            flush_connection(c);
+        } catch(socket_exception& se) {
+            // the pool serves requests with the connections it has
+            close_connection(fd);
+            break;
+        }
+    }
+}
+
+
+void reservation_client::read_connection(connection& c) {
+    int fd = c.sock.descriptor();
+    bool closed = false;
+
+    while(true) {
+        optional<string> received = c.sock.try_recv_info();
+        if(!received) break;
+
+        if(*received == CLOSED_CONNECTION) {
+            closed = true;
+            break;
+        }
+
+        c.pending_in += *received;
+    }
+
+    // answers received before the connection closed are still given to their requests
+    size_t offset = 0;
+    frame f;
+
+    try {
+        while(framing::decode(c.pending_in, offset, f)) {
+            if(!answer(c, f.type, f.id, f.payload)) return;
+        }
+    } catch(framing_exception& fe) {
+        close_connection(fd);
+        return;
+    }
+
+    c.pending_in.erase(0, offset);
+    if(closed) close_connection(fd);
+}
+
+
+bool reservation_client::answer(connection& c, uint8_t type, uint32_t id, const string& payload) {
+    unordered_map<uint32_t, outstanding>::iterator found = pending.find(id);
+    if(found == pending.end()) return true;
+
+    outstanding o = std::move(found->second);
+    pending.erase(found);
+    c.in_flight--;
+
+    if(type != FRAME_AUTHENTICATION && type != FRAME_RESUME) {
+        o.done(reservation_result {payload, c.port});
+        return true;
+    }
+
+    // a successful login is answered with the authorization code followed by a line of the session token
+    size_t newline = payload.find('\n');
+    string code = payload.substr(0, newline);
+
+    if(authenticated(code) && type == FRAME_AUTHENTICATION) {
+        credentials = std::move(o.credentials);
+        token = newline == string::npos ? "" : payload.substr(newline + 1);
+    }
+
+    if(!o.done) {
+        // a connection that could not join the session is of no use to the pool
+        if(!authenticated(code)) {
+            close_connection(c.sock.descriptor());
+            return false;
+        }
+
+        // the connection carrying the login is ready from the start, and fills the pool once it rejoins the session
+        if(c.sock.descriptor() == primary) {
+            rejoining = false;
+            fill_pool();
+            return true;
+        }
+
+        c.ready = true;
+        ready_connections++;
+        return true;
+    }
+
+    if(authenticated(code)) fill_pool();
+
+    o.done(reservation_result {code, c.port});
+    return true;
+}
+
+
+void reservation_client::flush_connection(connection& c) {
+    size_t sent = c.sock.try_send_info(c.pending_out.data(), c.pending_out.size());
+    c.pending_out.erase(0, sent);
+
+    watch(c);
+}
+
+
+void reservation_client::flush_pool() {
+    vector<int> failed {};
+    for(auto& [fd, c] : pool) {
+        if(c.pending_out.empty()) continue;
+
+        try {
+            flush_connection(c);
+        } catch(socket_exception& se) {
+            failed.push_back(fd);
+        }
+    }
+
+    for(int fd : failed) close_connection(fd);
+}
+
+
+void reservation_client::watch(connection& c) {
+    uint32_t events = EPOLLIN;
+    if(!c.pending_out.empty()) events |= EPOLLOUT;
+
+    loop.modify(c.sock.descriptor(), events);
+}
+
+
+void reservation_client::close_connection(int fd) {
+    unordered_map<int, connection>::iterator found = pool.find(fd);
+    if(found == pool.end()) return;
+
+    int port = found->second.port;
+    if(found->second.ready) ready_connections--;
+    if(fd == primary) {
+        primary = -1;
+        rejoining = false;
+    }
+
+    // the requests are answered once the connection is gone, so their callbacks see the pool without it
+    vector<result_callback> closed {};
+    for(unordered_map<uint32_t, outstanding>::iterator itr = pending.begin(); itr != pending.end();) {
+        if(itr->second.fd == fd) {
+            if(itr->second.done) closed.push_back(std::move(itr->second.done));
+            itr = pending.erase(itr);
+        } else {
+            itr++;
+        }
+    }
+
+    // closing the socket removes it from the epoll interest list
+    pool.erase(found);
+
+    for(result_callback& done : closed) done(reservation_result {CLOSED_CONNECTION, port});
+}
+
+
+reservation_client::~reservation_client() {
+    {
+        lock_guard<mutex> guard {lock};
+        stopping = true;
+    }
+
+    eventfd_write(wakeup, 1);
+    driver.join();
+    close(wakeup);
+}
+
+
+reservation_client_exception::reservation_client_exception(const string& err) : std::runtime_error{err} {}
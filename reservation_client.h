@@ -0,0 +1,207 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "constants.h"
+#include "event_loop.h"
+#include "socket.h"
+
+// the answer of the main server to a request
+struct reservation_result {
+    // authorization code of a login, or availability and reservation code of a request,
+    // CLOSED_CONNECTION if the connection the request was sent over closed before it was answered
+    std::string code;
+
+    // port of the client connection the request was answered over
+    int port;
+};
+
+/*
+ * class reservation_client lets a program make requests to the main server without blocking on their answers
+ *
+ * requests are sent in the framed protocol, so many of them may be in flight on each connection at once,
+ * and are spread over a pool of connections authenticated as the same user
+ * the first connection is opened right away and carries the login, once the login succeeds the rest of the pool
+ * is opened with the session token it was granted, and each joins the pool once its token is accepted
+ * the pool stays in the session of the first login that succeeds
+ * once every connection is lost, such as when the main server restarts, the next requests open the first connection again,
+ * which logs in again with the credentials of the session ahead of them and fills the pool once it succeeds
+ *
+ * every request is answered through a callback, or a future for the variants without one
+ * callbacks run on the thread of the client that drives the connections, so they must not block,
+ * though they may make further requests
+ */
+class reservation_client {
+public:
+    typedef std::function<void(const reservation_result&)> result_callback;
+
+private:
+    // a connection of the pool, driven by the client thread
+    struct connection {
+        Socket sock;
+
+        // whether the connection is authenticated, only ready connections are given requests, besides the login
+        bool ready {false};
+
+        // received bytes not yet forming a complete frame
+        std::string pending_in {};
+
+        // frames not yet accepted by the socket send buffer
+        std::string pending_out {};
+
+        // requests sent over the connection and not yet answered
+        unsigned int in_flight {0};
+
+        // port the connection is bound to, reported along with its answers
+        int port;
+
+        connection(Socket&& sock);
+    };
+
+    // a request made by the program, waiting to be sent by the client thread
+    struct request {
+        uint8_t type;
+        std::string payload;
+        result_callback done;
+    };
+
+    // a request sent to the main server, waiting for its answer
+    struct outstanding {
+        int fd;
+        uint8_t type;
+        result_callback done;
+
+        // authentication message of a login, kept until it succeeds
+        std::string credentials;
+    };
+
+    // port of the main server
+    int server_port;
+
+    // connections the pool is filled to once the login succeeds
+    size_t pool_size;
+
+    // requests made since the client thread last took them, along with whether the client is shutting down
+    std::mutex lock;
+    std::vector<request> queued {};
+    bool stopping {false};
+
+    // signalled whenever requests are queued, or the client is shutting down
+    int wakeup;
+
+    // the rest of the members are only touched by the client thread, once it is started
+    event_loop loop;
+
+    // connections of the pool, keyed by their file descriptors
+    std::unordered_map<int, connection> pool {};
+
+    // descriptor of the connection carrying the login, -1 once it is closed
+    int primary {-1};
+
+    // whether the connection carrying the login was opened again and is logging in to the session once more
+    bool rejoining {false};
+
+    // connections of the pool given requests, read by the program as well
+    std::atomic<size_t> ready_connections {0};
+
+    // requests awaiting an answer, keyed by the id of their frame
+    std::unordered_map<uint32_t, outstanding> pending {};
+    uint32_t next_id {0};
+
+    // authentication message of the last login that succeeded, and the session token it was granted
+    std::string credentials {};
+    std::string token {};
+
+    std::thread driver;
+
+    // queue a request for the client thread
+    void submit(uint8_t type, std::string payload, result_callback done);
+
+    // wait for events on the connections until the client shuts down
+    void run();
+
+    // send the requests queued by the program
+    void send_queued();
+
+    // send a frame over a connection, answering it through done
+    void send_frame(connection& c, uint8_t type, const std::string& payload, result_callback done);
+
+    // open the connection carrying the login again if it was lost, rejoining the session of the last login,
+    // and replace the connections of the pool lost since
+    void reconnect();
+
+    // open a connection to the main server, added to the pool though not yet ready
+    connection& open_connection();
+
+    // the ready connection with the fewest requests in flight, or the connection carrying the login for a login
+    // returns nullptr if there is none
+    connection* choose(uint8_t type);
+
+    // open connections until the pool is full, asking each to join the session of the login
+    void fill_pool();
+
+    // read the available information of a connection and answer the requests it completes
+    void read_connection(connection& c);
+
+    // answer the request of a received frame
+    // returns false if the answer closed the connection
+    bool answer(connection& c, uint8_t type, uint32_t id, const std::string& payload);
+
+    // send the frames a connection has queued
+    void flush_connection(connection& c);
+
+    // send the frames every connection has queued, closing the connections that fail
+    void flush_pool();
+
+    // watch a connection for the events it is waiting on
+    void watch(connection& c);
+
+    // close a connection, answering its requests in flight as closed
+    void close_connection(int fd);
+
+public:
+    // connections a client opens by default
+    constexpr static size_t DEFAULT_POOL_SIZE = 4;
+
+    // connect to the main server and start the client thread
+    // throws socket_exception if the main server cannot be reached
+    explicit reservation_client(size_t pool_size = DEFAULT_POOL_SIZE, int server_port = socket_constants::serverM_client);
+
+    // disallow copy operations, since the client thread refers to the client
+    reservation_client(const reservation_client&) = delete;
+    reservation_client& operator=(const reservation_client&) = delete;
+
+    // authenticate a member, or a guest when the password is empty
+    // the result code is VALID_MEMBER or VALID_GUEST if the user is admitted
+    void login(const std::string& username, const std::string& password, result_callback done);
+    std::future<reservation_result> login(const std::string& username, const std::string& password);
+
+    // ask whether a room is available
+    void check_availability(const std::string& room, result_callback done);
+    std::future<reservation_result> check_availability(const std::string& room);
+
+    // reserve a room
+    void reserve(const std::string& room, result_callback done);
+    std::future<reservation_result> reserve(const std::string& room);
+
+    // number of connections of the pool that are given requests
+    size_t connections() const;
+
+    // stop the client thread and close the connections
+    // requests still waiting are answered with CLOSED_CONNECTION
+    ~reservation_client();
+};
+
+class reservation_client_exception : public std::runtime_error {
+public:
+    reservation_client_exception(const std::string& err);
+};
@@ -0,0 +1,199 @@
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+#include "reservation_log.h"
+
+using namespace std;
+
+
+reservation_log_exception::reservation_log_exception(const string& err) : runtime_error{err} {}
+
+
+// open a file for appending records, creating it if it does not exist
+static int open_log(const string& path) {
+    int fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if(fd == -1) throw reservation_log_exception {"reservation_log exception: open: " + path + ": " + strerror(errno)};
+
+    return fd;
+}
+
+
+// write the whole string to a file, throwing on failure
+static void write_all(int fd, const string& data, const char* caller) {
+    size_t written = 0;
+    while(written < data.size()) {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+
+        if(n == -1) {
+            if(errno == EINTR) continue;
+            throw reservation_log_exception {string {"reservation_log exception: "} + caller + ": " + strerror(errno)};
+        }
+
+        written += n;
+    }
+}
+
+
+// markers of the changes that set a count rather than add to it
+constexpr char ADOPTED_MARKER = '=';
+constexpr char MOVED_MARKER = '>';
+
+
+// a single change of a record, kind is 0 for a change added to the count, or the marker of the change
+struct logged_change {
+    string room;
+    char kind;
+    int value;
+};
+
+
+// parse a record into its changes
+// returns false if the record is malformed
+static bool parse_record(const string& line, vector<logged_change>& changes) {
+    istringstream sstream {line};
+    string room, change;
+
+    changes.clear();
+    while(getline(sstream, room, ',')) {
+        if(room == "" || !getline(sstream, change, ',') || change == "") return false;
+
+        char kind = change[0] == ADOPTED_MARKER || change[0] == MOVED_MARKER ? change[0] : 0;
+        const char* number = change.c_str() + (kind == 0 ? 0 : 1);
+
+        char* end;
+        long value = strtol(number, &end, 10);
+        if(*number == 0 || *end != 0) return false;
+
+        changes.push_back({room, kind, static_cast<int>(value)});
+    }
+
+    return !changes.empty();
+}
+
+
+reservation_log::reservation_log(const string& path): fd {open_log(path)}, path {path}, queued {} {}
+
+
+reservation_log::reservation_log(reservation_log&& log): fd {log.fd}, path {std::move(log.path)}, queued {std::move(log.queued)} {
+    log.fd = -1;
+}
+
+
+// flush a directory, so the files created, renamed or removed in it stay that way after a crash
+static void sync_directory(const string& path) {
+    size_t slash = path.rfind('/');
+    const string directory = slash == string::npos ? "." : path.substr(0, slash + 1);
+    int dirfd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(dirfd != -1) {
+        fsync(dirfd);
+        close(dirfd);
+    }
+}
+
+
+map<string, logged_room> reservation_log::replay() {
+    ifstream f {path};
+    string contents {istreambuf_iterator<char> {f}, istreambuf_iterator<char> {}};
+
+    // state of each room, ordered so the rewritten log is stable
+    map<string, logged_room> rooms;
+    vector<logged_change> changes;
+
+    size_t start = 0;
+    size_t end;
+    while((end = contents.find('\n', start)) != string::npos) {
+        // records after a malformed one cannot be trusted to follow it
+        if(!parse_record(contents.substr(start, end - start), changes)) break;
+
+        for(const logged_change& c : changes) {
+            logged_room& r = rooms[c.room];
+
+            if(c.kind == 0) r.count += c.value;
+            else r = {c.value, c.kind == ADOPTED_MARKER, c.kind == MOVED_MARKER};
+        }
+
+        start = end + 1;
+    }
+
+    rewrite(rooms);
+    return rooms;
+}
+
+
+void reservation_log::rewrite(const map<string, logged_room>& rooms) {
+    // rewrite the log beside the old one and swap it in, so a crash leaves one of the two intact
+    string compacted;
+    for(const pair<const string, logged_room>& r : rooms) {
+        if(r.second.adopted) compacted += r.first + ',' + ADOPTED_MARKER + to_string(r.second.count) + '\n';
+        else if(r.second.moved) compacted += r.first + ',' + MOVED_MARKER + to_string(r.second.count) + '\n';
+        else if(r.second.count != 0) compacted += r.first + ',' + to_string(r.second.count) + '\n';
+    }
+
+    const string temp_path = path + ".tmp";
+    int temp = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(temp == -1) throw reservation_log_exception {"reservation_log exception: rewrite: " + temp_path + ": " + strerror(errno)};
+
+    write_all(temp, compacted, "rewrite");
+    if(fdatasync(temp) == -1 || close(temp) == -1 || rename(temp_path.c_str(), path.c_str()) == -1) {
+        throw reservation_log_exception {string {"reservation_log exception: rewrite: "} + strerror(errno)};
+    }
+
+    // the rename itself is only durable once the directory is flushed
+    sync_directory(path);
+
+    close(fd);
+    fd = open_log(path);
+    queued.clear();
+}
+
+
+void reservation_log::append(const vector<pair<string, int>>& changes) {
+    if(changes.empty()) return;
+
+    for(size_t i = 0; i < changes.size(); i++) {
+        if(i > 0) queued += ',';
+        queued += changes[i].first + ',' + to_string(changes[i].second);
+    }
+
+    queued += '\n';
+}
+
+
+void reservation_log::append_adopted(const string& room, int count) {
+    queued += room + ',' + ADOPTED_MARKER + to_string(count) + '\n';
+}
+
+
+void reservation_log::append_moved(const string& room, int count) {
+    queued += room + ',' + MOVED_MARKER + to_string(count) + '\n';
+}
+
+
+void reservation_log::sync() {
+    if(queued.empty()) return;
+
+    write_all(fd, queued, "sync");
+    if(fdatasync(fd) == -1) throw reservation_log_exception {string {"reservation_log exception: sync: "} + strerror(errno)};
+
+    queued.clear();
+}
+
+
+void reservation_log::remove(const string& path) {
+    if(unlink(path.c_str()) == -1 && errno != ENOENT) {
+        throw reservation_log_exception {"reservation_log exception: remove: " + path + ": " + strerror(errno)};
+    }
+
+    sync_directory(path);
+}
+
+
+reservation_log::~reservation_log() {
+    if(fd != -1) close(fd);
+}
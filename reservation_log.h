@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdexcept>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// the state of a room rebuilt from the log
+struct logged_room {
+    // net change to the count read from the room status file,
+    // or the count itself for a room adopted from or moved to another backend server
+    int count {0};
+
+    bool adopted {false};
+    bool moved {false};
+};
+
+/*
+ * class reservation_log is an append-only record of the room count changes made by a backend server,
+ * replayed at startup on top of the room status file so no acknowledged reservation is lost on restart
+ *
+ * each line is one record of comma separated room and change pairs, applied all together or not at all
+ * a change is a signed number added to the count, or a count prefixed by = for a room adopted from another
+ * backend server, or by > for a room moved to another backend server
+ * records are queued and written by a single sync, so many reservations share one flush to disk
+ */
+class reservation_log {
+private:
+    // log file descriptor
+    int fd;
+    std::string path;
+
+    // records queued since the last sync
+    std::string queued;
+
+public:
+    // open the log at the provided path, creating it if it does not exist
+    explicit reservation_log(const std::string& path);
+
+    // disallow copy operations to maintain unique ownership of the log file
+    reservation_log(const reservation_log&) = delete;
+    reservation_log& operator=(const reservation_log&) = delete;
+
+    // allow moving, leaving the source without a file
+    reservation_log(reservation_log&& log);
+
+    // returns the state logged for each room, after rewriting the log with one record per changed room
+    // a final record cut short by a crash was never acknowledged, and is dropped
+    std::map<std::string, logged_room> replay();
+
+    // replace the contents of the log with one record per changed room, dropping any queued records
+    void rewrite(const std::map<std::string, logged_room>& rooms);
+
+    // remove the log file at the provided path, such as one left by a different number of shards
+    static void remove(const std::string& path);
+
+    // queue a record of changes to the room counts, made durable by the next sync
+    void append(const std::vector<std::pair<std::string, int>>& changes);
+
+    // queue a record of a room adopted from another backend server along with its count
+    void append_adopted(const std::string& room, int count);
+
+    // queue a record of a room moved to another backend server, remembering its count when it left
+    void append_moved(const std::string& room, int count);
+
+    // write the queued records and flush them to disk
+    void sync();
+
+    // close the log file
+    ~reservation_log();
+};
+
+class reservation_log_exception : public std::runtime_error {
+public:
+    reservation_log_exception(const std::string& err);
+};
@@ -0,0 +1,31 @@
+#include <iostream>
+#include <stdexcept>
+
+#include "backend.h"
+#include "room_table.h"
+
+using namespace std;
+
+// convert a room status file into a snapshot, which backend servers map at startup instead of reading the file
+// the snapshot is written beside the file by default, such as single.snap for single.txt
+int main(int argc, char* argv[]) {
+    if(argc < 2 || argc > 3) {
+        cout<<"usage: room_snapshot <room status file> [snapshot file]\n";
+        return 1;
+    }
+
+    const string filename = argv[1];
+    const string snapshot = argc == 3 ? argv[2] : filename.substr(0, filename.rfind('.')) + ".snap";
+
+    try {
+        room_table room_status = read_status(filename);
+
+        room_status.save(snapshot);
+        cout<<"Saved "<<room_status.size()<<" rooms from "<<filename<<" to "<<snapshot<<".\n";
+        return 0;
+
+    } catch(runtime_error& e) {
+        cout<<e.what()<<endl;
+        return 1;
+    }
+}
@@ -0,0 +1,411 @@
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "room_table.h"
+
+using namespace std;
+
+
+// a snapshot file starts with a header, followed by the slots of the table exactly as laid out in memory,
+// and then by the interned codes
+// the header is as large as a cache line, so the slots stay aligned once mapped
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+
+    // size of a slot when the snapshot was written, which changes with the room code size
+    uint32_t slot_size;
+
+    uint64_t capacity;
+    uint64_t rooms;
+
+    // bytes of interned codes following the slots
+    uint64_t codes_size;
+
+    char reserved[24];
+};
+
+static_assert(sizeof(snapshot_header) == 64, "snapshot header must keep slots aligned");
+
+constexpr char SNAPSHOT_MAGIC[8] = {'R', 'O', 'O', 'M', 'S', 'N', 'A', 'P'};
+
+// bumped whenever the slot layout or the hash function changes, so older snapshots are rejected
+constexpr uint32_t SNAPSHOT_VERSION = 2;
+
+// first character of the slot of a room whose code is interned, followed by the length and position of the code
+// codes starting with it are interned whatever their length, so they never mistake an inline code for one
+constexpr char LONG_CODE = '\x7f';
+constexpr size_t LONG_CODE_LENGTH = 4;
+constexpr size_t LONG_CODE_POSITION = 8;
+
+// interned code storage is grown by at least this many bytes
+constexpr size_t MIN_CODES_CAPACITY = 4096;
+
+
+// returns whether a room code is interned rather than stored inline
+static bool is_long(string_view room) {
+    return room.size() >= ROOM_CODE_SIZE || room[0] == LONG_CODE;
+}
+
+
+// spread the bits of a word over the whole word, so the low bits used to pick a slot depend on all of them
+static uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+
+    return h;
+}
+
+
+// hash of an inline code, given as the two words of its padded code
+static uint64_t hash_key(const uint64_t key[2]) {
+    return mix(key[0] ^ mix(key[1]));
+}
+
+
+// hash of a room code
+// inline codes are hashed as the two words of their padded code, interned codes byte by byte with FNV-1a
+static uint64_t hash_room(string_view room) {
+    if(!is_long(room)) {
+        uint64_t key[2] = {0, 0};
+        memcpy(key, room.data(), room.size());
+        return hash_key(key);
+    }
+
+    uint64_t h = 14695981039346656037ull;
+    for(unsigned char c : room) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+
+    return mix(h);
+}
+
+
+// map zeroed memory that stays shared with forked child processes
+static void* map_shared(size_t size, const char* caller) {
+    void* region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(region == MAP_FAILED) throw room_table_exception {string {"room_table exception: "} + caller + ": " + strerror(errno)};
+
+    return region;
+}
+
+
+room_table::room_table(size_t max_rooms):
+    slots {nullptr}, capacity {16}, rooms {0}, region {nullptr}, region_size {0},
+    codes {nullptr}, codes_size {0}, codes_capacity {0}, codes_region {nullptr} {
+    // keep the table at most three quarters full so probe sequences stay short
+    while(capacity * 3 < max_rooms * 4) capacity *= 2;
+
+    // anonymous shared memory starts zeroed, which marks every slot as free with zero counts
+    region_size = capacity * sizeof(room_slot);
+    region = map_shared(region_size, "room_table");
+    slots = static_cast<room_slot*>(region);
+}
+
+
+room_table::room_table(room_slot* slots, size_t capacity, size_t rooms, void* region, size_t region_size, char* codes, size_t codes_size):
+    slots {slots}, capacity {capacity}, rooms {rooms}, region {region}, region_size {region_size},
+    codes {codes}, codes_size {codes_size}, codes_capacity {codes_size}, codes_region {nullptr} {}
+
+
+room_table::room_table(room_table&& table):
+    slots {table.slots}, capacity {table.capacity}, rooms {table.rooms}, region {table.region}, region_size {table.region_size},
+    codes {table.codes}, codes_size {table.codes_size}, codes_capacity {table.codes_capacity}, codes_region {table.codes_region} {
+    table.slots = nullptr;
+    table.region = nullptr;
+    table.codes = nullptr;
+    table.codes_region = nullptr;
+}
+
+
+room_table room_table::load(const string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd == -1) throw room_table_exception {"room_table exception: load: " + path + ": " + strerror(errno)};
+
+    struct stat info;
+    if(fstat(fd, &info) == -1) {
+        close(fd);
+        throw room_table_exception {"room_table exception: load: " + path + ": " + strerror(errno)};
+    }
+
+    size_t size = info.st_size;
+    if(size < sizeof(snapshot_header)) {
+        close(fd);
+        throw room_table_exception {"room_table exception: load: " + path + " is not a room snapshot"};
+    }
+
+    // a private mapping lets the table be updated in memory, copying only the pages written to
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED) throw room_table_exception {"room_table exception: load: " + path + ": " + strerror(errno)};
+
+    const snapshot_header* header = static_cast<const snapshot_header*>(mapped);
+    uint64_t capacity = header->capacity;
+
+    bool valid = memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) == 0
+              && header->version == SNAPSHOT_VERSION
+              && header->slot_size == sizeof(room_slot)
+              && capacity >= 16 && (capacity & (capacity - 1)) == 0
+              && header->rooms * 4 <= capacity * 3
+              && size == sizeof(snapshot_header) + capacity * sizeof(room_slot) + header->codes_size;
+
+    if(!valid) {
+        munmap(mapped, size);
+        throw room_table_exception {"room_table exception: load: " + path + " is not a compatible room snapshot"};
+    }
+
+    room_slot* slots = reinterpret_cast<room_slot*>(static_cast<char*>(mapped) + sizeof(snapshot_header));
+    char* codes = reinterpret_cast<char*>(slots + capacity);
+
+    // every interned code must lie within the codes of the snapshot, since lookups read them without checking,
+    // and the rooms must leave free slots, since lookups probe until they reach one
+    uint64_t used = 0;
+    for(uint64_t i = 0; i < capacity; i++) {
+        if(slots[i].code[0] != 0) used++;
+        if(slots[i].code[0] != LONG_CODE) continue;
+
+        uint32_t length;
+        uint64_t position;
+        memcpy(&length, slots[i].code + LONG_CODE_LENGTH, sizeof(length));
+        memcpy(&position, slots[i].code + LONG_CODE_POSITION, sizeof(position));
+
+        if(position > header->codes_size || length > header->codes_size - position) {
+            munmap(mapped, size);
+            throw room_table_exception {"room_table exception: load: " + path + " has a room code outside its snapshot"};
+        }
+    }
+
+    if(used != header->rooms) {
+        munmap(mapped, size);
+        throw room_table_exception {"room_table exception: load: " + path + " holds a different number of rooms than its header counts"};
+    }
+
+    return room_table {slots, capacity, header->rooms, mapped, size, codes, header->codes_size};
+}
+
+
+void room_table::save(const string& path) const {
+    snapshot_header header {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.slot_size = sizeof(room_slot);
+    header.capacity = capacity;
+    header.rooms = rooms;
+    header.codes_size = codes_size;
+
+    // write beside the old snapshot and swap it in, so a backend never maps a partial snapshot
+    const string temp_path = path + ".tmp";
+    int fd = open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd == -1) throw room_table_exception {"room_table exception: save: " + temp_path + ": " + strerror(errno)};
+
+    const char* parts[] = {reinterpret_cast<const char*>(&header), reinterpret_cast<const char*>(slots), codes};
+    size_t sizes[] = {sizeof(header), capacity * sizeof(room_slot), codes_size};
+
+    for(int p = 0; p < 3; p++) {
+        size_t written = 0;
+        while(written < sizes[p]) {
+            ssize_t n = write(fd, parts[p] + written, sizes[p] - written);
+
+            if(n == -1 && errno == EINTR) continue;
+            if(n == -1) {
+                close(fd);
+                throw room_table_exception {"room_table exception: save: " + temp_path + ": " + strerror(errno)};
+            }
+
+            written += n;
+        }
+    }
+
+    if(fsync(fd) == -1 || close(fd) == -1 || rename(temp_path.c_str(), path.c_str()) == -1) {
+        throw room_table_exception {"room_table exception: save: " + path + ": " + strerror(errno)};
+    }
+}
+
+
+room_slot* room_table::probe(string_view room) const {
+    size_t mask = capacity - 1;
+
+    if(!is_long(room)) {
+        // inline codes are compared a word at a time against the padded code of each slot
+        uint64_t key[2] = {0, 0};
+        memcpy(key, room.data(), room.size());
+
+        // linear probing until the room or a free slot is found
+        for(size_t i = hash_key(key) & mask;; i = (i + 1) & mask) {
+            room_slot& slot = slots[i];
+
+            uint64_t code[2];
+            memcpy(code, slot.code, sizeof(code));
+            if(slot.code[0] == 0 || (code[0] == key[0] && code[1] == key[1])) return &slot;
+        }
+    }
+
+    for(size_t i = hash_room(room) & mask;; i = (i + 1) & mask) {
+        room_slot& slot = slots[i];
+        if(slot.code[0] == 0 || (slot.code[0] == LONG_CODE && code(slot) == room)) return &slot;
+    }
+}
+
+
+void room_table::grow() {
+    // interned codes still in a mapped snapshot are copied out before the snapshot is unmapped
+    if(codes_region == nullptr && codes_size > 0) {
+        codes_capacity = max(codes_size, MIN_CODES_CAPACITY);
+        codes_region = map_shared(codes_capacity, "grow");
+        memcpy(codes_region, codes, codes_size);
+        codes = static_cast<char*>(codes_region);
+    }
+
+    size_t larger_capacity = capacity * 2;
+    size_t larger_size = larger_capacity * sizeof(room_slot);
+    room_slot* larger = static_cast<room_slot*>(map_shared(larger_size, "grow"));
+
+    size_t mask = larger_capacity - 1;
+    for(size_t i = 0; i < capacity; i++) {
+        const room_slot& slot = slots[i];
+        if(slot.code[0] == 0) continue;
+
+        // every room is distinct, so each one goes to the first free slot of its probe sequence
+        size_t j = hash_room(code(slot)) & mask;
+        while(larger[j].code[0] != 0) j = (j + 1) & mask;
+
+        memcpy(larger[j].code, slot.code, ROOM_CODE_SIZE);
+        larger[j].owner.store(slot.owner.load(memory_order_relaxed), memory_order_relaxed);
+        larger[j].count.store(slot.count.load(memory_order_relaxed), memory_order_relaxed);
+    }
+
+    munmap(region, region_size);
+    slots = larger;
+    capacity = larger_capacity;
+    region = larger;
+    region_size = larger_size;
+}
+
+
+void room_table::intern(room_slot& slot, string_view room) {
+    if(codes_size + room.size() > codes_capacity) {
+        size_t larger = max(codes_capacity * 2, MIN_CODES_CAPACITY);
+        while(larger < codes_size + room.size()) larger *= 2;
+
+        // shared memory cannot be remapped larger, since the object behind it keeps its size,
+        // so the codes are copied to new memory, out of a mapped snapshot as well
+        void* moved = map_shared(larger, "intern");
+        if(codes_size > 0) memcpy(moved, codes, codes_size);
+        if(codes_region != nullptr) munmap(codes_region, codes_capacity);
+
+        codes_region = moved;
+        codes = static_cast<char*>(moved);
+        codes_capacity = larger;
+    }
+
+    uint32_t length = room.size();
+    uint64_t position = codes_size;
+    memcpy(codes + codes_size, room.data(), room.size());
+    codes_size += room.size();
+
+    slot.code[0] = LONG_CODE;
+    memcpy(slot.code + LONG_CODE_LENGTH, &length, sizeof(length));
+    memcpy(slot.code + LONG_CODE_POSITION, &position, sizeof(position));
+}
+
+
+bool room_table::insert(string_view room, int owner, int count) {
+    if(!storable(room)) return false;
+
+    room_slot* slot = probe(room);
+
+    if(slot->code[0] == 0) {
+        // keep the table at most three quarters full so probe sequences stay short
+        if((rooms + 1) * 4 > capacity * 3) {
+            grow();
+            slot = probe(room);
+        }
+
+        if(is_long(room)) intern(*slot, room);
+        else memcpy(slot->code, room.data(), room.size());
+        rooms++;
+    }
+
+    slot->owner.store(owner, memory_order_relaxed);
+    slot->count.store(count, memory_order_relaxed);
+    return true;
+}
+
+
+bool room_table::erase(string_view room) {
+    room_slot* slot = find(room);
+    if(slot == nullptr) return false;
+
+    // rooms further along the probe sequence are shifted back into the hole,
+    // unless their own probe sequence starts after it, so every room stays reachable without tombstones
+    size_t mask = capacity - 1;
+    size_t hole = slot - slots;
+    for(size_t i = (hole + 1) & mask; slots[i].code[0] != 0; i = (i + 1) & mask) {
+        size_t home = hash_room(code(slots[i])) & mask;
+        if(((i - home) & mask) < ((i - hole) & mask)) continue;
+
+        memcpy(slots[hole].code, slots[i].code, ROOM_CODE_SIZE);
+        slots[hole].owner.store(slots[i].owner.load(memory_order_relaxed), memory_order_relaxed);
+        slots[hole].count.store(slots[i].count.load(memory_order_relaxed), memory_order_relaxed);
+        hole = i;
+    }
+
+    memset(slots[hole].code, 0, ROOM_CODE_SIZE);
+    slots[hole].owner.store(0, memory_order_relaxed);
+    slots[hole].count.store(0, memory_order_relaxed);
+    rooms--;
+    return true;
+}
+
+
+room_slot* room_table::find(string_view room) const {
+    if(!storable(room)) return nullptr;
+
+    room_slot* slot = probe(room);
+    return slot->code[0] == 0 ? nullptr : slot;
+}
+
+
+string_view room_table::code(const room_slot& slot) const {
+    if(slot.code[0] != LONG_CODE) return {slot.code, strnlen(slot.code, ROOM_CODE_SIZE)};
+
+    uint32_t length;
+    uint64_t position;
+    memcpy(&length, slot.code + LONG_CODE_LENGTH, sizeof(length));
+    memcpy(&position, slot.code + LONG_CODE_POSITION, sizeof(position));
+    return {codes + position, length};
+}
+
+
+bool room_table::storable(string_view room) {
+    return !room.empty() && room.find('\0') == string_view::npos;
+}
+
+
+size_t room_table::size() const {
+    return rooms;
+}
+
+
+size_t room_table::memory() const {
+    return capacity * sizeof(room_slot) + codes_capacity;
+}
+
+
+room_table::~room_table() {
+    if(codes_region != nullptr) munmap(codes_region, codes_capacity);
+    if(region != nullptr) munmap(region, region_size);
+}
+
+
+room_table_exception::room_table_exception(const string& err) : std::runtime_error{err} {}
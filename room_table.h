@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// room codes shorter than this are stored inline in table slots, padded with null characters
+// longer codes are interned in the code storage of the table, and their slots point at them
+constexpr size_t ROOM_CODE_SIZE = 16;
+
+/*
+ * struct room_slot is a single entry of a room table
+ * a slot with an empty code is free
+ */
+struct room_slot {
+    char code[ROOM_CODE_SIZE];
+
+    // port of the backend server owning the room, changed by the main server as it moves the room while others route to it
+    std::atomic<int32_t> owner;
+
+    // number of rooms available, kept current as reservations are made
+    std::atomic<int32_t> count;
+};
+
+/*
+ * class room_table is an open addressing hash table of room status,
+ * allocated in memory that stays shared with forked child processes,
+ * so the counts updated by any process or thread are seen by all of them
+ *
+ * a table grows as rooms are inserted, moving to new memory,
+ * so a table shared with child processes or other threads must hold all its rooms before they start
+ *
+ * a table may also be saved to a snapshot file and mapped back as is,
+ * so a large table is ready without parsing or inserting a single room
+ */
+class room_table {
+private:
+    room_slot* slots;
+    size_t capacity;
+    size_t rooms;
+
+    // mapped memory holding the slots, along with a snapshot header and the interned codes for mapped snapshots
+    void* region;
+    size_t region_size;
+
+    // interned codes of the rooms too long to be stored inline, back to back
+    char* codes;
+    size_t codes_size;
+    size_t codes_capacity;
+
+    // mapped memory holding the interned codes once they outgrow a mapped snapshot, or nullptr
+    void* codes_region;
+
+    // the slot holding the room, or the free slot where it belongs
+    room_slot* probe(std::string_view room) const;
+
+    // double the number of slots, inserting every room again
+    void grow();
+
+    // copy a long code into the code storage, growing it as needed, and point the slot at it
+    void intern(room_slot& slot, std::string_view room);
+
+    // adopt slots already laid out in mapped memory
+    room_table(room_slot* slots, size_t capacity, size_t rooms, void* region, size_t region_size, char* codes, size_t codes_size);
+
+public:
+    // allocate a table able to hold the provided number of rooms before growing
+    explicit room_table(size_t max_rooms = 0);
+
+    // map a snapshot written by save, reading its pages from the file as they are first used
+    // changes made to the table stay private to the process and never reach the file
+    static room_table load(const std::string& path);
+
+    // disallow copy operations to maintain unique ownership of the shared memory
+    room_table(const room_table&) = delete;
+    room_table& operator=(const room_table&) = delete;
+
+    // allow moving, leaving the source without memory
+    room_table(room_table&& table);
+
+    // add a room or update an existing one
+    // returns false if the room code cannot be stored
+    bool insert(std::string_view room, int owner, int count);
+
+    // remove a room, returns false if the table does not hold it
+    // the code of an interned room keeps its storage until the table is released
+    bool erase(std::string_view room);
+
+    // returns the slot of the room, or nullptr if the table does not hold it
+    room_slot* find(std::string_view room) const;
+
+    // returns the code of the room held by a slot
+    std::string_view code(const room_slot& slot) const;
+
+    // returns whether a room code can be stored in a table, which requires it to be non-empty without null characters
+    static bool storable(std::string_view room);
+
+    // number of rooms held
+    size_t size() const;
+
+    // bytes of memory taken by the slots and the interned codes
+    size_t memory() const;
+
+    // write the table to a snapshot file, replacing it only once completely written
+    void save(const std::string& path) const;
+
+    // call the provided function with the code and slot of every room
+    template <typename Function>
+    void for_each(Function f) const {
+        for(size_t i = 0; i < capacity; i++) {
+            if(slots[i].code[0] != 0) f(code(slots[i]), slots[i]);
+        }
+    }
+
+    // release the shared memory
+    ~room_table();
+};
+
+class room_table_exception : public std::runtime_error {
+public:
+    room_table_exception(const std::string& err);
+};
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "room_table.h"
+
+using namespace std;
+
+// rooms in the benchmark unless another number is given
+constexpr size_t DEFAULT_ROOMS = 10000000;
+
+// one room in this many has a code too long to be stored inline
+constexpr size_t LONG_CODE_EVERY = 100;
+
+
+// bytes of memory resident in the process, which counts the shared memory of the room table as it is touched
+size_t resident_bytes() {
+    ifstream statm {"/proc/self/statm"};
+    size_t total = 0, resident = 0;
+    statm >> total >> resident;
+
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+
+// seconds elapsed since the provided time
+double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double> {chrono::steady_clock::now() - start}.count();
+}
+
+
+// print one result line, with the rate in millions of operations per second
+void report(const char* structure, const char* operation, size_t operations, double seconds) {
+    printf("%-14s %-16s %8.2f M/s\n", structure, operation, operations / seconds / 1e6);
+}
+
+
+// time inserting, finding and missing every room in a table of room status
+// returns the memory taken per room
+template <typename Insert, typename Find>
+double run(const char* structure, const vector<string>& codes, const vector<string>& lookups, const vector<string>& missing, Insert insert, Find find) {
+    size_t before = resident_bytes();
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < codes.size(); i++) insert(codes[i], static_cast<int>(i & 0xff));
+    report(structure, "insert", codes.size(), seconds_since(start));
+
+    double per_room = static_cast<double>(resident_bytes() - before) / codes.size();
+
+    // found counts are summed so the lookups cannot be optimized away
+    long long sum = 0;
+
+    start = chrono::steady_clock::now();
+    for(const string& code : lookups) sum += find(code);
+    report(structure, "lookup hit", lookups.size(), seconds_since(start));
+
+    start = chrono::steady_clock::now();
+    for(const string& code : missing) sum += find(code);
+    report(structure, "lookup miss", missing.size(), seconds_since(start));
+
+    printf("%-14s %-16s %8.1f bytes/room (checksum %lld)\n", structure, "memory", per_room, sum);
+    return per_room;
+}
+
+
+// compare the flat room table against the node based map it replaced, at the provided number of rooms
+// usage: room_table_bench [rooms], best built with -DCMAKE_BUILD_TYPE=Release
+int main(int argc, char* argv[]) {
+    size_t rooms = argc > 1 ? stoull(argv[1]) : DEFAULT_ROOMS;
+
+    // room codes like the ones of the room status files, with a few too long to be stored inline
+    vector<string> codes {};
+    codes.reserve(rooms);
+    for(size_t i = 0; i < rooms; i++) {
+        if(i % LONG_CODE_EVERY == 0) codes.push_back("SUITE-PENTHOUSE-" + to_string(i));
+        else codes.push_back("SDU"[i % 3] + to_string(i));
+    }
+
+    vector<string> missing {};
+    missing.reserve(rooms / 10);
+    for(size_t i = 0; i < rooms / 10; i++) missing.push_back("Q" + to_string(i));
+
+    // rooms are inserted in one random order and looked up in another,
+    // since looking them up in the order they were inserted would favour a structure allocating in that order
+    mt19937_64 random {42};
+    shuffle(codes.begin(), codes.end(), random);
+
+    vector<string> lookups = codes;
+    shuffle(lookups.begin(), lookups.end(), random);
+
+    cout<<"Benchmarking "<<rooms<<" rooms.\n";
+
+    {
+        room_table table {};
+        run("room_table", codes, lookups, missing,
+            [&](const string& code, int count) { table.insert(code, 0, count); },
+            [&](const string& code) {
+                const room_slot* slot = table.find(code);
+                return slot == nullptr ? 0 : slot->count.load(memory_order_relaxed);
+            });
+        printf("%-14s %-16s %8.1f bytes/room in slots and interned codes\n", "room_table", "memory", static_cast<double>(table.memory()) / rooms);
+    }
+
+    {
+        unordered_map<string, pair<int, int>> map {};
+        run("unordered_map", codes, lookups, missing,
+            [&](const string& code, int count) { map[code] = {0, count}; },
+            [&](const string& code) {
+                unordered_map<string, pair<int, int>>::const_iterator r = map.find(code);
+                return r == map.end() ? 0 : r->second.second;
+            });
+    }
+
+    return 0;
+}
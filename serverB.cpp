@@ -0,0 +1,30 @@
+#include <string>
+
+#include "backend.h"
+#include "logger.h"
+
+// run a backend server of any name, port and room status file, such as one added to the topology
+// the main server takes in a backend server added to the topology, and gives it its rooms, once it reads the topology file again on SIGHUP
+// usage: serverB <name> <port> <room status file> [shards]
+int main(int argc, char* argv[]) {
+    const string usage = "usage: serverB <name> <port> <room status file> [shards]";
+
+    if(argc < 4 || string {argv[1]}.size() != 1) {
+        logging::error()<<usage;
+        return 1;
+    }
+
+    const string port {argv[2]};
+    if(port.empty() || port.size() > 5 || port.find_first_not_of("0123456789") != string::npos || stoi(port) == 0 || stoi(port) > 65535) {
+        logging::error()<<usage;
+        return 1;
+    }
+
+    unsigned int shards = parse_shards(argc, argv, 4);
+    if(shards == 0) {
+        logging::error()<<usage;
+        return 1;
+    }
+
+    return run_backend(argv[1][0], stoi(port), argv[3], shards);
+}
@@ -1,9 +1,16 @@
 #include "backend.h"
+#include "logger.h"
 #include "constants.h"
 
-// run serverD program
-int main() {
+// run serverD program, with its rooms optionally split among the given number of shards
+int main(int argc, char* argv[]) {
     const string filename = "double.txt";
 
-    return run_backend('D', socket_constants::serverD, filename);
+    unsigned int shards = parse_shards(argc, argv, 1);
+    if(shards == 0) {
+        logging::error()<<"usage: serverD [shards]";
+        return 1;
+    }
+
+    return run_backend('D', socket_constants::serverD, filename, shards);
 }
@@ -1,322 +1,504 @@
 #include <algorithm>
-#include <fstream>
-#include <iostream>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <errno.h>
 #include <map>
-#include <sstream>
+#include <optional>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <string>
+#include <string_view>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
 #include <unistd.h>
 #include <unordered_map>
+#include <vector>
 
 #include "socket.h"
+#include "backend_directory.h"
+#include "coordinator.h"
+#include "credential_index.h"
 #include "encrypt.h"
+#include "event_loop.h"
+#include "hash_ring.h"
+#include "logger.h"
+#include "reactor.h"
+#include "port_registrar.h"
+#include "room_table.h"
+#include "status_receiver.h"
+#include "token_table.h"
 #include "constants.h"
 
 using namespace std;
 using namespace socket_constants;
 
 
+// receive buffer asked for on every backend facing socket, so a room status transfer or a burst of responses is queued rather than dropped
+constexpr int TRANSFER_RECEIVE_BUFFER = 4 << 20;
+
 class server_exception : public runtime_error {
 public:
     server_exception(const string& err) : runtime_error{err} {}; 
 };
 
 
-// receive room status from all the backend servers
-unordered_map<string, pair<int, int>> get_room_status(Socket& server_sock, const map<int, char>& backend) {
-    unordered_map<string, pair<int, int>> room_status {};
+// a connection accepted in fork mode, waiting for the socket of its child to be registered with the backend servers
+struct waiting_connection {
+    Socket client;
+    Socket child_sock;
+    int port;
+};
 
-    // map track keeps track of which backend servers have finished transmitting their status
-    map<int, bool> track {};
-    for(const pair<int, char>& i : backend) track.insert({i.first, false});
+
+// receive room status from all the backend servers
+// the rooms go straight into a table shared by every process and thread of the main server, which grows as they arrive
+void get_room_status(Socket& server_sock, status_receiver& transfers) {
+    // the chunks of every backend server can arrive at once, queue them rather than drop them
+    server_sock.set_receive_buffer(TRANSFER_RECEIVE_BUFFER);
 
     // keep receiving status information until all the backend servers have finished transmitting
-    while(any_of(track.begin(), track.end(), [](const pair<int, bool>& s) { return !s.second; })) {
-        msg_port rec = server_sock.recv_info_from();
-
-        map<int, bool>::iterator tf = track.find(rec.port);
-        if(tf != track.end() && tf->second == false) {
-            string room;
-            int number;
-            string next_line;
-            istringstream sstream {rec.msg};
-            while(sstream.good() && getline(sstream, room, ',') && sstream >> number) {
-                if(room == "" && to_string(number) == FINISH_STATUS) {
-                    // backend server has finished transmission
-                    tf->second = true;
-                    cout<<"The main server has received the room status from Server "<<backend.find(rec.port)->second<<" using UDP over port "<<serverM_backend<<".\n";
-                    break;
+    while(!transfers.complete()) {
+        transfers.receive(server_sock, server_sock.recv_info_from());
+    }
+}
 
-                } else {
-                    // save room status information, mapping a room to its corresponding server (port number) and the count of the room
-                    room_status[room] = {rec.port, number};
-                    getline(sstream, next_line);
 
-                }
-            }
+// take in the datagrams queued on the backend port of the main server while worker threads or forked children serve clients
+void read_backend_port(Socket& server_sock, coordinator& coord) {
+    while(optional<msg_port> rec = server_sock.try_recv_info_from()) {
+        if(!coord.receive(*rec)) {
+            logging::warning()<<"The main server has received a response from an unexpected Server with port "<<rec->port<<".";
         }
     }
-
-    return room_status;
 }
 
 
-// read and store the encrypted usernames and passwords information from the given file
-unordered_map<string, string> get_user_info(const string& user_filename) {
-    unordered_map<string, string> user_info {};
-    ifstream f {user_filename};
-
-    if(!f.good()) throw server_exception {"server exception: get_user_info: file " + user_filename + " does not exist"};
-
-    string username, password;
-    while(getline(f, username, ',') && f.ignore() && getline(f, password)) {
-        user_info[username] = password;
+// serve the backend port of the main server until done returns true, such as once the rooms of a startup rebalancing are moved
+template <typename Done>
+void serve_backend_port(Socket& server_sock, coordinator& coord, Done done) {
+    while(!done()) {
+        if(server_sock.wait_readable(coord.next_timeout())) read_backend_port(server_sock, coord);
+        coord.expire();
     }
-
-    return user_info;
 }
 
 
-// authenticate the user credentials by comparing it to the stored user information
-bool authenticate(Socket& child, const unordered_map<string, string>& user_info, bool& member, string& username, bool& open) {
-    bool success = false;
-    string auth = child.recv_info();
+// map the index of the encrypted usernames and passwords written beside the given file, such as member.idx for member.txt,
+// or build the index from the file itself when there is no index or it is older than the file
+credential_index get_user_info(const string& user_filename) {
+    const string index = user_filename.substr(0, user_filename.rfind('.')) + ".idx";
 
-    string password;
-    istringstream sstream {auth};
+    struct stat file_info, index_info;
+    bool file_exists = stat(user_filename.c_str(), &file_info) == 0;
 
-    // mark connection as closed if an empty string is received
-    if(!getline(sstream, username)) {
-        cout<<"The client with port "<<child.connected_port<<" has closed the connection.\n";
-        open = false;
-        return false;
-    }
-
-    if(getline(sstream, password)) {
-        // a password implies a member request
-        cout<<"The main server received the authentication for "<<username<<" using TCP over port "<<serverM_client<<".\n";
-        
-        // lookup the user info for the valid user credentials
-        unordered_map<string, string>::const_iterator saved_info = user_info.find(username);
-        if(saved_info != user_info.end()) {
-            if(saved_info->second == password) {
-                member = true;
-                success = true;
-                child.send_info(VALID_MEMBER);
-            } else {
-                child.send_info(INVALID_PASSWORD);
-            }
+    if(stat(index.c_str(), &index_info) == 0) {
+        if(file_exists && file_info.st_mtim.tv_sec > index_info.st_mtim.tv_sec) {
+            logging::warning()<<"The main server found the index "<<index<<" older than "<<user_filename<<", reading the file instead.";
         } else {
-            child.send_info(INVALID_USER);
+            // an index written by another version is skipped until it is made again
+            try {
+                return credential_index::load(index);
+            } catch(credential_index_exception& ce) {
+                logging::warning()<<ce.what()<<", reading "<<user_filename<<" instead.";
+            }
         }
-        cout<<"The main server sent the authentication result to the client.\n";
-    } else {
-        // an empty password implies a guest request
-        cout<<"The main server has received the guest request for "<<username<<" using TCP over port "<<serverM_client<<".\n";
-        success = true;
-        member = false;
-        cout<<"The main server accepts "<<username<<" as a guest.\n";
-
-        child.send_info(VALID_GUEST);
-
-        cout<<"The main server sent the guest response to the client.\n";
     }
 
-    return success;
+    if(!file_exists) throw server_exception {"server exception: get_user_info: file " + user_filename + " does not exist"};
+
+    return credential_index::build(user_filename);
 }
 
 
-// satisfy availability requests from a client by querying the appropriate backend server
-void availability_request(Socket& child, Socket& server_sock, const map<char, int>& router, const string& request, const string& room) {
-    // the first character of the room is the name of the related backend server
-    const char server_name = room[0];
-    map<char, int>::const_iterator route_server = router.find(server_name);
+// serverM can serve clients by forking a process per connection,
+// from a single process driving non-blocking connections through epoll,
+// or from several worker threads each running its own epoll loop
+enum class server_mode { fork, epoll, threads };
 
-    if(route_server == router.end()) {
-        cout<<"The main server found no corresponding Server for room "<<room<<".\n";
-        child.send_info(ROOM_NOT_FOUND);
-    } else {
-        server_sock.send_info_to(route_server->second, request);
-        cout<<"The main server sent a request to Server "<<server_name<<".\n";
+struct server_options {
+    server_mode mode {server_mode::fork};
 
-        msg_port response = server_sock.recv_info_from();
+    // number of worker threads in threads mode
+    unsigned int workers {1};
 
-        if(response.port != route_server->second) {
-            cout<<"The main server has received a response from an unexpected Server with port "<<response.port<<".\n";
-            child.send_info(ROOM_NOT_FOUND);
-        } else {
-            cout<<"The main server received the response from Server "<<server_name<<" using UDP over port "<<serverM_backend<<".\n";
+    // pin each worker thread to its own CPU
+    bool pin {false};
+};
 
-            if(response.msg != "") {
-                child.send_info(response.msg);
-            } else {
-                cout<<"The backend Server "<<server_name<<" has sent an empty response.\n";
-                child.send_info(ROOM_NOT_FOUND);
-            }
-        }
-    }
 
-    cout<<"The main server sent the availability information to the client.\n";
-}
+// parse the command line options
+// usage: serverM [fork|epoll|threads [workers] [pin]]
+// the backend servers are read from topology.txt as the main server starts, and again on SIGHUP,
+// so a backend server added to or removed from it takes part, or has its rooms moved away, while clients are served
+server_options parse_options(int argc, char* argv[]) {
+    constexpr char usage[] = "server exception: parse_options: usage: serverM [fork|epoll|threads [workers] [pin]]";
+    server_options options {};
 
+    if(argc < 2) return options;
 
-// satisfy reservation requests from a client by querying the appropriate backend server
-void create_reservation(Socket& child, Socket& server_sock, const map<char, int>& router, unordered_map<string, pair<int, int>>& room_status, const string& request, const string& room, const bool member, const string& username) {
-    // a guest cannot make a reservation
-    if(!member) {
-        cout<<username<<" cannot make a reservation.\n";
-        child.send_info(USER_NOT_MEMBER);
+    string mode {argv[1]};
+    if(mode == "fork") options.mode = server_mode::fork;
+    else if(mode == "epoll") options.mode = server_mode::epoll;
+    else if(mode == "threads") options.mode = server_mode::threads;
+    else throw server_exception {usage};
 
-        cout<<"The main server sent the error message to the client.\n";
-        return;
+    if(options.mode != server_mode::threads) {
+        if(argc > 2) throw server_exception {usage};
+        return options;
     }
 
-    // the first character of the room is the name of the related backend server
-    const char server_name = room[0];
-    map<char, int>::const_iterator route_server = router.find(server_name);
+    // default to one worker per CPU
+    options.workers = max(1u, thread::hardware_concurrency());
 
-    if(route_server == router.end()) {
-        cout<<"The main server found no corresponding Server for room "<<room<<".\n";
-        child.send_info(ROOM_NOT_FOUND);
-    } else {
-        server_sock.send_info_to(route_server->second, request);
-        cout<<"The main server sent a request to Server "<<server_name<<".\n";
+    for(int i = 2; i < argc; i++) {
+        const string arg {argv[i]};
 
-        msg_port response = server_sock.recv_info_from();
+        // a worker count is the whole argument, between 1 and 999
+        unsigned int workers = 0;
+        from_chars_result parsed = from_chars(arg.data(), arg.data() + arg.size(), workers);
 
-        if(response.port != route_server->second) {
-            cout<<"The main server has received a response from an unexpected Server with port "<<response.port<<".\n";
-            child.send_info(ROOM_NOT_FOUND);
+        if(arg == "pin") {
+            options.pin = true;
+        } else if(parsed.ec == errc {} && parsed.ptr == arg.data() + arg.size() && workers > 0 && workers < 1000) {
+            options.workers = workers;
         } else {
-            string response_code;
-            istringstream sstream {response.msg};
-            getline(sstream, response_code);
-
-            // if a successful reservation is made, update the room status
-            if(response_code == ROOM_AVAILABLE) {
-                cout<<"The main server received the response and the updated room status from Server "<<server_name<<" using UDP over port "<<serverM_backend<<".\n";
-
-                int status;
-                if(sstream >> status) room_status[room].second = status;
-                else room_status[room].second = 0;
-                cout<<"The room status of Room "<<room<<" has been updated.\n";
-
-                child.send_info(response_code);
-            } else {
-                cout<<"The main server received the response from Server "<<server_name<<" using UDP over port "<<serverM_backend<<".\n";
-
-                if(response_code != "") {
-                    child.send_info(response_code);
-                } else {
-                    cout<<"The backend Server "<<server_name<<" has sent an empty response.\n";
-                    child.send_info(ROOM_NOT_FOUND);
-                }
-            }
+            throw server_exception {usage};
         }
     }
 
-    cout<<"The main server sent the reservation result to the client.\n";
+    return options;
 }
 
 
-// accept availability and reservation requests from the client and respond appropriately
-void accept_request(Socket& child, Socket& server_sock, const map<char, int>& router, unordered_map<string, pair<int, int>>& room_status, const bool member, const string& username, bool& open) {
-    string request = child.recv_info();
+// a worker owns a listening socket sharing the client port with the other workers,
+// and a backend facing UDP socket of its own, and serves its connections through an epoll loop
+// stopped is signalled once the worker returns
+void run_worker(unsigned int index, bool pin, Socket server_sock, const backend_directory& backends,
+                room_table& room_status, const credential_index& user_info, token_table& tokens,
+                stats_registry& stats, int stopped) {
+    constexpr bool debug = false;
 
-    string request_type, room;
-    istringstream sstream {request};
+    try {
+        if(pin) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(index % max(1u, thread::hardware_concurrency()), &cpus);
 
-    // an empty input indicates a broken connection
-    if(!getline(sstream, request_type)) {
-        cout<<"The client with port "<<child.connected_port<<" has closed the connection.\n";
-        open = false;
-        return;
-    }
+            int status = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+            if(status != 0) logging::warning()<<"The main server could not pin worker "<<index<<": "<<strerror(status)<<".";
+        }
 
-    if(!getline(sstream, room)) {
-        cout<<"The main server received a request with a missing room using TCP over port "<<serverM_client<<".\n";
-        child.send_info(ROOM_EMPTY);
-        return;
-    }
+        // the kernel balances new connections across the listening sockets of all workers
+        Socket client_sock {-1, SOCK_STREAM, serverM_client, debug};
+        client_sock.bind_socket(serverM_client, true);
+        client_sock.listen_socket();
 
-    if(request_type == AVAILABILITY_REQUEST) {
-        cout<<"The main server has received the availability request on Room "<<room<<" from "<<username<<" using TCP over port "<<serverM_client<<".\n";
-        availability_request(child, server_sock, router, request, room);
-    } else if(request_type == RESERVATION_REQUEST) {
-        cout<<"The main server has received the reservation request on Room "<<room<<" from "<<username<<" using TCP over port "<<serverM_client<<".\n";
-        create_reservation(child, server_sock, router, room_status, request, room, member, username);
-    } else {
-        cout<<"The main server received an invalid request type using TCP over port "<<serverM_client<<".\n";
-        child.send_info(INVALID_REQUEST);
+        uint32_t request_id = 0;
+        reactor engine {&client_sock, server_sock, request_id, nullptr, backends, room_status, user_info, tokens, stats};
+        engine.run();
+
+    } catch(socket_exception& se) {
+        logging::error()<<se.what();
+    } catch(event_loop_exception& ee) {
+        logging::error()<<ee.what();
     }
+
+    eventfd_write(stopped, 1);
 }
 
 
 // the main server is responsible for acting as an intermediary between the client and the backend servers
 // it satisfies client authentication requests by reading user information from a file
 // it satisfies client availability and reservation requests by querying the backend servers
-int main() {
+int main(int argc, char* argv[]) {
     constexpr bool debug = false;
 
-    // collection of backend servers, mapping their port to their names
-    const map<int, char> backend {{serverS, 'S'}, {serverD, 'D'}, {serverU, 'U'}};
-
-    // router is a map between server names and their corresponding ports
-    map<char, int> router {};
-    for(const pair<int, char>& b : backend) router[b.second] = b.first;
+    const string topology_filename = "topology.txt";
 
     try {
+        server_options options = parse_options(argc, argv);
+
+        // collection of backend servers, mapping their port to their names, added to as the topology file is read again
+        bool by_prefix = false;
+        map<int, char> backend = get_topology(topology_filename, by_prefix);
+
+        // the ring maps each room to the port of the backend server owning it
+        const hash_ring ring {backend, by_prefix};
+
         // create and bind the backend facing UDP socket
         Socket server_sock {-1, SOCK_DGRAM, serverM_backend, debug};
         server_sock.bind_socket(serverM_backend);
 
         // create and bind the client facing TCP socket
+        // in threads mode, it only reserves the port until the workers bind their own sockets
         Socket client_sock {-1, SOCK_STREAM, serverM_client, debug};
-        client_sock.bind_socket(serverM_client);
+        client_sock.bind_socket(serverM_client, options.mode == server_mode::threads);
+
+        logging::info()<<"The main server is up and running.";
+
+        // room_status is a hash table in shared memory, mapping each room to its corresponding backend server and its count
+        // forked children and worker threads all see the counts kept current by reservations
+        room_table room_status {};
+
+        // the transfers of room status go on while serving, since a backend server that restarts sends its room status again
+        status_receiver transfers {backend, ring, room_status};
+        get_room_status(server_sock, transfers);
+
+        transfers.serve();
+
+        // the backend servers are named in shared memory, so every child and worker knows those added while serving
+        backend_directory backends {backend};
+
+        // ids of the requests sent from the backend port, shared by the coordinator and, in epoll mode, the reactor
+        uint32_t request_id = 0;
 
-        cout<<"The main server is up and running.\n";
+        // the backend port takes in transfers, registrations and rebalancing, and the topology file read again on SIGHUP
+        port_registrar registrar {server_sock, backend, request_id};
+        coordinator coord {server_sock, backend, backends, transfers, registrar, room_status, request_id, ring, topology_filename};
 
-        // room_status is a hashmap, mapping each room to its corresponding backend server and its count
-        unordered_map<string, pair<int, int>> room_status = get_room_status(server_sock, backend);
+        // rooms held by a backend server other than their owner on the ring, such as after a backend server was added
+        // while the main server was down, are moved to their owner before any client is served
+        coord.rebalance(transfers.stray_rooms());
+        serve_backend_port(server_sock, coord, [&] { return coord.settled(); });
 
-        // user_info is a hashmap between usernames and corresponding passwords
-        unordered_map<string, string> user_info = get_user_info(user_filename);
+        // user_info maps usernames to their passwords, searched in place within mapped memory
+        credential_index user_info = get_user_info(user_filename);
+
+        // session tokens live in shared memory, so a client resuming its session may land on any child or worker
+        token_table tokens {};
+
+        // counters and latencies are shared the same way, so a single stats request reports every child and worker
+        stats_registry stats = reactor::make_stats();
+
+        if(options.mode == server_mode::threads) {
+            // a socket in the group that never listens would not receive connections, close it regardless
+            client_sock.close_socket();
+
+            // backend servers respond to the port a request came from, so any free port will do,
+            // once the backend servers are told to serve it
+            vector<Socket> worker_socks {};
+            vector<int> ports {};
+            for(unsigned int i = 0; i < options.workers; i++) {
+                Socket sock {-1, SOCK_DGRAM, -1, debug};
+                sock.bind_socket(0);
+                sock.set_receive_buffer(TRANSFER_RECEIVE_BUFFER);
+
+                ports.push_back(sock.bound_port());
+                worker_socks.push_back(std::move(sock));
+            }
+
+            // the main thread keeps the backend port, and registers the ports of the workers
+            registrar.add(ports);
+
+            // the workers start once every backend server serves their ports
+            serve_backend_port(server_sock, coord, [&] { return all_of(ports.begin(), ports.end(), [&](int port) { return registrar.ready(port); }); });
+
+            // signalled by each worker as it stops
+            int stopped = eventfd(0, EFD_CLOEXEC);
+            if(stopped == -1) throw server_exception {string {"server exception: eventfd: "} + strerror(errno)};
+
+            event_loop loop {};
+            loop.add(server_sock.descriptor(), EPOLLIN);
+            loop.add(stopped, EPOLLIN);
+            loop.add(coord.descriptor(), EPOLLIN);
+
+            vector<thread> workers {};
+            for(unsigned int i = 0; i < options.workers; i++) {
+                workers.emplace_back(run_worker, i, options.pin, std::move(worker_socks[i]), cref(backends), ref(room_status), cref(user_info), ref(tokens), ref(stats), stopped);
+            }
+
+            // while the workers serve clients, backend servers that restart are given their room status back and the ports of the workers,
+            // and rooms are moved as the topology changes
+            epoll_event events[event_loop::MAXEVENTS];
+            unsigned int running = options.workers;
+            while(running > 0) {
+                int ready = loop.wait(events, coord.next_timeout());
+
+                for(int i = 0; i < ready; i++) {
+                    if(events[i].data.fd == stopped) {
+                        eventfd_t count;
+                        eventfd_read(stopped, &count);
+                        running -= count;
+                        continue;
+                    }
+
+                    if(events[i].data.fd == coord.descriptor()) {
+                        coord.reload();
+                        continue;
+                    }
+
+                    try {
+                        read_backend_port(server_sock, coord);
+                    } catch(socket_exception& se) {
+                        // the workers keep serving, and the backend servers send again what went unanswered
+                        logging::error()<<se.what();
+                    }
+                }
+
+                coord.expire();
+            }
+
+            for(thread& w : workers) w.join();
+            close(stopped);
+            return 0;
+        }
 
         client_sock.listen_socket();
-        client_sock.reap_dead_processes();
 
+        if(options.mode == server_mode::epoll) {
+            // a single process drives every connection, and carries out the duties of the backend port along with them
+            reactor engine {&client_sock, server_sock, request_id, &coord, backends, room_status, user_info, tokens, stats};
+            engine.run();
+            return 0;
+        }
+
+        // children are reaped by the parent, which then unregisters the ports of their sockets,
+        // whether they closed their connection or crashed
+        sigset_t sigchld, unblocked;
+        sigemptyset(&sigchld);
+        sigaddset(&sigchld, SIGCHLD);
+        if(sigprocmask(SIG_BLOCK, &sigchld, &unblocked) == -1) throw server_exception {string {"server exception: sigprocmask: "} + strerror(errno)};
+
+        int reaped = signalfd(-1, &sigchld, SFD_NONBLOCK | SFD_CLOEXEC);
+        if(reaped == -1) throw server_exception {string {"server exception: signalfd: "} + strerror(errno)};
+
+        // the parent keeps the backend port, and registers the socket of each child before forking it,
+        // without holding up the connections accepted meanwhile
+        deque<waiting_connection> waiting {};
+        unordered_map<pid_t, int> children {};
+
+        // a port is unregistered once no child or waiting connection has a socket bound to it,
+        // the port of a child that exited may be bound again before the child is reaped
+        auto release_port = [&](int port) {
+            bool bound = any_of(waiting.begin(), waiting.end(), [&](const waiting_connection& w) { return w.port == port; }) ||
+                         any_of(children.begin(), children.end(), [&](const pair<const pid_t, int>& c) { return c.second == port; });
+            if(!bound) registrar.remove({port});
+        };
+
+        client_sock.set_nonblocking();
+
+        event_loop loop {};
+        loop.add(client_sock.descriptor(), EPOLLIN);
+        loop.add(server_sock.descriptor(), EPOLLIN);
+        loop.add(reaped, EPOLLIN);
+        loop.add(coord.descriptor(), EPOLLIN);
+
+        epoll_event events[event_loop::MAXEVENTS];
         while(true) {
-            Socket child = client_sock.accept_socket();
-
-            // fork the process to allow the parent socket to continue listening and accepting connections
-            if(!fork()) {
-                // parent socket is no longer required
-                client_sock.close_socket();
-
-                bool open = true;
-                bool member = false;
-                string username;
-
-                // accept authentication requests until the client is successfully authenticated,
-                // or until the connection is closed
-                bool success = false;
-                while(open && !success) {
-                    success = authenticate(child, user_info, member, username, open);
+            int ready = loop.wait(events, coord.next_timeout());
+
+            for(int i = 0; i < ready; i++) {
+                int fd = events[i].data.fd;
+
+                if(fd == client_sock.descriptor()) {
+                    while(optional<Socket> client = client_sock.try_accept_socket()) {
+                        // a socket of its own keeps the child from reading responses meant for its siblings
+                        Socket child_sock {-1, SOCK_DGRAM, -1, debug};
+                        child_sock.bind_socket(0);
+                        child_sock.set_receive_buffer(TRANSFER_RECEIVE_BUFFER);
+
+                        int port = child_sock.bound_port();
+                        registrar.add({port});
+                        waiting.push_back({std::move(*client), std::move(child_sock), port});
+                    }
+                } else if(fd == reaped) {
+                    signalfd_siginfo info;
+                    while(read(reaped, &info, sizeof(info)) == sizeof(info));
+
+                    pid_t pid;
+                    while((pid = waitpid(-1, nullptr, WNOHANG)) > 0) {
+                        unordered_map<pid_t, int>::iterator child = children.find(pid);
+                        if(child == children.end()) continue;
+
+                        int port = child->second;
+                        children.erase(child);
+                        release_port(port);
+                    }
+                } else if(fd == coord.descriptor()) {
+                    coord.reload();
+                } else {
+                    try {
+                        read_backend_port(server_sock, coord);
+                    } catch(socket_exception& se) {
+                        // the children keep serving, and the backend servers send again what went unanswered
+                        logging::error()<<se.what();
+                    }
                 }
+            }
 
-                // accept availability and reservation requests until the connection is closed
-                while(open) {
-                    accept_request(child, server_sock, router, room_status, member, username, open);
+            coord.expire();
+
+            // connections are forked in the order they were accepted, as their sockets are registered
+            while(!waiting.empty() && registrar.ready(waiting.front().port)) {
+                waiting_connection next = std::move(waiting.front());
+                waiting.pop_front();
+
+                // fork the process to allow the parent socket to continue listening and accepting connections
+                pid_t pid = fork();
+                if(pid == -1) {
+                    logging::error()<<"server exception: fork: "<<strerror(errno);
+                    next.client.close_socket();
+                    next.child_sock.close_socket();
+                    release_port(next.port);
+                    continue;
                 }
 
-                break;
+                if(pid == 0) {
+                    // parent sockets and the connections left to its siblings are no longer required
+                    client_sock.close_socket();
+                    server_sock.close_socket();
+                    close(reaped);
+                    waiting.clear();
+                    sigprocmask(SIG_SETMASK, &unblocked, nullptr);
+
+                    // the child serves its connection until it is closed
+                    // SIGHUP stays blocked, so only the parent reads the topology file again
+                    uint32_t child_request_id = 0;
+                    reactor engine {nullptr, next.child_sock, child_request_id, nullptr, backends, room_status, user_info, tokens, stats};
+                    engine.adopt(std::move(next.client));
+                    engine.run();
+                    return 0;
+                }
+
+                children.emplace(pid, next.port);
             }
         }
 
         return 0;
 
     } catch(socket_exception& se) {
-        cout<<se.what()<<endl;
+        logging::error()<<se.what();
+        return 1;
+    } catch(server_exception& se) {
+        logging::error()<<se.what();
+        return 1;
+    } catch(event_loop_exception& ee) {
+        logging::error()<<ee.what();
+        return 1;
+    } catch(coordinator_exception& ce) {
+        logging::error()<<ce.what();
+        return 1;
+    } catch(backend_directory_exception& be) {
+        logging::error()<<be.what();
+        return 1;
+    } catch(room_table_exception& re) {
+        logging::error()<<re.what();
+        return 1;
+    } catch(credential_index_exception& ce) {
+        logging::error()<<ce.what();
+        return 1;
+    } catch(token_table_exception& te) {
+        logging::error()<<te.what();
+        return 1;
+    } catch(stats_exception& se) {
+        logging::error()<<se.what();
         return 1;
     }
 }
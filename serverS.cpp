@@ -1,9 +1,16 @@
 #include "backend.h"
+#include "logger.h"
 #include "constants.h"
 
-// run serverS program
-int main() {
+// run serverS program, with its rooms optionally split among the given number of shards
+int main(int argc, char* argv[]) {
     const string filename = "single.txt";
 
-    return run_backend('S', socket_constants::serverS, filename);
+    unsigned int shards = parse_shards(argc, argv, 1);
+    if(shards == 0) {
+        logging::error()<<"usage: serverS [shards]";
+        return 1;
+    }
+
+    return run_backend('S', socket_constants::serverS, filename, shards);
 }
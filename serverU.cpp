@@ -1,9 +1,16 @@
 #include "backend.h"
+#include "logger.h"
 #include "constants.h"
 
-// run serverU program
-int main() {
+// run serverU program, with its rooms optionally split among the given number of shards
+int main(int argc, char* argv[]) {
     const string filename = "suite.txt";
 
-    return run_backend('U', socket_constants::serverU, filename);
+    unsigned int shards = parse_shards(argc, argv, 1);
+    if(shards == 0) {
+        logging::error()<<"usage: serverU [shards]";
+        return 1;
+    }
+
+    return run_backend('U', socket_constants::serverU, filename, shards);
 }
@@ -1,20 +1,27 @@
 #include <cstring>
-#include <iostream>
 #include <string>
+#include <vector>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
+#include "logger.h"
 #include "socket.h"
 
 using namespace std;
 
-Socket::Socket(int sfd, int stype, int port, bool dbg): sockfd {-1}, socktype {stype}, saved_addr {}, saved_port {port}, debug {dbg} {
+datagram_batch::datagram_batch(size_t capacity):
+    capacity {capacity}, data(capacity * Socket::MAXDATAGRAMSIZE), senders(capacity), buffers(capacity), headers(capacity) {}
+
+Socket::Socket(int sfd, int stype, int port, bool dbg): sockfd {-1}, socktype {stype}, saved_addr {}, saved_port {port}, peers {stype}, debug {dbg} {
     if(sfd >= 0) {
         // use the provided socket descriptor
         sockfd = sfd;
@@ -23,10 +30,10 @@ Socket::Socket(int sfd, int stype, int port, bool dbg): sockfd {-1}, socktype {s
         // create a new socket
         try {
             // if a valid port is provided, the address can be utilized for later operations like binding and connecting
-            if(port >= 0) saved_addr.populate(socktype, port);
+            if(port >= 0) saved_addr.populate(socktype, port, endpoint_registry::bind_host());
             else {
                 saved_port = -1;
-                saved_addr.populate(socktype);
+                saved_addr.populate(socktype, 0, endpoint_registry::bind_host());
             }
         } catch (address_list_err& err) {
             throw socket_exception {string {"socket exception: Socket: "} + err.what()};
@@ -39,7 +46,7 @@ Socket::Socket(int sfd, int stype, int port, bool dbg): sockfd {-1}, socktype {s
             sockfd = socket(itr->ai_family, itr->ai_socktype, itr->ai_protocol);
 
             if(sockfd == -1) {
-                if(debug) cout<<"invalid socket address: "<<strerror(errno)<<endl;
+                if(debug) logging::debug()<<"invalid socket address: "<<strerror(errno);
                 continue;
             } else break;
         }
@@ -47,13 +54,13 @@ Socket::Socket(int sfd, int stype, int port, bool dbg): sockfd {-1}, socktype {s
         if(itr == nullptr) throw socket_exception{"socket exception: Socket: no valid address to create socket"};
     }
 
-    if(debug) cout<<"Constructed socket with file descriptor: "<<sockfd<<endl;
+    if(debug) logging::debug()<<"Constructed socket with file descriptor: "<<sockfd;
 }
 
-Socket::Socket(Socket&& sock): sockfd {sock.sockfd}, socktype {sock.socktype}, saved_addr {}, saved_port {-1}, debug {sock.debug} {
+Socket::Socket(Socket&& sock): sockfd {sock.sockfd}, socktype {sock.socktype}, saved_addr {}, saved_port {-1}, peers {std::move(sock.peers)}, debug {sock.debug} {
     // manage ownership
     sock.sockfd = -1;
-    if(debug) cout<<"Moving socket: "<<sockfd<<endl;
+    if(debug) logging::debug()<<"Moving socket: "<<sockfd;
 }
 
 Socket& Socket::operator=(Socket&& sock) {
@@ -61,16 +68,17 @@ Socket& Socket::operator=(Socket&& sock) {
 
     sockfd = sock.sockfd;
     socktype = sock.socktype;
+    peers = std::move(sock.peers);
     debug = sock.debug;
 
     // manage ownership
     sock.sockfd = -1;
-    if(debug) cout<<"Moving socket: "<<sockfd<<endl;
+    if(debug) logging::debug()<<"Moving socket: "<<sockfd;
 
     return *this;
 }
 
-void Socket::bind_socket(int port) {
+void Socket::bind_socket(int port, bool reuse_port) {
     // Operations borrowed from Beej's Guide
     // prevent "Address already in use" error
     int yes = 1;
@@ -78,6 +86,10 @@ void Socket::bind_socket(int port) {
         throw socket_exception {string {"socket exception: setsockopt: "} + strerror(errno)};
     }
 
+    if(reuse_port && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int)) == -1) {
+        throw socket_exception {string {"socket exception: setsockopt: "} + strerror(errno)};
+    }
+
     address_list bind_addr {};
     addrinfo* itr = nullptr;
     if(port == saved_port) {
@@ -85,7 +97,7 @@ void Socket::bind_socket(int port) {
         itr = saved_addr.info;
     } else {
         try {
-            bind_addr.populate(socktype, port);
+            bind_addr.populate(socktype, port, endpoint_registry::bind_host());
         } catch (address_list_err& err) {
             throw socket_exception {string {"socket exception: bind_socket: "} + err.what()};
         }
@@ -99,13 +111,13 @@ void Socket::bind_socket(int port) {
         int status = bind(sockfd, itr->ai_addr, itr->ai_addrlen);
 
         if(status == -1) {
-            if(debug) cout<<"invalid socket bind address: "<<strerror(errno)<<endl;
+            if(debug) logging::debug()<<"invalid socket bind address: "<<strerror(errno);
             continue;
         } else break;
     }
     if(itr == nullptr) throw socket_exception {"socket exception: bind_socket: no valid address to bind socket"};
 
-    if(debug) cout<<"Bound socket "<<sockfd<<" to port: "<<port<<endl;
+    if(debug) logging::debug()<<"Bound socket "<<sockfd<<" to port: "<<port;
 }
 
 void Socket::listen_socket() {
@@ -117,7 +129,7 @@ void Socket::listen_socket() {
         throw socket_exception {string {"socket exception: listen_socket: "} + strerror(errno)};
     }
 
-    if(debug) cout<<"Listening on socket "<<sockfd<<endl;
+    if(debug) logging::debug()<<"Listening on socket "<<sockfd;
 }
 
 void Socket::connect_socket(int port) {
@@ -128,7 +140,7 @@ void Socket::connect_socket(int port) {
         itr = saved_addr.info;
     } else {
         try {
-            connect_addr.populate(socktype, port);
+            connect_addr.populate(socktype, port, endpoint_registry::host(port));
         } catch (address_list_err& err) {
             throw socket_exception {string {"socket exception: connect_socket: "} + err.what()};
         }
@@ -142,14 +154,14 @@ void Socket::connect_socket(int port) {
         int status = connect(sockfd, itr->ai_addr, itr->ai_addrlen);
 
         if(status == -1) {
-            if(debug) cout<<"invalid socket connect address: "<<strerror(errno)<<endl;
+            if(debug) logging::debug()<<"invalid socket connect address: "<<strerror(errno);
         } else break;
     }
     if(itr == nullptr) throw socket_exception {"socket exception: connect_socket: no valid address to connect socket"};
 
     // save connected port
     connected_port = port;
-    if(debug) cout<<"Connected socket "<<sockfd<<" to port: "<<port<<endl;
+    if(debug) logging::debug()<<"Connected socket "<<sockfd<<" to port: "<<port;
 }
 
 Socket Socket::accept_socket() {
@@ -168,11 +180,32 @@ Socket Socket::accept_socket() {
 
     // save connected port
     child.connected_port = ntohs(((sockaddr_in*) &connected_to)->sin_port);
-    if(debug) cout<<"Socket "<<sockfd<<" established connection with port: "<<child.connected_port<<endl;
+    if(debug) logging::debug()<<"Socket "<<sockfd<<" established connection with port: "<<child.connected_port;
 
     return child;
 };
 
+optional<Socket> Socket::try_accept_socket() {
+    sockaddr_storage connected_to;
+    socklen_t sin_size = sizeof(connected_to);
+
+    // accept connection and create a child socket, if one is pending
+    int childfd = accept(sockfd, (sockaddr*) &connected_to, &sin_size);
+
+    if(childfd == -1) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED) return nullopt;
+        throw socket_exception {string {"socket exception: try_accept_socket: "} + strerror(errno)};
+    }
+
+    Socket child {childfd, socktype, -1, debug};
+
+    // save connected port
+    child.connected_port = ntohs(((sockaddr_in*) &connected_to)->sin_port);
+    if(debug) logging::debug()<<"Socket "<<sockfd<<" established connection with port: "<<child.connected_port;
+
+    return child;
+}
+
 void Socket::send_info(const string& s) {
     // Operations borrowed from Beej's Guide
     // send information to the connected socket
@@ -182,7 +215,7 @@ void Socket::send_info(const string& s) {
         throw socket_exception {string {"socket exception: send_info: "} + strerror(errno)};
     }
 
-    if(debug) cout<<"Sent "<<sent<<" bytes of message: "<<s<<endl;
+    if(debug) logging::debug()<<"Sent "<<sent<<" bytes of message: "<<s;
 }
 
 string Socket::recv_info() {
@@ -199,38 +232,87 @@ string Socket::recv_info() {
     data[received] = 0;
     string rec {data};
 
-    if(debug && received > 0) cout<<"Received "<<received<<" bytes of message: "<<rec<<endl;
+    if(debug && received > 0) logging::debug()<<"Received "<<received<<" bytes of message: "<<rec;
     return rec;
 }
 
+// resolve the address of a peer port, cached after the first send
+static const endpoint& resolve_peer(endpoint_registry& peers, int port, const char* caller) {
+    try {
+        return peers.resolve(port);
+    } catch (address_list_err& err) {
+        throw socket_exception {string {"socket exception: "} + caller + ": " + err.what()};
+    }
+}
+
 void Socket::send_info_to(int port, const string& s) {
-    // Operations borrowed from Beej's Guide
-    // save address for future send operations
-    if(port != saved_port) {
-        try {
-            saved_addr.free();
-            saved_addr.populate(socktype, port);
-        } catch (address_list_err& err) {
-            throw socket_exception {string {"socket exception: send_info_to: "} + err.what()};
+    const endpoint& peer = resolve_peer(peers, port, "send_info_to");
+
+    // send information to the provided address
+    int sent = sendto(sockfd, s.c_str(), s.size(), 0, (const sockaddr*) &peer.addr, peer.addrlen);
+
+    if(sent == -1) {
+        throw socket_exception {string {"socket exception: send_info_to: "} + strerror(errno)};
+    }
+
+    if(debug) logging::debug()<<"Sent "<<sent<<" bytes of message: "<<s;
+}
+
+// send prepared messages with as few system calls as possible, the kernel may send only part of them per call
+static void send_headers(int sockfd, vector<mmsghdr>& headers, const char* caller) {
+    size_t sent = 0;
+    while(sent < headers.size()) {
+        int n = sendmmsg(sockfd, headers.data() + sent, headers.size() - sent, 0);
+
+        if(n == -1) {
+            if(errno == EINTR) continue;
+            throw socket_exception {string {"socket exception: "} + caller + ": " + strerror(errno)};
         }
 
-        saved_port = port;
+        sent += n;
     }
+}
 
-    int sent = -1;
-    addrinfo* itr = saved_addr.info;
-    for(; itr != nullptr; itr = itr->ai_next) {
-        // send information to the provided address
-        sent = sendto(sockfd, s.c_str(), s.size(), 0, itr->ai_addr, itr->ai_addrlen);
+void Socket::send_many_to(int port, const string* msgs, size_t count) {
+    const endpoint& peer = resolve_peer(peers, port, "send_many_to");
 
-        if(sent == -1) {
-            if(debug) cout<<"invalid send to address: "<<strerror(errno)<<endl;
-            continue;
-        } else break;
+    vector<iovec> data(count);
+    vector<mmsghdr> headers(count);
+
+    for(size_t i = 0; i < count; i++) {
+        data[i] = {const_cast<char*>(msgs[i].data()), msgs[i].size()};
+        headers[i] = {};
+        headers[i].msg_hdr.msg_name = const_cast<sockaddr_storage*>(&peer.addr);
+        headers[i].msg_hdr.msg_namelen = peer.addrlen;
+        headers[i].msg_hdr.msg_iov = &data[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    send_headers(sockfd, headers, "send_many_to");
+
+    if(debug) logging::debug()<<"Sent "<<count<<" messages to port "<<port;
+}
+
+void Socket::send_many_to(const vector<msg_port>& msgs) {
+    if(msgs.empty()) return;
+
+    vector<iovec> data(msgs.size());
+    vector<mmsghdr> headers(msgs.size());
+
+    for(size_t i = 0; i < msgs.size(); i++) {
+        const endpoint& peer = msgs[i].from.addrlen > 0 ? msgs[i].from : resolve_peer(peers, msgs[i].port, "send_many_to");
+
+        data[i] = {const_cast<char*>(msgs[i].msg.data()), msgs[i].msg.size()};
+        headers[i] = {};
+        headers[i].msg_hdr.msg_name = const_cast<sockaddr_storage*>(&peer.addr);
+        headers[i].msg_hdr.msg_namelen = peer.addrlen;
+        headers[i].msg_hdr.msg_iov = &data[i];
+        headers[i].msg_hdr.msg_iovlen = 1;
     }
-    if(itr == nullptr) throw socket_exception {"socket exception: send_info_to: no valid address to send to"};
 
-    if(debug) cout<<"Sent "<<sent<<" bytes of message: "<<s<<endl;
+    send_headers(sockfd, headers, "send_many_to");
+
+    if(debug) logging::debug()<<"Sent "<<msgs.size()<<" messages";
 }
 
 msg_port Socket::recv_info_from() {
@@ -239,10 +321,10 @@ msg_port Socket::recv_info_from() {
     sockaddr_storage connected_to;
     socklen_t sin_size = sizeof(connected_to);
 
-    char data[MAXDATASIZE];    
+    char data[MAXDATAGRAMSIZE];
 
     // receive information as well as sender identity
-    int received = recvfrom(sockfd, data, MAXDATASIZE - 1, 0, (sockaddr*) &connected_to, &sin_size);
+    int received = recvfrom(sockfd, data, MAXDATAGRAMSIZE - 1, 0, (sockaddr*) &connected_to, &sin_size);
 
     if(received == -1) {
         throw socket_exception {string {"socket exception: recv_info_from: "} + strerror(errno)};
@@ -251,15 +333,138 @@ msg_port Socket::recv_info_from() {
     data[received] = 0;
 
     // return both the data and the sender port number
-    msg_port rec {data, ntohs(((sockaddr_in*) &connected_to)->sin_port)};
+    msg_port rec {data, ntohs(((sockaddr_in*) &connected_to)->sin_port), {connected_to, sin_size}};
+
+    if(debug) logging::debug()<<"Socket "<<sockfd<<" received "<<received
+                  <<" bytes from port "<<rec.port
+                  <<" of message: "<<rec.msg;
+
+    return rec;
+}
+
+optional<string> Socket::try_recv_info() {
+    char data[STREAMBUFSIZE];
+
+    // receive whatever information is available on the connected socket
+    int received = recv(sockfd, data, STREAMBUFSIZE, 0);
+
+    if(received == -1) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK) return nullopt;
+        // a reset connection is reported the same way as a closed connection
+        if(errno == ECONNRESET) return string {};
+        throw socket_exception {string {"socket exception: try_recv_info: "} + strerror(errno)};
+    }
+
+    string rec {data, (size_t) received};
+
+    if(debug && received > 0) logging::debug()<<"Received "<<received<<" bytes of message: "<<rec;
+    return rec;
+}
+
+size_t Socket::try_send_info(const char* data, size_t size) {
+    // send as much as the socket buffer allows, without raising SIGPIPE on a closed connection
+    int sent = send(sockfd, data, size, MSG_NOSIGNAL);
+
+    if(sent == -1) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+        throw socket_exception {string {"socket exception: try_send_info: "} + strerror(errno)};
+    }
 
-    if(debug) cout<<"Socket "<<sockfd<<" received "<<received
+    if(debug) logging::debug()<<"Sent "<<sent<<" of "<<size<<" bytes";
+    return sent;
+}
+
+optional<msg_port> Socket::try_recv_info_from() {
+    sockaddr_storage connected_to;
+    socklen_t sin_size = sizeof(connected_to);
+
+    char data[MAXDATAGRAMSIZE];
+
+    // receive a datagram as well as sender identity, if one is queued
+    int received = recvfrom(sockfd, data, MAXDATAGRAMSIZE - 1, MSG_DONTWAIT, (sockaddr*) &connected_to, &sin_size);
+
+    if(received == -1) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK) return nullopt;
+        throw socket_exception {string {"socket exception: try_recv_info_from: "} + strerror(errno)};
+    }
+
+    data[received] = 0;
+    msg_port rec {data, ntohs(((sockaddr_in*) &connected_to)->sin_port), {connected_to, sin_size}};
+
+    if(debug) logging::debug()<<"Socket "<<sockfd<<" received "<<received
                   <<" bytes from port "<<rec.port
-                  <<" of message: "<<rec.msg<<endl;
+                  <<" of message: "<<rec.msg;
 
     return rec;
 }
 
+size_t Socket::try_recv_many_from(datagram_batch& batch, vector<msg_port>& received) {
+    for(size_t i = 0; i < batch.capacity; i++) {
+        // leave room for the terminating null character
+        batch.buffers[i] = {batch.data.data() + i * MAXDATAGRAMSIZE, MAXDATAGRAMSIZE - 1};
+        batch.headers[i] = {};
+        batch.headers[i].msg_hdr.msg_name = &batch.senders[i];
+        batch.headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+        batch.headers[i].msg_hdr.msg_iov = &batch.buffers[i];
+        batch.headers[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    received.clear();
+
+    int count = recvmmsg(sockfd, batch.headers.data(), batch.capacity, MSG_DONTWAIT, nullptr);
+
+    if(count == -1) {
+        if(errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+        throw socket_exception {string {"socket exception: try_recv_many_from: "} + strerror(errno)};
+    }
+
+    for(int i = 0; i < count; i++) {
+        received.push_back({string {static_cast<char*>(batch.buffers[i].iov_base), batch.headers[i].msg_len},
+                            ntohs(((sockaddr_in*) &batch.senders[i])->sin_port),
+                            {batch.senders[i], batch.headers[i].msg_hdr.msg_namelen}});
+
+        if(debug) logging::debug()<<"Socket "<<sockfd<<" received "<<batch.headers[i].msg_len
+                      <<" bytes from port "<<received.back().port
+                      <<" of message: "<<received.back().msg;
+    }
+
+    return count;
+}
+
+bool Socket::wait_readable(int timeout_ms) {
+    pollfd pfd {sockfd, POLLIN, 0};
+
+    int ready = poll(&pfd, 1, timeout_ms);
+
+    if(ready == -1) {
+        // a signal interrupted the wait, let the caller check again
+        if(errno == EINTR) return false;
+        throw socket_exception {string {"socket exception: wait_readable: "} + strerror(errno)};
+    }
+
+    return ready > 0;
+}
+
+void Socket::set_receive_buffer(int bytes) {
+    if(setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &bytes, sizeof(bytes)) == -1) {
+        throw socket_exception {string {"socket exception: set_receive_buffer: "} + strerror(errno)};
+    }
+}
+
+void Socket::set_nonblocking() {
+    int flags = fcntl(sockfd, F_GETFL, 0);
+
+    if(flags == -1 || fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        throw socket_exception {string {"socket exception: set_nonblocking: "} + strerror(errno)};
+    }
+
+    if(debug) logging::debug()<<"Socket "<<sockfd<<" set to non-blocking mode";
+}
+
+int Socket::descriptor() const {
+    return sockfd;
+}
+
 int Socket::bound_port() {
     sockaddr_storage self_addr;
     socklen_t self_size = sizeof(self_addr);
@@ -278,7 +483,7 @@ int Socket::bound_port() {
 void Socket::close_socket() {
     // close if valid
     if(sockfd >= 0) {
-        if(debug) cout<<"Closing socket: "<<sockfd<<endl;
+        if(debug) logging::debug()<<"Closing socket: "<<sockfd;
         
         close(sockfd);
         sockfd = -1;
@@ -297,7 +502,7 @@ void Socket::reap_dead_processes() {
         throw socket_exception {string {"socket exception: reap_dead_processes: "} + strerror(errno)};
     }
 
-    if(debug) cout<<"Reaped dead processes\n";
+    if(debug) logging::debug()<<"Reaped dead processes";
 }
 
 Socket::~Socket() {
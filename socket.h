@@ -1,6 +1,13 @@
+#pragma once
+
 #include <netdb.h>
+#include <optional>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
 
 #include "addr_list.h"
+#include "endpoint_registry.h"
 
 class Socket;
 
@@ -8,6 +15,26 @@ class Socket;
 struct msg_port {
     std::string msg;
     int port;
+
+    // address the message was received from, so a reply goes back to the sender's own host
+    // left empty for messages to send, which are then sent to the registered address of the port
+    endpoint from {};
+};
+
+/*
+ * struct datagram_batch holds the buffers to receive many datagrams through a single system call,
+ * owned by the caller so they are allocated once and reused
+ */
+struct datagram_batch {
+    // most datagrams received by a single call
+    size_t capacity;
+
+    std::vector<char> data;
+    std::vector<sockaddr_storage> senders;
+    std::vector<iovec> buffers;
+    std::vector<mmsghdr> headers;
+
+    explicit datagram_batch(size_t capacity);
 };
 
 /*
@@ -24,6 +51,9 @@ private:
     address_list saved_addr;
     int saved_port;
 
+    // addresses of the peers information is sent to
+    endpoint_registry peers;
+
     // determines whether to display socket debug information
     bool debug;
 
@@ -34,6 +64,12 @@ public:
     // buffer size while receiving information through a socket
     constexpr static int MAXDATASIZE = 1024;
 
+    // buffer size while receiving a datagram through a UDP socket, enough for the largest UDP payload
+    constexpr static int MAXDATAGRAMSIZE = 65536;
+
+    // buffer size while receiving a byte stream through a non-blocking TCP socket
+    constexpr static int STREAMBUFSIZE = 65536;
+
     // constructor
     Socket(int sfd, int stype, int port = -1, bool debug = false);
 
@@ -46,7 +82,8 @@ public:
     Socket& operator=(Socket&&);
 
     // bind socket to provided port
-    void bind_socket(int port);
+    // with reuse_port, several sockets may bind the same port and the kernel spreads incoming connections among them
+    void bind_socket(int port, bool reuse_port = false);
 
     // begin listening on socket
     void listen_socket();
@@ -57,6 +94,10 @@ public:
     // accept connection from a client socket
     Socket accept_socket();
 
+    // accept a pending connection on a non-blocking socket
+    // returns nothing if no connection is pending
+    std::optional<Socket> try_accept_socket();
+
     // send string information to a connected TCP socket
     void send_info(const std::string& s);
 
@@ -70,6 +111,43 @@ public:
     // returns both the received information and the port of the sender
     msg_port recv_info_from();
 
+    // send several messages to the provided port through a UDP socket, with as few system calls as possible
+    void send_many_to(int port, const std::string* msgs, size_t count);
+
+    // send each message to its own port through a UDP socket, with as few system calls as possible
+    // a message carrying the address it was received from is sent back to that address
+    void send_many_to(const std::vector<msg_port>& msgs);
+
+    // receive available information from a non-blocking TCP socket
+    // returns nothing if no information is available, and an empty string if the connection was closed
+    std::optional<std::string> try_recv_info();
+
+    // send as much information as possible through a non-blocking TCP socket
+    // returns the number of bytes sent
+    size_t try_send_info(const char* data, size_t size);
+
+    // receive information through a UDP socket without blocking
+    // returns nothing if no datagram is available
+    std::optional<msg_port> try_recv_info_from();
+
+    // receive as many queued datagrams as the batch holds through a UDP socket without blocking
+    // the datagrams replace the contents of received, returns the number of datagrams received
+    size_t try_recv_many_from(datagram_batch& batch, std::vector<msg_port>& received);
+
+    // wait until information can be received, or the timeout in milliseconds passes
+    // a negative timeout waits indefinitely, returns false on timeout
+    bool wait_readable(int timeout_ms);
+
+    // switch the socket to non-blocking mode
+    void set_nonblocking();
+
+    // ask for a larger receive buffer, so bursts of datagrams are queued rather than dropped
+    // the kernel may grant less than asked
+    void set_receive_buffer(int bytes);
+
+    // returns the socket file descriptor, for registering the socket with an event loop
+    int descriptor() const;
+
     // returns the port number to which the socket is bound
     int bound_port();
 
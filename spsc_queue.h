@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/*
+ * class spsc_queue is a bounded queue between exactly one producer thread and one consumer thread,
+ * passing elements without locks
+ *
+ * each side only writes its own index, and keeps a copy of the other side's index,
+ * reading the shared one again only once its copy says the queue is full or empty
+ */
+template <typename T>
+class spsc_queue {
+private:
+    std::vector<T> slots;
+    size_t mask;
+
+    // index of the next element to pop, along with the consumer's copy of tail
+    alignas(64) std::atomic<size_t> head {0};
+    size_t cached_tail {0};
+
+    // index of the next element to push, along with the producer's copy of head
+    alignas(64) std::atomic<size_t> tail {0};
+    size_t cached_head {0};
+
+    // rounds the capacity up to a power of two, so indices wrap with a mask
+    static size_t round_up(size_t capacity) {
+        size_t size = 1;
+        while(size < capacity) size <<= 1;
+        return size;
+    }
+
+public:
+    // allocate a queue holding at least the provided number of elements
+    explicit spsc_queue(size_t capacity): slots(round_up(capacity)), mask {slots.size() - 1} {}
+
+    // disallow copy operations, the indices are shared by two threads
+    spsc_queue(const spsc_queue&) = delete;
+    spsc_queue& operator=(const spsc_queue&) = delete;
+
+    // add an element, called by the producer only
+    // returns false if the queue is full, leaving the element untouched
+    bool try_push(T&& value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+
+        if(t - cached_head == slots.size()) {
+            cached_head = head.load(std::memory_order_acquire);
+            if(t - cached_head == slots.size()) return false;
+        }
+
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // take the oldest element, called by the consumer only
+    // returns false if the queue is empty
+    bool try_pop(T& value) {
+        size_t h = head.load(std::memory_order_relaxed);
+
+        if(h == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if(h == cached_tail) return false;
+        }
+
+        value = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
@@ -0,0 +1,146 @@
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <string>
+#include <sys/mman.h>
+
+#include "stats.h"
+
+using namespace std;
+
+// bits of a latency, below its leading bit, that pick its bucket within its power of two
+constexpr int SUB_BUCKET_BITS = 4;
+static_assert(HISTOGRAM_SUB_BUCKETS == 1 << SUB_BUCKET_BITS, "sub buckets must split a power of two");
+
+// quantiles reported for every stage
+constexpr double QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+
+// bucket of a latency in nanoseconds
+// latencies below the number of sub buckets have a bucket each, larger ones share a bucket with their neighbours
+static size_t bucket_of(uint64_t value) {
+    if(value < HISTOGRAM_SUB_BUCKETS) return value;
+
+    int exponent = 63 - __builtin_clzll(value);
+    return (exponent - SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS + ((value >> (exponent - SUB_BUCKET_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+
+// largest latency in nanoseconds counted in a bucket
+static uint64_t bucket_limit(size_t bucket) {
+    if(bucket < HISTOGRAM_SUB_BUCKETS) return bucket;
+
+    int exponent = bucket / HISTOGRAM_SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    uint64_t lowest = (HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << (exponent - SUB_BUCKET_BITS);
+    return lowest + (uint64_t {1} << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+
+// latency in nanoseconds at or below which the provided fraction of the counted latencies fall,
+// taken as the upper limit of the smallest bucket reaching it, and never beyond the largest latency seen
+static uint64_t quantile_of(const vector<uint64_t>& buckets, uint64_t total, uint64_t largest, double q) {
+    uint64_t rank = max<uint64_t>(static_cast<uint64_t>(q * total + 0.5), 1);
+    uint64_t seen = 0;
+    for(size_t b = 0; b < HISTOGRAM_BUCKETS && total > 0; b++) {
+        seen += buckets[b];
+        if(seen >= rank) return min(bucket_limit(b), largest);
+    }
+
+    return 0;
+}
+
+
+// copy the buckets of a histogram, returning the number of latencies they hold
+// the buckets are read once, so quantiles taken from the copy agree with each other while other threads keep recording
+static uint64_t read_buckets(const latency_histogram& h, vector<uint64_t>& buckets) {
+    buckets.assign(HISTOGRAM_BUCKETS, 0);
+    uint64_t total = 0;
+    for(size_t b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        buckets[b] = h.buckets[b].load(memory_order_relaxed);
+        total += buckets[b];
+    }
+
+    return total;
+}
+
+
+// nanoseconds in seconds, as metrics are reported in base units
+static string seconds(uint64_t nanoseconds) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.9f", nanoseconds / 1e9);
+    return text;
+}
+
+
+stats_registry::stats_registry(const string& prefix, const vector<string>& counter_names, const vector<string>& stage_names):
+    prefix {prefix}, counter_names {counter_names}, stage_names {stage_names}, counters {nullptr}, stages {nullptr}, region {nullptr} {
+    // the histograms follow the counters, both zeroed as anonymous memory is
+    size_t counters_size = (counter_names.size() * sizeof(atomic<uint64_t>) + alignof(latency_histogram) - 1) / alignof(latency_histogram) * alignof(latency_histogram);
+    region_size = counters_size + stage_names.size() * sizeof(latency_histogram);
+
+    region = mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(region == MAP_FAILED) throw stats_exception {string {"stats exception: stats_registry: "} + strerror(errno)};
+
+    counters = static_cast<atomic<uint64_t>*>(region);
+    stages = reinterpret_cast<latency_histogram*>(static_cast<char*>(region) + counters_size);
+}
+
+
+void stats_registry::record(size_t stage, chrono::steady_clock::duration elapsed) {
+    latency_histogram& h = stages[stage];
+    uint64_t value = max<int64_t>(0, chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+
+    h.buckets[bucket_of(value)].fetch_add(1, memory_order_relaxed);
+    h.count.fetch_add(1, memory_order_relaxed);
+    h.sum.fetch_add(value, memory_order_relaxed);
+
+    uint64_t largest = h.max.load(memory_order_relaxed);
+    while(value > largest && !h.max.compare_exchange_weak(largest, value, memory_order_relaxed)) {}
+}
+
+
+string stats_registry::report() const {
+    string out {};
+
+    for(size_t i = 0; i < counter_names.size(); i++) {
+        out += prefix + '_' + counter_names[i] + ' ' + to_string(counters[i].load(memory_order_relaxed)) + '\n';
+    }
+
+    for(size_t i = 0; i < stage_names.size(); i++) {
+        const latency_histogram& h = stages[i];
+        const string name = prefix + "_stage_latency_seconds";
+        const string label = "stage=\"" + stage_names[i] + '"';
+
+        vector<uint64_t> buckets {};
+        uint64_t total = read_buckets(h, buckets);
+        uint64_t largest = h.max.load(memory_order_relaxed);
+
+        for(double q : QUANTILES) {
+            char quantile[16];
+            snprintf(quantile, sizeof(quantile), "%g", q);
+            out += name + '{' + label + ",quantile=\"" + quantile + "\"} " + seconds(quantile_of(buckets, total, largest, q)) + '\n';
+        }
+
+        out += name + '{' + label + ",quantile=\"1\"} " + seconds(largest) + '\n';
+        out += name + "_sum{" + label + "} " + seconds(h.sum.load(memory_order_relaxed)) + '\n';
+        out += name + "_count{" + label + "} " + to_string(h.count.load(memory_order_relaxed)) + '\n';
+    }
+
+    return out;
+}
+
+
+chrono::nanoseconds stats_registry::quantile(size_t stage, double q) const {
+    vector<uint64_t> buckets {};
+    uint64_t total = read_buckets(stages[stage], buckets);
+
+    return chrono::nanoseconds {quantile_of(buckets, total, stages[stage].max.load(memory_order_relaxed), q)};
+}
+
+
+stats_registry::~stats_registry() {
+    if(region != nullptr) munmap(region, region_size);
+}
+
+
+stats_exception::stats_exception(const string& err) : std::runtime_error{err} {}
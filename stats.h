@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// latencies are counted in buckets of logarithmic width, each power of two split into this many buckets,
+// so a latency is known to within about six percent whatever its magnitude
+constexpr size_t HISTOGRAM_SUB_BUCKETS = 16;
+
+// buckets covering every latency in nanoseconds a 64 bit count holds
+constexpr size_t HISTOGRAM_BUCKETS = (64 - 4 + 1) * HISTOGRAM_SUB_BUCKETS;
+
+/*
+ * struct latency_histogram counts the latencies of a stage, along with their total and their maximum
+ */
+struct latency_histogram {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+
+    std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+};
+
+/*
+ * class stats_registry holds the counters and stage latency histograms of a server,
+ * allocated in memory that stays shared with forked child processes,
+ * so the counts of every process and thread add up in a single place
+ *
+ * counters and stages are named at construction and updated by their position,
+ * with relaxed atomic additions only, so updating them costs no lock and no system call
+ *
+ * a report lists them in the Prometheus text format, for monitoring to scrape
+ */
+class stats_registry {
+private:
+    // prepended to the name of every metric, such as serverM
+    std::string prefix;
+
+    // counter names may carry labels, such as requests_total{type="availability"}
+    std::vector<std::string> counter_names;
+    std::vector<std::string> stage_names;
+
+    std::atomic<uint64_t>* counters;
+    latency_histogram* stages;
+
+    void* region;
+    size_t region_size;
+
+public:
+    // allocate zeroed counters and histograms for the provided names
+    stats_registry(const std::string& prefix, const std::vector<std::string>& counter_names, const std::vector<std::string>& stage_names);
+
+    // disallow copy operations to maintain unique ownership of the shared memory
+    stats_registry(const stats_registry&) = delete;
+    stats_registry& operator=(const stats_registry&) = delete;
+
+    // add to the counter at the provided position
+    void count(size_t counter, uint64_t n = 1) {
+        counters[counter].fetch_add(n, std::memory_order_relaxed);
+    }
+
+    // record a latency of the stage at the provided position
+    void record(size_t stage, std::chrono::steady_clock::duration elapsed);
+
+    // record the latency of a stage started at the provided time and ending now
+    void record_since(size_t stage, std::chrono::steady_clock::time_point start) {
+        record(stage, std::chrono::steady_clock::now() - start);
+    }
+
+    // returns the value of the counter at the provided position
+    uint64_t counted(size_t counter) const {
+        return counters[counter].load(std::memory_order_relaxed);
+    }
+
+    // returns the number of latencies recorded for the stage at the provided position
+    uint64_t recorded(size_t stage) const {
+        return stages[stage].count.load(std::memory_order_relaxed);
+    }
+
+    // returns the latency at or below which the provided fraction of the latencies of a stage fall, within a bucket
+    std::chrono::nanoseconds quantile(size_t stage, double q) const;
+
+    // returns every counter, and the count, total and quantiles of every stage, in the Prometheus text format
+    std::string report() const;
+
+    // release the shared memory
+    ~stats_registry();
+};
+
+class stats_exception : public std::runtime_error {
+public:
+    stats_exception(const std::string& err);
+};
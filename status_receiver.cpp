@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <charconv>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "status_receiver.h"
+#include "constants.h"
+#include "logger.h"
+
+using namespace std;
+using namespace socket_constants;
+
+
+status_receiver::status_receiver(const map<int, char>& bknd, const hash_ring& hr, room_table& rs):
+    backend {bknd}, ring {hr}, room_status {rs}, transfers {}, strays {}, serving {false} {
+
+    for(const pair<const int, char>& b : backend) transfers.insert({b.first, {}});
+}
+
+
+bool status_receiver::is_chunk(const string& msg) {
+    return msg.compare(0, 1, TRANSFER_CHUNK) == 0;
+}
+
+
+bool status_receiver::receive(Socket& sock, const msg_port& rec) {
+    map<int, status_transfer>::iterator tf = transfers.find(rec.port);
+    size_t header_end = rec.msg.find('\n');
+    if(tf == transfers.end() || !is_chunk(rec.msg) || header_end == string::npos) return false;
+
+    string id, sequence, total;
+    istringstream header {rec.msg.substr(1, header_end - 1)};
+    if(!getline(header, id, ',') || !getline(header, sequence, ',') || !getline(header, total)) return false;
+
+    status_transfer& t = tf->second;
+    if(id != t.id) {
+        // a backend server that restarted begins a new transfer
+        // while starting up, the rooms of the earlier one are forgotten, a serving table keeps them and takes the new counts
+        if(!serving) {
+            vector<string> earlier {};
+            room_status.for_each([&](string_view code, const room_slot& slot) {
+                if(slot.owner.load(memory_order_relaxed) == rec.port) earlier.emplace_back(code);
+            });
+            for(const string& room : earlier) room_status.erase(room);
+        } else if(t.done) {
+            logging::info()<<"The main server is receiving the room status from Server "<<backend.find(rec.port)->second<<" again.";
+        }
+
+        t = {id, 0, strtoul(total.c_str(), nullptr, 10)};
+    }
+
+    // keep chunks within the window, ones further ahead will be sent again
+    size_t seq = strtoul(sequence.c_str(), nullptr, 10);
+    if(!t.done && seq >= t.next && seq < t.next + TRANSFER_WINDOW) t.ahead.emplace(seq, rec.msg.substr(header_end + 1));
+
+    while(!t.ahead.empty() && t.ahead.begin()->first == t.next) {
+        take_rooms(rec.port, t, t.ahead.begin()->second);
+
+        t.ahead.erase(t.ahead.begin());
+        t.next++;
+    }
+
+    bool completed = false;
+    if(!t.done && t.next == t.total) {
+        // backend server has finished transmission
+        t.done = true;
+        completed = true;
+
+        const char server_name = backend.find(rec.port)->second;
+        logging::info()<<"The main server has received the room status from Server "<<server_name<<" using UDP over port "<<serverM_backend<<".";
+        if(t.unknown > 0) logging::warning()<<"The main server left out "<<t.unknown<<" new rooms of Server "<<server_name<<" until it restarts.";
+    }
+
+    // repeated chunks are acknowledged as well, since the earlier acknowledgement may have been lost
+    sock.send_info_to(rec.port, TRANSFER_CHUNK + t.id + ',' + to_string(t.next));
+    return completed;
+}
+
+
+void status_receiver::take_rooms(int port, status_transfer& t, const string& chunk) {
+    // chunks can carry thousands of rooms, so they are scanned in place rather than through a string stream
+    string_view rest {chunk};
+    while(!rest.empty()) {
+        size_t line_end = rest.find('\n');
+        string_view line = rest.substr(0, line_end);
+        rest.remove_prefix(line_end == string_view::npos ? rest.size() : line_end + 1);
+
+        size_t comma = line.rfind(',');
+        int number;
+        if(comma == string_view::npos || from_chars(line.data() + comma + 1, line.data() + line.size(), number).ec != errc {}) continue;
+
+        string_view room = line.substr(0, comma);
+        room_slot* saved = room_status.find(room);
+
+        // a serving table only takes the counts of the rooms it holds for the backend server
+        if(serving) {
+            if(saved == nullptr) t.unknown++;
+            else if(saved->owner.load(memory_order_relaxed) == port) saved->count.store(number, memory_order_relaxed);
+            continue;
+        }
+
+        // save room status information, mapping a room to its corresponding server (port number) and the count of the room
+        if(saved == nullptr || saved->owner.load(memory_order_relaxed) == port) {
+            room_status.insert(room, port, number);
+        } else if(ring.owner(room) == port) {
+            strays.emplace_back(room, saved->owner.load(memory_order_relaxed));
+            room_status.insert(room, port, number);
+        } else {
+            strays.emplace_back(room, port);
+        }
+    }
+}
+
+
+void status_receiver::add(int port) {
+    transfers.insert({port, {}});
+}
+
+
+bool status_receiver::complete() const {
+    return all_of(transfers.begin(), transfers.end(), [](const pair<const int, status_transfer>& t) { return t.second.done; });
+}
+
+
+bool status_receiver::received(int port) const {
+    map<int, status_transfer>::const_iterator t = transfers.find(port);
+    return t != transfers.end() && t->second.done;
+}
+
+
+const vector<pair<string, int>>& status_receiver::stray_rooms() const {
+    return strays;
+}
+
+
+void status_receiver::serve() {
+    serving = true;
+}
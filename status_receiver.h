@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "hash_ring.h"
+#include "room_table.h"
+#include "socket.h"
+
+// progress of the room status transfer from a backend server
+struct status_transfer {
+    std::string id {};
+
+    // sequence number of the next chunk to parse, and the number of chunks in the transfer
+    size_t next {0};
+    size_t total {0};
+
+    // chunks received ahead of the next one, keyed by sequence number
+    std::map<size_t, std::string> ahead {};
+
+    // rooms of the transfer the room table does not hold, which a serving main server cannot add
+    size_t unknown {0};
+
+    bool done {false};
+};
+
+/*
+ * class status_receiver takes in the room status transfers of the backend servers,
+ * acknowledging every chunk received with the next chunk expected, so the backend servers resend what was lost
+ *
+ * while the main server starts up, the rooms go straight into the room table, which grows as they arrive
+ * once the main server serves clients, the table is shared and may no longer grow,
+ * so the transfer of a backend server that restarted only updates the counts of the rooms the table holds
+ */
+class status_receiver {
+private:
+    // collection of backend servers, mapping their port to their names
+    const std::map<int, char>& backend;
+
+    // consistent hash ring mapping rooms to the ports of their backend servers
+    const hash_ring& ring;
+
+    // table of each room's backend server and count
+    room_table& room_status;
+
+    // transfer from each backend server, keyed by its port
+    std::map<int, status_transfer> transfers;
+
+    // rooms reported by two backend servers while starting up, along with the backend server holding the copy to remove
+    std::vector<std::pair<std::string, int>> strays;
+
+    // whether the table is shared with clients being served
+    bool serving;
+
+    // parse a chunk of room status, one room and its count per line separated by a comma
+    void take_rooms(int port, status_transfer& t, const std::string& chunk);
+
+public:
+    // constructor
+    status_receiver(const std::map<int, char>& backend, const hash_ring& ring, room_table& room_status);
+
+    // returns whether a datagram is a chunk of room status
+    static bool is_chunk(const std::string& msg);
+
+    // take in and acknowledge a chunk of room status from a backend server
+    // chunks from other ports are dropped, returns true if the chunk completed a transfer
+    bool receive(Socket& sock, const msg_port& chunk);
+
+    // take in the transfers of a backend server added to the topology while serving
+    void add(int port);
+
+    // returns whether every backend server has completed a transfer
+    bool complete() const;
+
+    // returns whether the backend server with the provided port has completed a transfer
+    bool received(int port) const;
+
+    // rooms reported by two backend servers while starting up, left behind by an interrupted rebalancing
+    // a room is kept from its owner on the ring, and each entry names the other backend server holding it
+    const std::vector<std::pair<std::string, int>>& stray_rooms() const;
+
+    // stop adding and removing rooms, since the table is about to be shared with clients being served
+    void serve();
+};
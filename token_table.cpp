@@ -0,0 +1,134 @@
+#include <cstring>
+#include <errno.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/random.h>
+
+#include "token_table.h"
+
+using namespace std;
+
+static_assert(sizeof(token_slot) == 128, "token slots must fill two cache lines");
+
+// bytes of a token, sent as twice as many hexadecimal characters
+constexpr size_t TOKEN_SIZE = sizeof(token_slot::secret);
+
+// times an issue tries another slot when the one picked is being written by another process or thread
+constexpr int ISSUE_ATTEMPTS = 4;
+
+
+// current time on the steady clock in nanoseconds, the same in every process of the machine
+static int64_t now() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+// decode a token of hexadecimal characters, returning false if it is malformed
+static bool decode_token(string_view token, uint64_t secret[2]) {
+    if(token.size() != TOKEN_SIZE * 2) return false;
+
+    secret[0] = secret[1] = 0;
+    for(size_t i = 0; i < token.size(); i++) {
+        char c = token[i];
+        uint64_t digit;
+
+        if(c >= '0' && c <= '9') digit = c - '0';
+        else if(c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else return false;
+
+        secret[i / 16] = secret[i / 16] << 4 | digit;
+    }
+
+    return true;
+}
+
+
+// encode a token as hexadecimal characters
+static string encode_token(const uint64_t secret[2]) {
+    constexpr char digits[] = "0123456789abcdef";
+    string token(TOKEN_SIZE * 2, '0');
+
+    for(size_t i = 0; i < token.size(); i++) {
+        token[i] = digits[secret[i / 16] >> (60 - 4 * (i % 16)) & 0xf];
+    }
+
+    return token;
+}
+
+
+token_table::token_table(size_t max_tokens, chrono::seconds lifetime): slots {nullptr}, capacity {16}, lifetime {lifetime} {
+    while(capacity < max_tokens) capacity *= 2;
+
+    // anonymous shared memory starts zeroed, which marks every slot as free
+    void* region = mmap(nullptr, capacity * sizeof(token_slot), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(region == MAP_FAILED) throw token_table_exception {string {"token_table exception: token_table: "} + strerror(errno)};
+
+    slots = static_cast<token_slot*>(region);
+}
+
+
+string token_table::issue(string_view username, bool member) {
+    if(username.size() > TOKEN_USERNAME_SIZE) return "";
+
+    for(int attempt = 0; attempt < ISSUE_ATTEMPTS; attempt++) {
+        // tokens come from the kernel's random source, so a token cannot be guessed from the ones seen before
+        uint64_t secret[2];
+        if(getrandom(secret, sizeof(secret), 0) != sizeof(secret)) return "";
+
+        // a zero secret marks a free slot
+        if(secret[0] == 0 && secret[1] == 0) continue;
+
+        token_slot& slot = slots[secret[0] & (capacity - 1)];
+
+        // claim the slot by making its sequence odd, leaving it to another writer already holding it
+        uint32_t sequence = slot.sequence.load(memory_order_relaxed);
+        if(sequence & 1) continue;
+        if(!slot.sequence.compare_exchange_strong(sequence, sequence + 1, memory_order_acquire)) continue;
+        atomic_thread_fence(memory_order_release);
+
+        slot.member = member;
+        slot.length = static_cast<uint8_t>(username.size());
+        slot.expires = now() + lifetime.count();
+        memcpy(slot.secret, secret, sizeof(secret));
+        memcpy(slot.username, username.data(), username.size());
+
+        slot.sequence.store(sequence + 2, memory_order_release);
+        return encode_token(secret);
+    }
+
+    return "";
+}
+
+
+optional<token_grant> token_table::redeem(string_view token) const {
+    uint64_t secret[2];
+    if(!decode_token(token, secret) || (secret[0] == 0 && secret[1] == 0)) return nullopt;
+
+    const token_slot& slot = slots[secret[0] & (capacity - 1)];
+
+    // copy the slot, and only trust the copy if no writer touched the slot meanwhile
+    uint32_t sequence = slot.sequence.load(memory_order_acquire);
+    if(sequence & 1) return nullopt;
+
+    uint64_t saved[2];
+    memcpy(saved, slot.secret, sizeof(saved));
+    int64_t expires = slot.expires;
+    bool member = slot.member;
+    size_t length = min<size_t>(slot.length, TOKEN_USERNAME_SIZE);
+    string username {slot.username, length};
+
+    atomic_thread_fence(memory_order_acquire);
+    if(slot.sequence.load(memory_order_relaxed) != sequence) return nullopt;
+
+    if(saved[0] != secret[0] || saved[1] != secret[1] || expires <= now()) return nullopt;
+
+    return token_grant {std::move(username), member};
+}
+
+
+token_table::~token_table() {
+    if(slots != nullptr) munmap(slots, capacity * sizeof(token_slot));
+}
+
+
+token_table_exception::token_table_exception(const string& err) : std::runtime_error{err} {}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// usernames up to this length are kept along with their tokens, longer ones are never issued a token
+constexpr size_t TOKEN_USERNAME_SIZE = 94;
+
+/*
+ * struct token_slot is a single entry of a token table
+ * the sequence is odd while the slot is being written, and readers retry or give up if it changes under them
+ */
+struct alignas(64) token_slot {
+    std::atomic<uint32_t> sequence;
+
+    uint8_t member;
+    uint8_t length;
+
+    // steady clock time the token stops being accepted, in nanoseconds
+    int64_t expires;
+
+    // random token, zero in a free slot
+    uint64_t secret[2];
+
+    char username[TOKEN_USERNAME_SIZE];
+};
+
+// the session a token was issued for
+struct token_grant {
+    std::string username;
+    bool member;
+};
+
+/*
+ * class token_table holds the session tokens issued to authenticated clients, so a client reconnecting
+ * with its token is served without authenticating again
+ *
+ * the table is allocated in memory that stays shared with forked child processes,
+ * so a token issued by any process or thread is accepted by all of them
+ *
+ * a token picks its slot from its own random bits, overwriting whichever token held the slot before,
+ * so the table never grows and an evicted client simply authenticates again
+ */
+class token_table {
+private:
+    token_slot* slots;
+    size_t capacity;
+
+    std::chrono::nanoseconds lifetime;
+
+public:
+    // allocate a table of at least the provided number of slots, issuing tokens accepted for the provided time
+    explicit token_table(size_t max_tokens = 65536, std::chrono::seconds lifetime = std::chrono::minutes {10});
+
+    // disallow copy operations to maintain unique ownership of the shared memory
+    token_table(const token_table&) = delete;
+    token_table& operator=(const token_table&) = delete;
+
+    // issue a token for an authenticated session, as 32 hexadecimal characters
+    // returns an empty string if no token can be issued
+    std::string issue(std::string_view username, bool member);
+
+    // returns the session of a token, or nothing if the token is unknown, evicted or expired
+    std::optional<token_grant> redeem(std::string_view token) const;
+
+    // release the shared memory
+    ~token_table();
+};
+
+class token_table_exception : public std::runtime_error {
+public:
+    token_table_exception(const std::string& err);
+};